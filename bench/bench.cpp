@@ -0,0 +1,270 @@
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <random>
+
+#include "../convolution.h"
+#include "../downscale.h"
+#include "../gaussian.h"
+#include "../grayscale.h"
+#include "../integral.h"
+#include "../remap.h"
+#include "../resize.h"
+#include "../rotate.h"
+
+constexpr size_t kBenchImageSide = 1024;
+constexpr size_t kBenchMaxMatrixSize = 41;
+constexpr size_t kBenchRepetitions = 3;
+constexpr size_t kBenchGrayscaleWidth = 8192;
+constexpr size_t kBenchGrayscaleHeight = 6144;
+// A 24 MP photo to a 1 MP thumbnail.
+constexpr size_t kBenchResizeSourceWidth = 6000;
+constexpr size_t kBenchResizeSourceHeight = 4000;
+constexpr size_t kBenchResizeWidth = 1224;
+constexpr size_t kBenchResizeHeight = 816;
+
+Plane MakeRandomPlane(size_t width, size_t height) {
+    std::mt19937 generator(42);
+    std::uniform_int_distribution<int> distribution(kMinRgb, kMaxRgb);
+    Plane plane(width, height);
+    for (auto& value : plane.data) {
+        value = static_cast<uint8_t>(distribution(generator));
+    }
+    return plane;
+}
+
+template <typename Function>
+double MeasureMilliseconds(Function&& function) {
+    double best = std::numeric_limits<double>::max();
+    for (size_t repetition = 0; repetition < kBenchRepetitions; ++repetition) {
+        auto start = std::chrono::steady_clock::now();
+        function();
+        best = std::min(best, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() -
+                                                                          start).count());
+    }
+    return best;
+}
+
+void BenchFftThreshold() {
+    Plane source = MakeRandomPlane(kBenchImageSide, kBenchImageSide);
+    Plane destination;
+    size_t threshold = 0;
+
+    std::cout << "FFT convolution threshold, " << kBenchImageSide << "x" << kBenchImageSide << " plane\n";
+    std::cout << "matrix\tdirect ms\tfft ms\n";
+    for (size_t matrix_size = 3; matrix_size <= kBenchMaxMatrixSize; matrix_size += 2) {
+        CoefficientsMatrix matrix(matrix_size, CoefficientsVector(matrix_size, 1.0 / (matrix_size * matrix_size)));
+        double direct = MeasureMilliseconds([&] { ConvolveDirect<double>(source, destination, matrix); });
+        double fft = MeasureMilliseconds([&] { ConvolveFft(source, destination, matrix); });
+        std::cout << matrix_size << "\t" << direct << "\t" << fft << "\n";
+        if (threshold == 0 && fft < direct) {
+            threshold = matrix_size;
+        }
+    }
+    std::cout << "measured kFftConvolutionMinMatrixSize: " << threshold << " (current "
+              << kFftConvolutionMinMatrixSize << ")\n";
+}
+
+void BenchPrecision() {
+    Plane source = MakeRandomPlane(kBenchImageSide, kBenchImageSide);
+    Plane destination;
+    const CoefficientsMatrix sharpening = {{0, -1, 0}, {-1, 5, -1}, {0, -1, 0}};
+    auto megapixels = static_cast<double>(kBenchImageSide * kBenchImageSide) / 1e6;
+
+    std::cout << "Convolution throughput, megapixels per second\n";
+    std::cout << "kernel\tfloat\tdouble\tlinear float\n";
+    double float_ms = MeasureMilliseconds([&] { ConvolveDirect<float>(source, destination, sharpening); });
+    double double_ms = MeasureMilliseconds([&] { ConvolveDirect<double>(source, destination, sharpening); });
+    double linear_ms = MeasureMilliseconds([&] {
+        ConvolveDirect<float>(source, destination, sharpening, LightMode::kLinear);
+    });
+    std::cout << "3x3\t" << megapixels * 1000 / float_ms << "\t" << megapixels * 1000 / double_ms << "\t"
+              << megapixels * 1000 / linear_ms << "\n";
+
+    for (auto sigma : kStandardGaussianSigmas) {
+        auto float_kernel = GetGaussianKernel<float>(sigma);
+        auto double_kernel = GetGaussianKernel<double>(sigma);
+        float_ms = MeasureMilliseconds([&] {
+            ConvolveSeparable(source, destination, float_kernel->kernel, float_kernel->kernel);
+        });
+        double_ms = MeasureMilliseconds([&] {
+            ConvolveSeparable(source, destination, double_kernel->kernel, double_kernel->kernel);
+        });
+        linear_ms = MeasureMilliseconds([&] {
+            ConvolveSeparable(source, destination, float_kernel->kernel, float_kernel->kernel, LightMode::kLinear);
+        });
+        std::cout << "blur " << sigma << "\t" << megapixels * 1000 / float_ms << "\t"
+                  << megapixels * 1000 / double_ms << "\t" << megapixels * 1000 / linear_ms << "\n";
+    }
+}
+
+// A copy of the same bytes is the memory-bound ceiling the gray conversion is compared to.
+void BenchGrayscale() {
+    Plane bytes = MakeRandomPlane(kBenchGrayscaleWidth * kAmountOfPrimaryColors, kBenchGrayscaleHeight);
+    std::vector<PixelColor> pixels(kBenchGrayscaleWidth * kBenchGrayscaleHeight);
+    std::memcpy(pixels.data(), bytes.data.data(), bytes.data.size());
+    std::vector<uint8_t> gray(pixels.size());
+    auto megapixels = static_cast<double>(pixels.size()) / 1e6;
+
+    std::cout << "Grayscale of " << megapixels << " MP, megapixels per second\n";
+    double copy_ms = MeasureMilliseconds([&] {
+        std::memcpy(bytes.data.data(), pixels.data(), bytes.data.size());
+    });
+    std::cout << "copy\t" << megapixels * 1000 / copy_ms << "\n";
+    for (auto level : {SimdLevel::kScalar, DetectSimdLevel()}) {
+        SetSimdLevel(level);
+        double gray_ms = MeasureMilliseconds([&] {
+            for (size_t y = 0; y < kBenchGrayscaleHeight; ++y) {
+                ConvertRowToGray(pixels.data() + y * kBenchGrayscaleWidth, gray.data() + y * kBenchGrayscaleWidth,
+                                 kBenchGrayscaleWidth);
+            }
+        });
+        std::cout << "level " << static_cast<int>(level) << "\t" << megapixels * 1000 / gray_ms << "\n";
+    }
+    SetSimdLevel(DetectSimdLevel());
+}
+
+// Three planes, as for a colour image.
+void BenchResize() {
+    Plane source = MakeRandomPlane(kBenchResizeSourceWidth, kBenchResizeSourceHeight);
+    Plane destination;
+
+    std::cout << "Resize of three " << kBenchResizeSourceWidth << "x" << kBenchResizeSourceHeight << " planes to "
+              << kBenchResizeWidth << "x" << kBenchResizeHeight << ", milliseconds\n";
+    std::cout << "filter\tscalar\tvector\n";
+    const std::pair<std::string_view, ResizeFilter> filters[] = {{kResizeNearestName, ResizeFilter::kNearest},
+                                                                 {kResizeBilinearName, ResizeFilter::kBilinear},
+                                                                 {kResizeBicubicName, ResizeFilter::kBicubic},
+                                                                 {kResizeLanczos3Name, ResizeFilter::kLanczos3}};
+    for (auto [name, filter] : filters) {
+        std::cout << name;
+        for (auto level : {SimdLevel::kScalar, DetectSimdLevel()}) {
+            SetSimdLevel(level);
+            double resize_ms = MeasureMilliseconds([&] {
+                ResampleWeights horizontal = ComputeResampleWeights(source.width, kBenchResizeWidth, filter);
+                ResampleWeights vertical = ComputeResampleWeights(source.height, kBenchResizeHeight, filter);
+                for (size_t channel = 0; channel < kAmountOfPrimaryColors; ++channel) {
+                    ResamplePlane(source, destination, horizontal, vertical);
+                }
+            });
+            std::cout << "\t" << resize_ms;
+        }
+        std::cout << "\n";
+    }
+    SetSimdLevel(DetectSimdLevel());
+}
+
+void BenchDownscale() {
+    Plane source = MakeRandomPlane(kBenchResizeSourceWidth, kBenchResizeSourceHeight);
+
+    std::cout << "Downscale of three " << kBenchResizeSourceWidth << "x" << kBenchResizeSourceHeight
+              << " planes, milliseconds\n";
+    std::cout << "factor\tscalar\tvector\n";
+    for (size_t factor : {2, 4, 5}) {
+        std::cout << factor;
+        for (auto level : {SimdLevel::kScalar, DetectSimdLevel()}) {
+            SetSimdLevel(level);
+            double downscale_ms = MeasureMilliseconds([&] {
+                for (size_t channel = 0; channel < kAmountOfPrimaryColors; ++channel) {
+                    DownscalePlane(source, factor);
+                }
+            });
+            std::cout << "\t" << downscale_ms;
+        }
+        std::cout << "\n";
+    }
+    SetSimdLevel(DetectSimdLevel());
+}
+
+void BenchPyramid() {
+    constexpr size_t levels_count = 4;
+    Plane source = MakeRandomPlane(kBenchResizeSourceWidth, kBenchResizeSourceHeight);
+
+    std::cout << "Pyramid of " << levels_count << " levels of three " << kBenchResizeSourceWidth << "x"
+              << kBenchResizeSourceHeight << " planes, milliseconds\n";
+    double separate_ms = MeasureMilliseconds([&] {
+        for (size_t channel = 0; channel < kAmountOfPrimaryColors; ++channel) {
+            for (size_t level = 1; level <= levels_count; ++level) {
+                DownscalePlane(source, size_t{1} << level);
+            }
+        }
+    });
+    double streamed_ms = MeasureMilliseconds([&] {
+        for (size_t channel = 0; channel < kAmountOfPrimaryColors; ++channel) {
+            PyramidBuilder pyramid(source.width, source.height, levels_count);
+            for (size_t y = 0; y < source.height; ++y) {
+                pyramid.AddRow(y, source.Row(y));
+            }
+        }
+    });
+    std::cout << "each level from the source\t" << separate_ms << "\n";
+    std::cout << "streamed from level to level\t" << streamed_ms << "\n";
+}
+
+void BenchRotate() {
+    Plane source = MakeRandomPlane(kBenchResizeSourceWidth, kBenchResizeSourceHeight);
+    Plane destination;
+
+    std::cout << "Rotation of three " << kBenchResizeSourceWidth << "x" << kBenchResizeSourceHeight
+              << " planes, milliseconds\n";
+    std::cout << "rotation\tscalar\tvector\n";
+    const std::pair<std::string_view, Rotation> rotations[] = {{"90", Rotation::kRotate90},
+                                                               {"180", Rotation::kRotate180},
+                                                               {"transpose", Rotation::kTranspose}};
+    for (auto [name, rotation] : rotations) {
+        std::cout << name;
+        for (auto level : {SimdLevel::kScalar, DetectSimdLevel()}) {
+            SetSimdLevel(level);
+            double rotate_ms = MeasureMilliseconds([&] {
+                for (size_t channel = 0; channel < kAmountOfPrimaryColors; ++channel) {
+                    RotatePlane(source, destination, rotation);
+                }
+            });
+            std::cout << "\t" << rotate_ms;
+        }
+        std::cout << "\n";
+    }
+    SetSimdLevel(DetectSimdLevel());
+}
+
+void BenchRemap() {
+    Plane source = MakeRandomPlane(kBenchResizeSourceWidth, kBenchResizeSourceHeight);
+    RemapModel model{.kind = RemapKind::kLens, .coefficients = {-0.1, 0.02}};
+
+    std::cout << "Lens remap of three " << kBenchResizeSourceWidth << "x" << kBenchResizeSourceHeight
+              << " planes, milliseconds\n";
+    double map_ms = MeasureMilliseconds([&] { RemapMap(model, source.width, source.height); });
+    std::cout << "map\t" << map_ms << "\n";
+    RemapMap map(model, source.width, source.height);
+    std::vector<Plane> sources(kAmountOfPrimaryColors, source);
+    std::vector<Plane> destinations(kAmountOfPrimaryColors, Plane(source.width, source.height));
+    std::cout << "scalar\tvector\n";
+    for (auto level : {SimdLevel::kScalar, DetectSimdLevel()}) {
+        SetSimdLevel(level);
+        std::cout << MeasureMilliseconds([&] { RemapPlanes(sources, destinations, map); }) << "\t";
+    }
+    std::cout << "\n";
+    SetSimdLevel(DetectSimdLevel());
+}
+
+void BenchIntegral() {
+    Plane source = MakeRandomPlane(kBenchResizeSourceWidth, kBenchResizeSourceHeight);
+
+    std::cout << "Integral image of a " << kBenchResizeSourceWidth << "x" << kBenchResizeSourceHeight
+              << " plane, milliseconds\n";
+    std::cout << "32-bit\t" << MeasureMilliseconds([&] { IntegralImage<uint32_t> integral(source); }) << "\n";
+    std::cout << "64-bit\t" << MeasureMilliseconds([&] { IntegralImage<uint64_t> integral(source); }) << "\n";
+}
+
+int main() {
+    BenchFftThreshold();
+    BenchPrecision();
+    BenchGrayscale();
+    BenchResize();
+    BenchDownscale();
+    BenchPyramid();
+    BenchRotate();
+    BenchRemap();
+    BenchIntegral();
+}
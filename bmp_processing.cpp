@@ -1,5 +1,212 @@
 #include "bmp_processing.h"
 
+#include <algorithm>
+#include <cstdlib>
+
+#include "grayscale.h"
+#include "packed_rgb.h"
+#include "simd.h"
+
+namespace {
+
+#ifdef IMAGE_PROCESSOR_X86
+
+IMAGE_PROCESSOR_TARGET("sse4.1")
+size_t SplitRowSse41(const PixelColor* pixels, uint8_t* red, uint8_t* green, uint8_t* blue, size_t count) {
+    size_t x = 0;
+    for (; x + kPackedRgbPixelsPerStep <= count; x += kPackedRgbPixelsPerStep) {
+        __m128i channels[kAmountOfPrimaryColors];
+        DeinterleaveRgbSse41(pixels + x, channels);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(red + x), channels[0]);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(green + x), channels[1]);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(blue + x), channels[2]);
+    }
+    return x;
+}
+
+IMAGE_PROCESSOR_TARGET("sse4.1")
+size_t MergeRowSse41(const uint8_t* red, const uint8_t* green, const uint8_t* blue, PixelColor* pixels,
+                     size_t count) {
+    size_t x = 0;
+    for (; x + kPackedRgbPixelsPerStep <= count; x += kPackedRgbPixelsPerStep) {
+        const __m128i channels[kAmountOfPrimaryColors] = {
+                _mm_loadu_si128(reinterpret_cast<const __m128i*>(red + x)),
+                _mm_loadu_si128(reinterpret_cast<const __m128i*>(green + x)),
+                _mm_loadu_si128(reinterpret_cast<const __m128i*>(blue + x))};
+        InterleaveRgbSse41(channels, pixels + x);
+    }
+    return x;
+}
+
+#endif
+
+// Returns how many leading pixels were converted, the caller finishes the row in scalar.
+size_t SplitRowVector(const PixelColor* pixels, uint8_t* red, uint8_t* green, uint8_t* blue, size_t count) {
+#ifdef IMAGE_PROCESSOR_X86
+    if (GetSimdLevel() >= SimdLevel::kSse41) {
+        return SplitRowSse41(pixels, red, green, blue, count);
+    }
+#endif
+    return 0;
+}
+
+size_t MergeRowVector(const uint8_t* red, const uint8_t* green, const uint8_t* blue, PixelColor* pixels,
+                      size_t count) {
+#ifdef IMAGE_PROCESSOR_X86
+    if (GetSimdLevel() >= SimdLevel::kSse41) {
+        return MergeRowSse41(red, green, blue, pixels, count);
+    }
+#endif
+    return 0;
+}
+
+void SplitRow(const PixelColor* pixels, uint8_t* red, uint8_t* green, uint8_t* blue, size_t count) {
+    for (size_t x = SplitRowVector(pixels, red, green, blue, count); x < count; ++x) {
+        red[x] = pixels[x].r;
+        green[x] = pixels[x].g;
+        blue[x] = pixels[x].b;
+    }
+}
+
+void MergeRow(const uint8_t* red, const uint8_t* green, const uint8_t* blue, PixelColor* pixels, size_t count) {
+    for (size_t x = MergeRowVector(red, green, blue, pixels, count); x < count; ++x) {
+        pixels[x] = {red[x], green[x], blue[x]};
+    }
+}
+
+// Planes are merged a row at a time into a packed buffer so ConvertRowToGray keeps its
+// vector path without a packed copy of the whole image.
+Plane ConvertPlanesToGray(const ColorPlanes& planes) {
+    Plane gray(planes[0].width, planes[0].height);
+    std::vector<PixelColor> row(gray.width);
+    for (size_t y = 0; y < gray.height; ++y) {
+        MergeRow(planes[0].Row(y), planes[1].Row(y), planes[2].Row(y), row.data(), row.size());
+        ConvertRowToGray(row.data(), gray.Row(y), row.size());
+    }
+    return gray;
+}
+
+Plane ConvertPixelsToGray(const PixelMatrix& pixels) {
+    Plane gray(pixels.empty() ? 0 : pixels[0].size(), pixels.size());
+    for (size_t y = 0; y < gray.height; ++y) {
+        ConvertRowToGray(pixels[y].data(), gray.Row(y), gray.width);
+    }
+    return gray;
+}
+
+PixelMatrix ExpandIndices(const Plane& indices, const Palette& palette) {
+    PixelMatrix pixels(indices.height, std::vector<PixelColor>(indices.width));
+    for (size_t y = 0; y < indices.height; ++y) {
+        const uint8_t* row = indices.Row(y);
+        for (size_t x = 0; x < indices.width; ++x) {
+            pixels[y][x] = palette[row[x]];
+        }
+    }
+    return pixels;
+}
+
+Palette MakeGrayPalette() {
+    Palette palette(kPaletteSize);
+    for (size_t index = 0; index < kPaletteSize; ++index) {
+        auto level = static_cast<uint8_t>(index);
+        palette[index] = {level, level, level};
+    }
+    return palette;
+}
+
+size_t GetRowPadding(size_t row_bytes_count) {
+    return (kPadding - row_bytes_count % kPadding) % kPadding;
+}
+
+void ResizePlane(Plane& plane, size_t width, size_t height) {
+    if (plane.width == width && plane.height == height) {
+        return;
+    }
+    Plane resized(width, height);
+    size_t copied_width = std::min(width, plane.width);
+    for (size_t y = 0; y < std::min(height, plane.height); ++y) {
+        std::copy(plane.Row(y), plane.Row(y) + copied_width, resized.Row(y));
+    }
+    plane = std::move(resized);
+}
+
+}  // namespace
+
+Plane::Plane(size_t width, size_t height)
+    : width(width), height(height), data(width * height), stride(static_cast<std::ptrdiff_t>(width)) {
+}
+
+uint8_t* Plane::Row(size_t row_number) {
+    return data.data() + static_cast<std::ptrdiff_t>(offset) + static_cast<std::ptrdiff_t>(row_number) * stride;
+}
+
+const uint8_t* Plane::Row(size_t row_number) const {
+    return data.data() + static_cast<std::ptrdiff_t>(offset) + static_cast<std::ptrdiff_t>(row_number) * stride;
+}
+
+void Plane::FlipRows() {
+    if (height == 0) {
+        return;
+    }
+    offset = static_cast<size_t>(static_cast<std::ptrdiff_t>(offset) +
+                                 static_cast<std::ptrdiff_t>(height - 1) * stride);
+    stride = -stride;
+}
+
+void Plane::Crop(size_t x, size_t y, size_t new_width, size_t new_height) {
+    offset = static_cast<size_t>(static_cast<std::ptrdiff_t>(offset) + static_cast<std::ptrdiff_t>(y) * stride +
+                                 static_cast<std::ptrdiff_t>(x));
+    width = new_width;
+    height = new_height;
+}
+
+bool Plane::IsCompact() const {
+    return offset == 0 && stride == static_cast<std::ptrdiff_t>(width) && data.size() == width * height;
+}
+
+void Plane::Compact() {
+    if (IsCompact()) {
+        return;
+    }
+    Plane compact(width, height);
+    for (size_t y = 0; y < height; ++y) {
+        std::copy(Row(y), Row(y) + width, compact.Row(y));
+    }
+    *this = std::move(compact);
+}
+
+bool Plane::operator==(const Plane& other) const {
+    if (width != other.width || height != other.height) {
+        return false;
+    }
+    for (size_t y = 0; y < height; ++y) {
+        if (!std::equal(Row(y), Row(y) + width, other.Row(y))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+ColorPlanes SplitToPlanes(const PixelMatrix& pixels) {
+    size_t height = pixels.size();
+    size_t width = pixels.empty() ? 0 : pixels[0].size();
+    ColorPlanes planes = {Plane(width, height), Plane(width, height), Plane(width, height)};
+
+    for (size_t y = 0; y < height; ++y) {
+        SplitRow(pixels[y].data(), planes[0].Row(y), planes[1].Row(y), planes[2].Row(y), width);
+    }
+    return planes;
+}
+
+void MergePlanes(const ColorPlanes& planes, PixelMatrix& pixels) {
+    size_t width = planes[0].width;
+    pixels.resize(planes[0].height);
+    for (size_t y = 0; y < planes[0].height; ++y) {
+        pixels[y].resize(width);
+        MergeRow(planes[0].Row(y), planes[1].Row(y), planes[2].Row(y), pixels[y].data(), width);
+    }
+}
+
 void BMP::ReadMagic(std::ifstream& in, std::string_view input_file) {
     if (!in.read(reinterpret_cast<char*>(&magic_), kBmpMagicBytesCount)) {
         throw FileProcessingException("invalid input file " + std::string(input_file));
@@ -21,8 +228,8 @@ void BMP::ReadInfo(std::ifstream& in, std::string_view input_file) {
         throw FileProcessingException("can not read Bitmap info from " + std::string(input_file));
     }
 
-    if (info_.bits_per_pixel != kRequiredBitsPerPixel) {
-        throw FileProcessingException(std::string(input_file) + " is not 24 bits per pixel");
+    if (info_.bits_per_pixel != kRequiredBitsPerPixel && info_.bits_per_pixel != kPalettedBitsPerPixel) {
+        throw FileProcessingException(std::string(input_file) + " is not 24 or 8 bits per pixel");
     }
 
     if (info_.compression != kRequiredCompression) {
@@ -62,6 +269,11 @@ void BMP::ReadImage(std::ifstream& in, std::string_view input_file) {
         info_.height = -info_.height;
     }
 
+    if (info_.bits_per_pixel == kPalettedBitsPerPixel) {
+        ReadPalettedImage(in, input_file, put_pixels_at_top);
+        return;
+    }
+
     in.seekg(file_header_.offset);
 
     for (auto row_number = 0; row_number < info_.height; ++row_number) {
@@ -82,6 +294,60 @@ void BMP::ReadImage(std::ifstream& in, std::string_view input_file) {
     }
 }
 
+// A palette of grays only gives a gray image, any other palette an interleaved one.
+void BMP::ReadPalettedImage(std::ifstream& in, std::string_view input_file, bool put_pixels_at_top) {
+    size_t colors_count = info_.num_colors == 0 ? kPaletteSize : info_.num_colors;
+    if (colors_count > kPaletteSize) {
+        throw FileProcessingException(std::string(input_file) + " have invalid palette");
+    }
+
+    std::vector<Byte> entries(colors_count * kPaletteEntryBytesCount);
+    in.seekg(kBmpMagicBytesCount + kBmpFileHeaderBytesCount + info_.header_size);
+    if (!in.read(reinterpret_cast<char*>(entries.data()), static_cast<std::streamsize>(entries.size()))) {
+        throw FileProcessingException(std::string(input_file) + " have invalid palette");
+    }
+    std::vector<PixelColor> palette(colors_count);
+    bool gray = true;
+    for (size_t index = 0; index < colors_count; ++index) {
+        const Byte* entry = entries.data() + index * kPaletteEntryBytesCount;
+        palette[index] = {entry[2], entry[1], entry[0]};
+        gray = gray && entry[0] == entry[1] && entry[1] == entry[2];
+    }
+
+    auto width = static_cast<size_t>(info_.width);
+    auto height = static_cast<size_t>(info_.height);
+    std::vector<Byte> indices(width + GetRowPadding(width));
+    Plane plane;
+    if (gray) {
+        plane = Plane(width, height);
+    } else {
+        pixels_.assign(height, std::vector<PixelColor>(width));
+    }
+
+    in.seekg(file_header_.offset);
+    for (size_t row_number = 0; row_number < height; ++row_number) {
+        if (!in.read(reinterpret_cast<char*>(indices.data()), static_cast<std::streamsize>(indices.size()))) {
+            throw FileProcessingException(std::string(input_file) + " have invalid pixels");
+        }
+        size_t y = put_pixels_at_top ? height - 1 - row_number : row_number;
+        for (size_t x = 0; x < width; ++x) {
+            if (indices[x] >= colors_count) {
+                throw FileProcessingException(std::string(input_file) + " have invalid pixels");
+            }
+            if (gray) {
+                plane.Row(y)[x] = palette[indices[x]].r;
+            } else {
+                pixels_[y][x] = palette[indices[x]];
+            }
+        }
+    }
+
+    if (gray) {
+        planes_[0] = std::move(plane);
+        layout_ = PixelLayout::kGray;
+    }
+}
+
 void BMP::Open(std::string_view input_file) {
     std::ifstream in(input_file.data(), std::ios::in | std::ios::binary);
 
@@ -89,20 +355,67 @@ void BMP::Open(std::string_view input_file) {
         throw FileProcessingException("can not open for reading " + std::string(input_file));
     }
 
+    pixels_.clear();
+    planes_ = {};
+    palette_ = {};
+    layout_ = PixelLayout::kInterleaved;
     ReadHeaders(in, input_file);
     ReadImage(in, input_file);
 
     in.close();
 }
 
+bool BMP::OpenStreaming(std::string_view input_file, const RowConsumer& consume) {
+    std::ifstream in(input_file.data(), std::ios::in | std::ios::binary);
+
+    if (!in) {
+        throw FileProcessingException("can not open for reading " + std::string(input_file));
+    }
+
+    pixels_.clear();
+    planes_ = {};
+    palette_ = {};
+    layout_ = PixelLayout::kInterleaved;
+    ReadHeaders(in, input_file);
+    if (info_.bits_per_pixel == kPalettedBitsPerPixel) {
+        ReadImage(in, input_file);
+        return false;
+    }
+
+    bool put_pixels_at_top = info_.height > 0;
+    info_.height = std::abs(info_.height);
+    size_t width = GetWidth();
+    size_t row_bytes_count = width * kAmountOfPrimaryColors;
+    std::vector<Byte> line(row_bytes_count + GetRowPadding(row_bytes_count));
+    std::vector<uint8_t> channels(width * kAmountOfPrimaryColors);
+    uint8_t* red = channels.data();
+    uint8_t* green = red + width;
+    uint8_t* blue = green + width;
+    in.seekg(file_header_.offset);
+    for (size_t row_number = 0; row_number < GetHeight(); ++row_number) {
+        if (!in.read(reinterpret_cast<char*>(line.data()), static_cast<std::streamsize>(line.size()))) {
+            throw FileProcessingException(std::string(input_file) + " have invalid pixels");
+        }
+        // Stored pixels are b, g, r, so the red field of a PixelColor holds blue.
+        SplitRow(reinterpret_cast<const PixelColor*>(line.data()), blue, green, red, width);
+        consume(put_pixels_at_top ? GetHeight() - 1 - row_number : row_number, red, green, blue);
+    }
+    return true;
+}
+
 void BMP::WriteMagic(std::ofstream& out) {
     out.write(reinterpret_cast<char*>(&magic_), kBmpMagicBytesCount);
 }
 
 void BMP::WriteFileHeader(std::ofstream& out) {
     file_header_.offset = kBmpMagicBytesCount + kBmpFileHeaderBytesCount + kBmpInfoHeaderBytesCount;
-    file_header_.file_size = file_header_.offset + (GetHeight() * kAmountOfPrimaryColors +
-                                                    GetWidth() % kPadding) * GetHeight();
+    if (info_.bits_per_pixel == kPalettedBitsPerPixel) {
+        file_header_.offset += info_.num_colors * kPaletteEntryBytesCount;
+        file_header_.file_size = file_header_.offset + info_.size_image;
+    } else {
+        file_header_.file_size = file_header_.offset + (GetHeight() * kAmountOfPrimaryColors +
+                                                        GetWidth() % kPadding) * GetHeight();
+    }
 
     out.write(reinterpret_cast<char*>(&file_header_), kBmpFileHeaderBytesCount);
 }
@@ -124,6 +437,21 @@ void BMP::WritePixel(std::ofstream& out, PixelColor pixel) {
 }
 
 void BMP::WriteImage(std::ofstream& out) {
+    if (layout_ == PixelLayout::kGray) {
+        const Plane& gray = planes_[0];
+        size_t row_bytes_count = gray.width * kAmountOfPrimaryColors;
+        std::vector<char> line(row_bytes_count + GetRowPadding(row_bytes_count));
+        for (auto row_number = gray.height; row_number > 0; --row_number) {
+            const uint8_t* row = gray.Row(row_number - 1);
+            for (size_t x = 0; x < gray.width; ++x) {
+                std::fill_n(line.begin() + static_cast<std::ptrdiff_t>(x * kAmountOfPrimaryColors),
+                            kAmountOfPrimaryColors, static_cast<char>(row[x]));
+            }
+            out.write(line.data(), static_cast<std::streamsize>(line.size()));
+        }
+        return;
+    }
+
     for (auto row_number = GetHeight(); row_number > 0; --row_number) {
         const std::vector<PixelColor>& row = pixels_[row_number - 1];
 
@@ -137,23 +465,180 @@ void BMP::WriteImage(std::ofstream& out) {
     }
 }
 
-void BMP::Save(std::string_view output_file) {
+void BMP::WritePalettedImage(std::ofstream& out, const Palette& palette) {
+    std::vector<Byte> entries(palette.size() * kPaletteEntryBytesCount);
+    for (size_t index = 0; index < palette.size(); ++index) {
+        Byte* entry = entries.data() + index * kPaletteEntryBytesCount;
+        entry[0] = palette[index].b;
+        entry[1] = palette[index].g;
+        entry[2] = palette[index].r;
+    }
+    out.write(reinterpret_cast<char*>(entries.data()), static_cast<std::streamsize>(entries.size()));
+
+    const Plane& indices = planes_[0];
+    std::vector<char> padding(GetRowPadding(indices.width));
+    for (auto row_number = indices.height; row_number > 0; --row_number) {
+        out.write(reinterpret_cast<const char*>(indices.Row(row_number - 1)),
+                  static_cast<std::streamsize>(indices.width));
+        out.write(padding.data(), static_cast<std::streamsize>(padding.size()));
+    }
+}
+
+void BMP::Save(std::string_view output_file, Word gray_bits_per_pixel) {
     std::ofstream out(output_file.data(), std::ios::out | std::ios::binary);
 
     if (!out) {
         throw FileProcessingException("can not open for editing " + std::string(output_file));
     }
 
+    Palette palette;
+    if (layout_ == PixelLayout::kIndexed) {
+        palette = palette_;
+    } else if (layout_ == PixelLayout::kGray && gray_bits_per_pixel == kPalettedBitsPerPixel) {
+        palette = MakeGrayPalette();
+    } else if (layout_ != PixelLayout::kGray) {
+        SetLayout(PixelLayout::kInterleaved);
+    }
+    bool paletted = !palette.empty();
+    info_.bits_per_pixel = paletted ? kPalettedBitsPerPixel : kRequiredBitsPerPixel;
+    info_.num_colors = static_cast<Dword>(palette.size());
+    if (paletted) {
+        info_.header_size = kBmpInfoHeaderBytesCount;
+        info_.size_image = static_cast<Dword>((GetWidth() + GetRowPadding(GetWidth())) * GetHeight());
+    }
+
     WriteHeaders(out);
-    WriteImage(out);
+    if (paletted) {
+        WritePalettedImage(out, palette);
+    } else {
+        WriteImage(out);
+    }
 
     out.close();
 }
 
 PixelMatrix& BMP::PixelMatrix() {
+    SetLayout(PixelLayout::kInterleaved);
     return pixels_;
 }
 
+std::span<Plane> BMP::ActivePlanes() {
+    if (layout_ == PixelLayout::kInterleaved) {
+        return {};
+    }
+    if (layout_ == PixelLayout::kGray || layout_ == PixelLayout::kIndexed) {
+        return std::span<Plane>(planes_).first(1);
+    }
+    return planes_;
+}
+
+std::span<Plane> BMP::Planes() {
+    if (layout_ == PixelLayout::kInterleaved || layout_ == PixelLayout::kIndexed) {
+        SetLayout(PixelLayout::kPlanar);
+    }
+    return ActivePlanes();
+}
+
+void BMP::SetIndexed(Plane indices, Palette palette) {
+    pixels_ = {};
+    planes_ = {};
+    planes_[0] = std::move(indices);
+    palette_ = std::move(palette);
+    layout_ = PixelLayout::kIndexed;
+}
+
+void BMP::SetPlanes(ColorPlanes planes) {
+    pixels_ = {};
+    planes_ = std::move(planes);
+    palette_ = {};
+    layout_ = PixelLayout::kPlanar;
+    info_.width = static_cast<Llong>(planes_[0].width);
+    info_.height = static_cast<Llong>(planes_[0].height);
+}
+
+void BMP::SetGray(Plane gray) {
+    pixels_ = {};
+    planes_ = {};
+    planes_[0] = std::move(gray);
+    palette_ = {};
+    layout_ = PixelLayout::kGray;
+    info_.width = static_cast<Llong>(planes_[0].width);
+    info_.height = static_cast<Llong>(planes_[0].height);
+}
+
+Palette& BMP::GetPalette() {
+    return palette_;
+}
+
+void BMP::ReadGrayRow(size_t y, uint8_t* gray, std::span<PixelColor> merged) const {
+    size_t width = GetWidth();
+    switch (layout_) {
+        case PixelLayout::kInterleaved:
+            ConvertRowToGray(pixels_[y].data(), gray, width);
+            return;
+        case PixelLayout::kGray:
+            std::copy(planes_[0].Row(y), planes_[0].Row(y) + width, gray);
+            return;
+        case PixelLayout::kIndexed: {
+            const uint8_t* indices = planes_[0].Row(y);
+            for (size_t x = 0; x < width; ++x) {
+                merged[x] = palette_[indices[x]];
+            }
+            break;
+        }
+        default:
+            MergeRow(planes_[0].Row(y), planes_[1].Row(y), planes_[2].Row(y), merged.data(), width);
+    }
+    ConvertRowToGray(merged.data(), gray, width);
+}
+
+PixelLayout BMP::GetLayout() const {
+    return layout_;
+}
+
+void BMP::SetLayout(PixelLayout layout) {
+    if (layout == layout_ || layout == PixelLayout::kIndexed) {
+        return;
+    }
+    if (layout_ == PixelLayout::kIndexed) {
+        pixels_ = ExpandIndices(planes_[0], palette_);
+        planes_ = {};
+        palette_ = {};
+        layout_ = PixelLayout::kInterleaved;
+        SetLayout(layout);
+        return;
+    }
+    if (layout_ == PixelLayout::kGray) {
+        Plane gray = std::move(planes_[0]);
+        if (layout == PixelLayout::kPlanar) {
+            // Each copy would otherwise carry the whole buffer a cropped plane looks into.
+            gray.Compact();
+            planes_ = {gray, gray, std::move(gray)};
+        } else {
+            pixels_.assign(gray.height, std::vector<PixelColor>(gray.width));
+            for (size_t y = 0; y < gray.height; ++y) {
+                const uint8_t* row = gray.Row(y);
+                for (size_t x = 0; x < gray.width; ++x) {
+                    pixels_[y][x] = {row[x], row[x], row[x]};
+                }
+            }
+            planes_ = {};
+        }
+    } else if (layout == PixelLayout::kGray) {
+        Plane gray = layout_ == PixelLayout::kPlanar ? ConvertPlanesToGray(planes_) : ConvertPixelsToGray(pixels_);
+        pixels_ = {};
+        planes_ = {};
+        planes_[0] = std::move(gray);
+    } else if (layout == PixelLayout::kPlanar) {
+        planes_ = SplitToPlanes(pixels_);
+        pixels_ = {};
+    } else {
+        MergePlanes(planes_, pixels_);
+        planes_ = {};
+    }
+    layout_ = layout;
+}
+
 size_t BMP::GetHeight() const {
     return info_.height;
 }
@@ -163,13 +648,56 @@ size_t BMP::GetWidth() const {
 }
 
 void BMP::ResizeHeight(size_t height) {
-    pixels_.resize(height);
+    if (layout_ != PixelLayout::kInterleaved) {
+        for (auto& plane : ActivePlanes()) {
+            ResizePlane(plane, plane.width, height);
+        }
+    } else {
+        pixels_.resize(height);
+    }
     info_.height = static_cast<Llong>(height);
 }
 
+void BMP::FlipRows() {
+    if (layout_ == PixelLayout::kInterleaved) {
+        std::reverse(pixels_.begin(), pixels_.end());
+        return;
+    }
+    for (auto& plane : ActivePlanes()) {
+        plane.FlipRows();
+    }
+}
+
+void BMP::Crop(size_t x, size_t y, size_t width, size_t height) {
+    if (layout_ != PixelLayout::kInterleaved) {
+        for (auto& plane : ActivePlanes()) {
+            plane.Crop(x, y, width, height);
+        }
+    } else {
+        pixels_.erase(pixels_.begin(), pixels_.begin() + static_cast<std::ptrdiff_t>(y));
+        pixels_.resize(height);
+        for (auto& row : pixels_) {
+            row.erase(row.begin(), row.begin() + static_cast<std::ptrdiff_t>(x));
+            row.resize(width);
+        }
+    }
+    info_.width = static_cast<Llong>(width);
+    info_.height = static_cast<Llong>(height);
+}
+
+void BMP::SwapResolutions() {
+    std::swap(info_.h_res, info_.v_res);
+}
+
 void BMP::ResizeWidth(size_t width) {
-    for (auto& row : pixels_) {
-        row.resize(width);
+    if (layout_ != PixelLayout::kInterleaved) {
+        for (auto& plane : ActivePlanes()) {
+            ResizePlane(plane, width, plane.height);
+        }
+    } else {
+        for (auto& row : pixels_) {
+            row.resize(width);
+        }
     }
     info_.width = static_cast<Llong>(width);
 }
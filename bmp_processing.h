@@ -1,7 +1,10 @@
 #pragma once
 
+#include <array>
 #include <cstdint>
 #include <fstream>
+#include <functional>
+#include <span>
 #include <string>
 #include <vector>
 
@@ -20,6 +23,11 @@ constexpr size_t kBmpFileHeaderBytesCount = 12;
 constexpr size_t kBmpInfoHeaderBytesCount = 40;
 
 constexpr Word kRequiredBitsPerPixel = 24;
+// Gray and indexed images may also be read and written with 8-bit indices into a palette of up to
+// 256 colours.
+constexpr Word kPalettedBitsPerPixel = 8;
+constexpr size_t kPaletteSize = 256;
+constexpr size_t kPaletteEntryBytesCount = 4;
 constexpr Dword kRequiredCompression = 0;
 constexpr Llong kPadding = 4;
 constexpr size_t kAmountOfPrimaryColors = 3;
@@ -55,13 +63,80 @@ struct PixelColor {
 };
 
 typedef std::vector<std::vector<PixelColor>> PixelMatrix;
+typedef std::vector<PixelColor> Palette;
+
+enum class PixelLayout : unsigned char {
+    kInterleaved,
+    kPlanar,
+    // One plane of luma. Entering it converts a colour image with CalculateGray, which
+    // leaves images with equal channels unchanged; leaving it copies the plane to all channels.
+    kGray,
+    // One plane of indices into a palette of at most 256 colours. Only SetIndexed enters it;
+    // leaving it looks every index up in the palette.
+    kIndexed,
+};
+
+struct Plane {
+    size_t width = 0;
+    size_t height = 0;
+    std::vector<uint8_t> data;
+    // Row y starts at data[offset + y * stride]. New planes are compact, with stride equal to
+    // width; FlipRows only changes these two, so rows must be reached through Row.
+    size_t offset = 0;
+    std::ptrdiff_t stride = 0;
+
+    Plane() = default;
+    Plane(size_t width, size_t height);
+
+    uint8_t* Row(size_t row_number);
+    const uint8_t* Row(size_t row_number) const;
+    // Turns the plane upside down without moving a pixel.
+    void FlipRows();
+    // Narrows the plane to new_width x new_height pixels from (x, y), which must lie inside it,
+    // by moving offset only; the rest of data stays where it is.
+    void Crop(size_t x, size_t y, size_t new_width, size_t new_height);
+    // Whether data holds exactly the pixels of the plane, row after row.
+    bool IsCompact() const;
+    // Copies the pixels into a buffer of their own unless the plane is compact already.
+    void Compact();
+
+    // Compares pixels, wherever the rows of either plane lie.
+    bool operator==(const Plane& other) const;
+};
+
+typedef std::array<Plane, kAmountOfPrimaryColors> ColorPlanes;
+
+// Receives row y of an image split into its red, green and blue channels.
+typedef std::function<void(size_t y, const uint8_t* red, const uint8_t* green, const uint8_t* blue)> RowConsumer;
+
+ColorPlanes SplitToPlanes(const PixelMatrix& pixels);
+void MergePlanes(const ColorPlanes& planes, PixelMatrix& pixels);
 
 class BMP {
 private:
-    Byte magic_[kBmpMagicBytesCount];
-    BitmapFileHeader file_header_;
-    BitmapInfo info_;
+    // Defaults describe an empty 24-bit image, so images built in memory can be saved too.
+    Byte magic_[kBmpMagicBytesCount] = {kBmpSignatureFirstByte, kBmpSignatureSecondByte};
+    BitmapFileHeader file_header_{};
+    BitmapInfo info_{.header_size = static_cast<Dword>(kBmpInfoHeaderBytesCount),
+                     .width = 0,
+                     .height = 0,
+                     .planes = 1,
+                     .bits_per_pixel = kRequiredBitsPerPixel,
+                     .compression = kRequiredCompression,
+                     .size_image = 0,
+                     .h_res = 0,
+                     .v_res = 0,
+                     .num_colors = 0,
+                     .num_important_colors = 0};
     PixelMatrix pixels_;
+    // Only the representation of the current layout holds the image, the other one is empty.
+    // A gray image keeps its plane in planes_[0], an indexed one its indices.
+    ColorPlanes planes_;
+    Palette palette_;
+    PixelLayout layout_ = PixelLayout::kInterleaved;
+
+    void ReadPalettedImage(std::ifstream& in, std::string_view input_file, bool put_pixels_at_top);
+    void WritePalettedImage(std::ofstream& out, const Palette& palette);
 
 public:
     void ReadMagic(std::ifstream& in, std::string_view input_file);
@@ -79,12 +154,50 @@ public:
     void WriteHeaders(std::ofstream& out);
 
     void Open(std::string_view input_file);
-    void Save(std::string_view output_file);
-
+    // An indexed image is written as 8-bit palettised BMP, and so is a gray image if
+    // gray_bits_per_pixel asks for it; otherwise a gray image is written as 24-bit, expanding
+    // one row at a time.
+    void Save(std::string_view output_file, Word gray_bits_per_pixel = kRequiredBitsPerPixel);
+    // Opens input_file, but hands each row of a 24-bit image to consume, in the order the rows
+    // are stored, instead of keeping it; the size is known by then. Returns false, with the
+    // image opened as by Open, for a paletted image.
+    bool OpenStreaming(std::string_view input_file, const RowConsumer& consume);
+
+    // Converts the image to interleaved layout first if it is not already in it.
     PixelMatrix& PixelMatrix();
+    // The single plane of a gray image, or the three colour planes, converting interleaved
+    // and indexed images to planar layout first.
+    std::span<Plane> Planes();
+    // The planes the current layout keeps, without converting: the single plane of a gray image,
+    // the indices of an indexed one or the three colour planes; none for an interleaved image.
+    std::span<Plane> ActivePlanes();
+    // Replaces the image with indices into palette, leaving it in PixelLayout::kIndexed.
+    void SetIndexed(Plane indices, Palette palette);
+    // Replaces the image with planes of equal size, leaving it in PixelLayout::kPlanar.
+    void SetPlanes(ColorPlanes planes);
+    // Replaces the image with a single gray plane, leaving it in PixelLayout::kGray.
+    void SetGray(Plane gray);
+    // Colours of an indexed image; changing them recolours every pixel that uses them.
+    Palette& GetPalette();
+
+    // Luma of row y as SetLayout(PixelLayout::kGray) would compute it, without converting the
+    // image. merged holds a row of pixels for planar and indexed images.
+    void ReadGrayRow(size_t y, uint8_t* gray, std::span<PixelColor> merged) const;
+
+    PixelLayout GetLayout() const;
+    // layout must not be PixelLayout::kIndexed, see SetIndexed.
+    void SetLayout(PixelLayout layout);
 
     size_t GetHeight() const;
     size_t GetWidth() const;
     void ResizeHeight(size_t height);
     void ResizeWidth(size_t width);
+    // For filters that swap the axes of the image.
+    void SwapResolutions();
+    // Turns the image upside down: an interleaved image swaps its rows, planes only negate
+    // their strides.
+    void FlipRows();
+    // Keeps width x height pixels from (x, y), which must fit in the image. Planes become views
+    // into their old buffers, an interleaved image trims its rows in place.
+    void Crop(size_t x, size_t y, size_t width, size_t height);
 };
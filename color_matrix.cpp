@@ -0,0 +1,135 @@
+#include "color_matrix.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "packed_rgb.h"
+#include "parallel.h"
+
+namespace {
+
+// Weights act on 8-bit levels directly, so the offset column is scaled up to them.
+struct ColorMatrixCoefficients {
+    std::array<std::array<float, kAmountOfPrimaryColors>, kAmountOfPrimaryColors> weights;
+    std::array<float, kAmountOfPrimaryColors> offsets;
+};
+
+ColorMatrixCoefficients MakeCoefficients(const ColorMatrix& matrix) {
+    ColorMatrixCoefficients coefficients{};
+    for (size_t channel = 0; channel < kAmountOfPrimaryColors; ++channel) {
+        for (size_t source = 0; source < kAmountOfPrimaryColors; ++source) {
+            coefficients.weights[channel][source] = static_cast<float>(matrix[channel][source]);
+        }
+        coefficients.offsets[channel] = static_cast<float>(matrix[channel][kAmountOfPrimaryColors] * kMaxRgb);
+    }
+    return coefficients;
+}
+
+void ApplyColorMatrixScalar(const ColorMatrixCoefficients& coefficients, PixelColor* row, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        std::array<float, kAmountOfPrimaryColors> source = {static_cast<float>(row[i].r), static_cast<float>(row[i].g),
+                                                            static_cast<float>(row[i].b)};
+        std::array<uint8_t, kAmountOfPrimaryColors> result{};
+        for (size_t channel = 0; channel < kAmountOfPrimaryColors; ++channel) {
+            const auto& weights = coefficients.weights[channel];
+            float value = weights[0] * source[0] + weights[1] * source[1];
+            value += weights[2] * source[2];
+            value += coefficients.offsets[channel];
+            result[channel] = static_cast<uint8_t>(std::clamp(static_cast<int>(std::lround(value)), kMinRgb,
+                                                              kMaxRgb));
+        }
+        row[i] = {result[0], result[1], result[2]};
+    }
+}
+
+#ifdef IMAGE_PROCESSOR_X86
+
+// Rounds halves away from zero like std::lround. Values are clamped to [-1, 256] first:
+// that does not change the clamped result and keeps the conversion in range.
+IMAGE_PROCESSOR_TARGET("sse4.1")
+__m128i RoundLevelsSse41(__m128 value) {
+    value = _mm_min_ps(_mm_max_ps(value, _mm_set1_ps(kMinRgb - 1)), _mm_set1_ps(kMaxRgb + 1));
+    __m128i truncated = _mm_cvttps_epi32(value);
+    __m128 fraction = _mm_sub_ps(value, _mm_cvtepi32_ps(truncated));
+    return _mm_sub_epi32(truncated, _mm_castps_si128(_mm_cmpge_ps(fraction, _mm_set1_ps(0.5f))));
+}
+
+IMAGE_PROCESSOR_TARGET("sse4.1")
+void ApplyColorMatrixSse41(const ColorMatrixCoefficients& coefficients, PixelColor* row, size_t count) {
+    constexpr size_t kQuarters = kPackedRgbPixelsPerStep / 4;
+    size_t i = 0;
+    for (; i + kPackedRgbPixelsPerStep <= count; i += kPackedRgbPixelsPerStep) {
+        __m128i channels[kAmountOfPrimaryColors];
+        DeinterleaveRgbSse41(row + i, channels);
+
+        __m128 sources[kAmountOfPrimaryColors][kQuarters];
+        for (size_t source = 0; source < kAmountOfPrimaryColors; ++source) {
+            __m128i shifted = channels[source];
+            for (size_t quarter = 0; quarter < kQuarters; ++quarter) {
+                sources[source][quarter] = _mm_cvtepi32_ps(_mm_cvtepu8_epi32(shifted));
+                shifted = _mm_srli_si128(shifted, 4);
+            }
+        }
+
+        __m128i results[kAmountOfPrimaryColors];
+        for (size_t channel = 0; channel < kAmountOfPrimaryColors; ++channel) {
+            const auto& weights = coefficients.weights[channel];
+            __m128i levels[kQuarters];
+            for (size_t quarter = 0; quarter < kQuarters; ++quarter) {
+                __m128 value = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(weights[0]), sources[0][quarter]),
+                                          _mm_mul_ps(_mm_set1_ps(weights[1]), sources[1][quarter]));
+                value = _mm_add_ps(value, _mm_mul_ps(_mm_set1_ps(weights[2]), sources[2][quarter]));
+                value = _mm_add_ps(value, _mm_set1_ps(coefficients.offsets[channel]));
+                levels[quarter] = RoundLevelsSse41(value);
+            }
+            results[channel] = _mm_packus_epi16(_mm_packus_epi32(levels[0], levels[1]),
+                                                _mm_packus_epi32(levels[2], levels[3]));
+        }
+        InterleaveRgbSse41(results, row + i);
+    }
+    ApplyColorMatrixScalar(coefficients, row + i, count - i);
+}
+
+#endif
+
+}  // namespace
+
+ColorMatrix MakeSaturationColorMatrix(double saturation) {
+    ColorMatrix matrix{};
+    for (size_t channel = 0; channel < kAmountOfPrimaryColors; ++channel) {
+        for (size_t source = 0; source < kColorMatrixColumns; ++source) {
+            matrix[channel][source] = (1 - saturation) * kLumaColorMatrix[channel][source] +
+                                      saturation * kIdentityColorMatrix[channel][source];
+        }
+    }
+    return matrix;
+}
+
+ColorMatrix ComposeColorMatrices(const ColorMatrix& first, const ColorMatrix& second) {
+    ColorMatrix composed{};
+    for (size_t channel = 0; channel < kAmountOfPrimaryColors; ++channel) {
+        for (size_t source = 0; source < kColorMatrixColumns; ++source) {
+            for (size_t middle = 0; middle < kAmountOfPrimaryColors; ++middle) {
+                composed[channel][source] += second[channel][middle] * first[middle][source];
+            }
+        }
+        composed[channel][kAmountOfPrimaryColors] += second[channel][kAmountOfPrimaryColors];
+    }
+    return composed;
+}
+
+void ApplyColorMatrix(const ColorMatrix& matrix, PixelMatrix& pixels) {
+    ColorMatrixCoefficients coefficients = MakeCoefficients(matrix);
+    auto apply_row = ApplyColorMatrixScalar;
+#ifdef IMAGE_PROCESSOR_X86
+    if (GetSimdLevel() >= SimdLevel::kSse41) {
+        apply_row = ApplyColorMatrixSse41;
+    }
+#endif
+
+    ParallelFor(pixels.size(), [&coefficients, &pixels, apply_row](size_t, size_t begin, size_t end) {
+        for (size_t y = begin; y < end; ++y) {
+            apply_row(coefficients, pixels[y].data(), pixels[y].size());
+        }
+    });
+}
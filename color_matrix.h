@@ -0,0 +1,28 @@
+#pragma once
+
+#include <array>
+
+#include "bmp_processing.h"
+#include "grayscale.h"
+
+constexpr size_t kColorMatrixColumns = kAmountOfPrimaryColors + 1;
+
+// Row c gives output channel c as a weighted sum of r, g and b plus the last column.
+// Colours and the offset are on the [0, 1] scale.
+typedef std::array<std::array<double, kColorMatrixColumns>, kAmountOfPrimaryColors> ColorMatrix;
+
+constexpr ColorMatrix kIdentityColorMatrix = {{{1, 0, 0, 0}, {0, 1, 0, 0}, {0, 0, 1, 0}}};
+constexpr ColorMatrix kLumaColorMatrix = {{{kRedToGray, kGreenToGray, kBlueToGray, 0},
+                                           {kRedToGray, kGreenToGray, kBlueToGray, 0},
+                                           {kRedToGray, kGreenToGray, kBlueToGray, 0}}};
+constexpr ColorMatrix kSepiaColorMatrix = {{{0.393, 0.769, 0.189, 0},
+                                            {0.349, 0.686, 0.168, 0},
+                                            {0.272, 0.534, 0.131, 0}}};
+constexpr ColorMatrix kChannelSwapColorMatrix = {{{0, 0, 1, 0}, {0, 1, 0, 0}, {1, 0, 0, 0}}};
+
+// Mixes every channel with the luma: 0 gives gray, 1 the identity, above 1 boosts colour.
+ColorMatrix MakeSaturationColorMatrix(double saturation);
+// The matrix of applying first and then second, without rounding or clamping in between.
+ColorMatrix ComposeColorMatrices(const ColorMatrix& first, const ColorMatrix& second);
+// Coefficients are used as floats; every SIMD level gives the same bytes.
+void ApplyColorMatrix(const ColorMatrix& matrix, PixelMatrix& pixels);
@@ -1,5 +1,16 @@
 #include "console_read.h"
 
+#include <cctype>
+
+namespace {
+
+// Negative numbers are parameters, not the start of the next filter.
+bool IsParam(const char* arg) {
+    return arg[0] != '-' || std::isdigit(static_cast<unsigned char>(arg[1])) || arg[1] == '.';
+}
+
+}  // namespace
+
 Arguments Parser::operator()(int argc, char **argv) {
     if (argc < kMinimalAmountOfArgs) {
         throw ParserException("not enough params");
@@ -13,10 +24,22 @@ Arguments Parser::operator()(int argc, char **argv) {
             throw ParserException("wrong filters input (missing -)");
         }
 
+        if (argv[arg][1] == '-') {
+            Option option;
+            option.option_name = argv[arg];
+            ++arg;
+            while (arg < argc && IsParam(argv[arg])) {
+                option.option_params.emplace_back(argv[arg]);
+                ++arg;
+            }
+            arguments.options.push_back(option);
+            continue;
+        }
+
         Filter filter;
         filter.filter_name = argv[arg];
         ++arg;
-        while (arg < argc && argv[arg][0] != '-') {
+        while (arg < argc && IsParam(argv[arg])) {
             filter.filter_params.emplace_back(argv[arg]);
             ++arg;
         }
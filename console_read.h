@@ -12,11 +12,17 @@ struct Filter {
     std::vector<std::string> filter_params;
 };
 
+struct Option {
+    std::string option_name;
+    std::vector<std::string> option_params;
+};
+
 struct Arguments {
     std::string_view input_path;
     std::string_view output_path;
 
     std::vector<Filter> filters;
+    std::vector<Option> options;
 };
 
 struct Parser {
@@ -0,0 +1,704 @@
+#include "convolution.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+
+#include "fft.h"
+#include "parallel.h"
+#include "simd.h"
+#include "srgb.h"
+
+namespace {
+
+// Scalar kernels repeat the reference per-pixel arithmetic in the accumulator type,
+// vector kernels repeat the scalar ones lane by lane, so every level gives identical
+// pixels for a given precision.
+
+template <typename Accumulator>
+void WidenRowScalar(const uint8_t* source, Accumulator* destination, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        destination[i] = static_cast<Accumulator>(source[i]) / kMaxRgb;
+    }
+}
+
+template <typename Accumulator>
+void AccumulateRowScalar(const Accumulator* source, Accumulator coefficient, Accumulator* accumulator,
+                         size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        accumulator[i] += source[i] * coefficient;
+    }
+}
+
+template <typename Accumulator>
+void NarrowRowScalar(const Accumulator* source, uint8_t* destination, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        destination[i] = std::clamp(static_cast<int>(std::lround(source[i] * kMaxRgb)), kMinRgb, kMaxRgb);
+    }
+}
+
+#ifdef IMAGE_PROCESSOR_X86
+
+// std::lround rounds halves away from zero, vector rounding modes do not, so the
+// fraction left after truncation decides the direction by hand.
+
+IMAGE_PROCESSOR_TARGET("sse4.1")
+__m128i RoundToInt32Sse41(__m128d value) {
+    const __m128d half = _mm_set1_pd(0.5);
+    const __m128d one = _mm_set1_pd(1.0);
+    __m128d truncated = _mm_round_pd(value, _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC);
+    __m128d fraction = _mm_sub_pd(value, truncated);
+    truncated = _mm_add_pd(truncated, _mm_and_pd(_mm_cmpge_pd(fraction, half), one));
+    truncated = _mm_sub_pd(truncated, _mm_and_pd(_mm_cmple_pd(fraction, _mm_set1_pd(-0.5)), one));
+    truncated = _mm_min_pd(_mm_max_pd(truncated, _mm_set1_pd(kMinRgb)), _mm_set1_pd(kMaxRgb));
+    return _mm_cvttpd_epi32(truncated);
+}
+
+IMAGE_PROCESSOR_TARGET("sse4.1")
+void WidenRowSse41(const uint8_t* source, double* destination, size_t count) {
+    const __m128d max_rgb = _mm_set1_pd(kMaxRgb);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m128i bytes = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(source + i));
+        __m128i low = _mm_cvtepu8_epi32(bytes);
+        __m128i high = _mm_cvtepu8_epi32(_mm_srli_si128(bytes, 4));
+        _mm_storeu_pd(destination + i, _mm_div_pd(_mm_cvtepi32_pd(low), max_rgb));
+        _mm_storeu_pd(destination + i + 2, _mm_div_pd(_mm_cvtepi32_pd(_mm_srli_si128(low, 8)), max_rgb));
+        _mm_storeu_pd(destination + i + 4, _mm_div_pd(_mm_cvtepi32_pd(high), max_rgb));
+        _mm_storeu_pd(destination + i + 6, _mm_div_pd(_mm_cvtepi32_pd(_mm_srli_si128(high, 8)), max_rgb));
+    }
+    WidenRowScalar(source + i, destination + i, count - i);
+}
+
+IMAGE_PROCESSOR_TARGET("sse4.1")
+void AccumulateRowSse41(const double* source, double coefficient, double* accumulator, size_t count) {
+    const __m128d factor = _mm_set1_pd(coefficient);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        for (size_t lane = 0; lane < 8; lane += 2) {
+            __m128d sum = _mm_loadu_pd(accumulator + i + lane);
+            sum = _mm_add_pd(sum, _mm_mul_pd(_mm_loadu_pd(source + i + lane), factor));
+            _mm_storeu_pd(accumulator + i + lane, sum);
+        }
+    }
+    AccumulateRowScalar(source + i, coefficient, accumulator + i, count - i);
+}
+
+IMAGE_PROCESSOR_TARGET("sse4.1")
+void NarrowRowSse41(const double* source, uint8_t* destination, size_t count) {
+    const __m128d max_rgb = _mm_set1_pd(kMaxRgb);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m128i first = _mm_unpacklo_epi64(RoundToInt32Sse41(_mm_mul_pd(_mm_loadu_pd(source + i), max_rgb)),
+                                           RoundToInt32Sse41(_mm_mul_pd(_mm_loadu_pd(source + i + 2), max_rgb)));
+        __m128i second = _mm_unpacklo_epi64(RoundToInt32Sse41(_mm_mul_pd(_mm_loadu_pd(source + i + 4), max_rgb)),
+                                            RoundToInt32Sse41(_mm_mul_pd(_mm_loadu_pd(source + i + 6), max_rgb)));
+        __m128i words = _mm_packs_epi32(first, second);
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(destination + i), _mm_packus_epi16(words, words));
+    }
+    NarrowRowScalar(source + i, destination + i, count - i);
+}
+
+IMAGE_PROCESSOR_TARGET("sse4.1")
+__m128i RoundToInt32Sse41(__m128 value) {
+    const __m128 one = _mm_set1_ps(1.0f);
+    __m128 truncated = _mm_round_ps(value, _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC);
+    __m128 fraction = _mm_sub_ps(value, truncated);
+    truncated = _mm_add_ps(truncated, _mm_and_ps(_mm_cmpge_ps(fraction, _mm_set1_ps(0.5f)), one));
+    truncated = _mm_sub_ps(truncated, _mm_and_ps(_mm_cmple_ps(fraction, _mm_set1_ps(-0.5f)), one));
+    truncated = _mm_min_ps(_mm_max_ps(truncated, _mm_set1_ps(kMinRgb)), _mm_set1_ps(kMaxRgb));
+    return _mm_cvttps_epi32(truncated);
+}
+
+IMAGE_PROCESSOR_TARGET("sse4.1")
+void WidenRowSse41(const uint8_t* source, float* destination, size_t count) {
+    const __m128 max_rgb = _mm_set1_ps(kMaxRgb);
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(source + i));
+        _mm_storeu_ps(destination + i, _mm_div_ps(_mm_cvtepi32_ps(_mm_cvtepu8_epi32(bytes)), max_rgb));
+        _mm_storeu_ps(destination + i + 4, _mm_div_ps(
+                _mm_cvtepi32_ps(_mm_cvtepu8_epi32(_mm_srli_si128(bytes, 4))), max_rgb));
+        _mm_storeu_ps(destination + i + 8, _mm_div_ps(
+                _mm_cvtepi32_ps(_mm_cvtepu8_epi32(_mm_srli_si128(bytes, 8))), max_rgb));
+        _mm_storeu_ps(destination + i + 12, _mm_div_ps(
+                _mm_cvtepi32_ps(_mm_cvtepu8_epi32(_mm_srli_si128(bytes, 12))), max_rgb));
+    }
+    WidenRowScalar(source + i, destination + i, count - i);
+}
+
+IMAGE_PROCESSOR_TARGET("sse4.1")
+void AccumulateRowSse41(const float* source, float coefficient, float* accumulator, size_t count) {
+    const __m128 factor = _mm_set1_ps(coefficient);
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        for (size_t lane = 0; lane < 16; lane += 4) {
+            __m128 sum = _mm_loadu_ps(accumulator + i + lane);
+            sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(source + i + lane), factor));
+            _mm_storeu_ps(accumulator + i + lane, sum);
+        }
+    }
+    AccumulateRowScalar(source + i, coefficient, accumulator + i, count - i);
+}
+
+IMAGE_PROCESSOR_TARGET("sse4.1")
+void NarrowRowSse41(const float* source, uint8_t* destination, size_t count) {
+    const __m128 max_rgb = _mm_set1_ps(kMaxRgb);
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m128i first = _mm_packs_epi32(RoundToInt32Sse41(_mm_mul_ps(_mm_loadu_ps(source + i), max_rgb)),
+                                        RoundToInt32Sse41(_mm_mul_ps(_mm_loadu_ps(source + i + 4), max_rgb)));
+        __m128i second = _mm_packs_epi32(RoundToInt32Sse41(_mm_mul_ps(_mm_loadu_ps(source + i + 8), max_rgb)),
+                                         RoundToInt32Sse41(_mm_mul_ps(_mm_loadu_ps(source + i + 12), max_rgb)));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(destination + i), _mm_packus_epi16(first, second));
+    }
+    NarrowRowScalar(source + i, destination + i, count - i);
+}
+
+IMAGE_PROCESSOR_TARGET("avx2")
+__m128i RoundToInt32Avx2(__m256d value) {
+    const __m256d half = _mm256_set1_pd(0.5);
+    const __m256d one = _mm256_set1_pd(1.0);
+    __m256d truncated = _mm256_round_pd(value, _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC);
+    __m256d fraction = _mm256_sub_pd(value, truncated);
+    truncated = _mm256_add_pd(truncated, _mm256_and_pd(_mm256_cmp_pd(fraction, half, _CMP_GE_OQ), one));
+    truncated = _mm256_sub_pd(truncated,
+                              _mm256_and_pd(_mm256_cmp_pd(fraction, _mm256_set1_pd(-0.5), _CMP_LE_OQ), one));
+    truncated = _mm256_min_pd(_mm256_max_pd(truncated, _mm256_set1_pd(kMinRgb)), _mm256_set1_pd(kMaxRgb));
+    return _mm256_cvttpd_epi32(truncated);
+}
+
+IMAGE_PROCESSOR_TARGET("avx2")
+void WidenRowAvx2(const uint8_t* source, double* destination, size_t count) {
+    const __m256d max_rgb = _mm256_set1_pd(kMaxRgb);
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(source + i));
+        _mm256_storeu_pd(destination + i, _mm256_div_pd(_mm256_cvtepi32_pd(_mm_cvtepu8_epi32(bytes)), max_rgb));
+        _mm256_storeu_pd(destination + i + 4, _mm256_div_pd(
+                _mm256_cvtepi32_pd(_mm_cvtepu8_epi32(_mm_srli_si128(bytes, 4))), max_rgb));
+        _mm256_storeu_pd(destination + i + 8, _mm256_div_pd(
+                _mm256_cvtepi32_pd(_mm_cvtepu8_epi32(_mm_srli_si128(bytes, 8))), max_rgb));
+        _mm256_storeu_pd(destination + i + 12, _mm256_div_pd(
+                _mm256_cvtepi32_pd(_mm_cvtepu8_epi32(_mm_srli_si128(bytes, 12))), max_rgb));
+    }
+    WidenRowScalar(source + i, destination + i, count - i);
+}
+
+IMAGE_PROCESSOR_TARGET("avx2")
+void AccumulateRowAvx2(const double* source, double coefficient, double* accumulator, size_t count) {
+    const __m256d factor = _mm256_set1_pd(coefficient);
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        for (size_t lane = 0; lane < 16; lane += 4) {
+            __m256d sum = _mm256_loadu_pd(accumulator + i + lane);
+            sum = _mm256_add_pd(sum, _mm256_mul_pd(_mm256_loadu_pd(source + i + lane), factor));
+            _mm256_storeu_pd(accumulator + i + lane, sum);
+        }
+    }
+    AccumulateRowScalar(source + i, coefficient, accumulator + i, count - i);
+}
+
+IMAGE_PROCESSOR_TARGET("avx2")
+void NarrowRowAvx2(const double* source, uint8_t* destination, size_t count) {
+    const __m256d max_rgb = _mm256_set1_pd(kMaxRgb);
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m128i first = _mm_packs_epi32(RoundToInt32Avx2(_mm256_mul_pd(_mm256_loadu_pd(source + i), max_rgb)),
+                                        RoundToInt32Avx2(_mm256_mul_pd(_mm256_loadu_pd(source + i + 4), max_rgb)));
+        __m128i second = _mm_packs_epi32(RoundToInt32Avx2(_mm256_mul_pd(_mm256_loadu_pd(source + i + 8), max_rgb)),
+                                         RoundToInt32Avx2(_mm256_mul_pd(_mm256_loadu_pd(source + i + 12), max_rgb)));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(destination + i), _mm_packus_epi16(first, second));
+    }
+    NarrowRowScalar(source + i, destination + i, count - i);
+}
+
+IMAGE_PROCESSOR_TARGET("avx2")
+__m256i RoundToInt32Avx2(__m256 value) {
+    const __m256 one = _mm256_set1_ps(1.0f);
+    __m256 truncated = _mm256_round_ps(value, _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC);
+    __m256 fraction = _mm256_sub_ps(value, truncated);
+    truncated = _mm256_add_ps(truncated, _mm256_and_ps(_mm256_cmp_ps(fraction, _mm256_set1_ps(0.5f), _CMP_GE_OQ),
+                                                       one));
+    truncated = _mm256_sub_ps(truncated, _mm256_and_ps(_mm256_cmp_ps(fraction, _mm256_set1_ps(-0.5f), _CMP_LE_OQ),
+                                                       one));
+    truncated = _mm256_min_ps(_mm256_max_ps(truncated, _mm256_set1_ps(kMinRgb)), _mm256_set1_ps(kMaxRgb));
+    return _mm256_cvttps_epi32(truncated);
+}
+
+IMAGE_PROCESSOR_TARGET("avx2")
+void WidenRowAvx2(const uint8_t* source, float* destination, size_t count) {
+    const __m256 max_rgb = _mm256_set1_ps(kMaxRgb);
+    size_t i = 0;
+    for (; i + 32 <= count; i += 32) {
+        for (size_t lane = 0; lane < 32; lane += 8) {
+            __m128i bytes = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(source + i + lane));
+            _mm256_storeu_ps(destination + i + lane,
+                             _mm256_div_ps(_mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(bytes)), max_rgb));
+        }
+    }
+    WidenRowScalar(source + i, destination + i, count - i);
+}
+
+IMAGE_PROCESSOR_TARGET("avx2")
+void AccumulateRowAvx2(const float* source, float coefficient, float* accumulator, size_t count) {
+    const __m256 factor = _mm256_set1_ps(coefficient);
+    size_t i = 0;
+    for (; i + 32 <= count; i += 32) {
+        for (size_t lane = 0; lane < 32; lane += 8) {
+            __m256 sum = _mm256_loadu_ps(accumulator + i + lane);
+            sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_loadu_ps(source + i + lane), factor));
+            _mm256_storeu_ps(accumulator + i + lane, sum);
+        }
+    }
+    AccumulateRowScalar(source + i, coefficient, accumulator + i, count - i);
+}
+
+IMAGE_PROCESSOR_TARGET("avx2")
+void NarrowRowAvx2(const float* source, uint8_t* destination, size_t count) {
+    const __m256 max_rgb = _mm256_set1_ps(kMaxRgb);
+    // Packing works inside 128-bit lanes, the permutation restores pixel order.
+    const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+    size_t i = 0;
+    for (; i + 32 <= count; i += 32) {
+        __m256i first = _mm256_packs_epi32(RoundToInt32Avx2(_mm256_mul_ps(_mm256_loadu_ps(source + i), max_rgb)),
+                                           RoundToInt32Avx2(_mm256_mul_ps(_mm256_loadu_ps(source + i + 8), max_rgb)));
+        __m256i second = _mm256_packs_epi32(
+                RoundToInt32Avx2(_mm256_mul_ps(_mm256_loadu_ps(source + i + 16), max_rgb)),
+                RoundToInt32Avx2(_mm256_mul_ps(_mm256_loadu_ps(source + i + 24), max_rgb)));
+        __m256i bytes = _mm256_permutevar8x32_epi32(_mm256_packus_epi16(first, second), order);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(destination + i), bytes);
+    }
+    NarrowRowScalar(source + i, destination + i, count - i);
+}
+
+IMAGE_PROCESSOR_TARGET("avx512f")
+__m512i RoundToInt32Avx512(__m512d first, __m512d second) {
+    const __m512d one = _mm512_set1_pd(1.0);
+    __m256i result[2];
+    __m512d values[2] = {first, second};
+    for (size_t part = 0; part < 2; ++part) {
+        __m512d truncated = _mm512_roundscale_pd(values[part], _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC);
+        __m512d fraction = _mm512_sub_pd(values[part], truncated);
+        truncated = _mm512_mask_add_pd(truncated, _mm512_cmp_pd_mask(fraction, _mm512_set1_pd(0.5), _CMP_GE_OQ),
+                                       truncated, one);
+        truncated = _mm512_mask_sub_pd(truncated, _mm512_cmp_pd_mask(fraction, _mm512_set1_pd(-0.5), _CMP_LE_OQ),
+                                       truncated, one);
+        truncated = _mm512_min_pd(_mm512_max_pd(truncated, _mm512_set1_pd(kMinRgb)), _mm512_set1_pd(kMaxRgb));
+        result[part] = _mm512_cvttpd_epi32(truncated);
+    }
+    return _mm512_inserti64x4(_mm512_castsi256_si512(result[0]), result[1], 1);
+}
+
+IMAGE_PROCESSOR_TARGET("avx512f")
+void WidenRowAvx512(const uint8_t* source, double* destination, size_t count) {
+    const __m512d max_rgb = _mm512_set1_pd(kMaxRgb);
+    size_t i = 0;
+    for (; i + 32 <= count; i += 32) {
+        for (size_t lane = 0; lane < 32; lane += 8) {
+            __m128i bytes = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(source + i + lane));
+            _mm512_storeu_pd(destination + i + lane,
+                             _mm512_div_pd(_mm512_cvtepi32_pd(_mm256_cvtepu8_epi32(bytes)), max_rgb));
+        }
+    }
+    WidenRowScalar(source + i, destination + i, count - i);
+}
+
+IMAGE_PROCESSOR_TARGET("avx512f")
+void AccumulateRowAvx512(const double* source, double coefficient, double* accumulator, size_t count) {
+    const __m512d factor = _mm512_set1_pd(coefficient);
+    size_t i = 0;
+    for (; i + 32 <= count; i += 32) {
+        for (size_t lane = 0; lane < 32; lane += 8) {
+            __m512d sum = _mm512_loadu_pd(accumulator + i + lane);
+            sum = _mm512_add_pd(sum, _mm512_mul_pd(_mm512_loadu_pd(source + i + lane), factor));
+            _mm512_storeu_pd(accumulator + i + lane, sum);
+        }
+    }
+    AccumulateRowScalar(source + i, coefficient, accumulator + i, count - i);
+}
+
+IMAGE_PROCESSOR_TARGET("avx512f")
+void NarrowRowAvx512(const double* source, uint8_t* destination, size_t count) {
+    const __m512d max_rgb = _mm512_set1_pd(kMaxRgb);
+    size_t i = 0;
+    for (; i + 32 <= count; i += 32) {
+        for (size_t lane = 0; lane < 32; lane += 16) {
+            __m512i values = RoundToInt32Avx512(_mm512_mul_pd(_mm512_loadu_pd(source + i + lane), max_rgb),
+                                                _mm512_mul_pd(_mm512_loadu_pd(source + i + lane + 8), max_rgb));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(destination + i + lane), _mm512_cvtepi32_epi8(values));
+        }
+    }
+    NarrowRowScalar(source + i, destination + i, count - i);
+}
+
+IMAGE_PROCESSOR_TARGET("avx512f")
+__m512i RoundToInt32Avx512(__m512 value) {
+    const __m512 one = _mm512_set1_ps(1.0f);
+    __m512 truncated = _mm512_roundscale_ps(value, _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC);
+    __m512 fraction = _mm512_sub_ps(value, truncated);
+    truncated = _mm512_mask_add_ps(truncated, _mm512_cmp_ps_mask(fraction, _mm512_set1_ps(0.5f), _CMP_GE_OQ),
+                                   truncated, one);
+    truncated = _mm512_mask_sub_ps(truncated, _mm512_cmp_ps_mask(fraction, _mm512_set1_ps(-0.5f), _CMP_LE_OQ),
+                                   truncated, one);
+    truncated = _mm512_min_ps(_mm512_max_ps(truncated, _mm512_set1_ps(kMinRgb)), _mm512_set1_ps(kMaxRgb));
+    return _mm512_cvttps_epi32(truncated);
+}
+
+IMAGE_PROCESSOR_TARGET("avx512f")
+void WidenRowAvx512(const uint8_t* source, float* destination, size_t count) {
+    const __m512 max_rgb = _mm512_set1_ps(kMaxRgb);
+    size_t i = 0;
+    for (; i + 32 <= count; i += 32) {
+        for (size_t lane = 0; lane < 32; lane += 16) {
+            __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(source + i + lane));
+            _mm512_storeu_ps(destination + i + lane,
+                             _mm512_div_ps(_mm512_cvtepi32_ps(_mm512_cvtepu8_epi32(bytes)), max_rgb));
+        }
+    }
+    WidenRowScalar(source + i, destination + i, count - i);
+}
+
+IMAGE_PROCESSOR_TARGET("avx512f")
+void AccumulateRowAvx512(const float* source, float coefficient, float* accumulator, size_t count) {
+    const __m512 factor = _mm512_set1_ps(coefficient);
+    size_t i = 0;
+    for (; i + 32 <= count; i += 32) {
+        for (size_t lane = 0; lane < 32; lane += 16) {
+            __m512 sum = _mm512_loadu_ps(accumulator + i + lane);
+            sum = _mm512_add_ps(sum, _mm512_mul_ps(_mm512_loadu_ps(source + i + lane), factor));
+            _mm512_storeu_ps(accumulator + i + lane, sum);
+        }
+    }
+    AccumulateRowScalar(source + i, coefficient, accumulator + i, count - i);
+}
+
+IMAGE_PROCESSOR_TARGET("avx512f")
+void NarrowRowAvx512(const float* source, uint8_t* destination, size_t count) {
+    const __m512 max_rgb = _mm512_set1_ps(kMaxRgb);
+    size_t i = 0;
+    for (; i + 32 <= count; i += 32) {
+        for (size_t lane = 0; lane < 32; lane += 16) {
+            __m512i values = RoundToInt32Avx512(_mm512_mul_ps(_mm512_loadu_ps(source + i + lane), max_rgb));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(destination + i + lane), _mm512_cvtepi32_epi8(values));
+        }
+    }
+    NarrowRowScalar(source + i, destination + i, count - i);
+}
+
+#endif
+
+template <typename Accumulator>
+RowKernels<Accumulator> SimdRowKernels() {
+    switch (GetSimdLevel()) {
+#ifdef IMAGE_PROCESSOR_X86
+        case SimdLevel::kAvx512:
+            return {WidenRowAvx512, AccumulateRowAvx512, NarrowRowAvx512};
+        case SimdLevel::kAvx2:
+            return {WidenRowAvx2, AccumulateRowAvx2, NarrowRowAvx2};
+        case SimdLevel::kSse41:
+            return {WidenRowSse41, AccumulateRowSse41, NarrowRowSse41};
+#endif
+        default:
+            return {WidenRowScalar<Accumulator>, AccumulateRowScalar<Accumulator>, NarrowRowScalar<Accumulator>};
+    }
+}
+
+// Adds coefficient * row[x + offset] to accumulator[x]. Where x + offset leaves the
+// row, row[x] is used instead, as BorderCoordinate prescribes.
+template <typename Accumulator>
+void AccumulateShiftedRow(const RowKernels<Accumulator>& kernels, const Accumulator* row, long long offset,
+                          Accumulator coefficient, Accumulator* accumulator, size_t width) {
+    auto signed_width = static_cast<long long>(width);
+    auto begin = static_cast<size_t>(std::clamp(-offset, 0LL, signed_width));
+    auto end = static_cast<size_t>(std::clamp(signed_width - offset, static_cast<long long>(begin), signed_width));
+
+    kernels.accumulate(row + begin + offset, coefficient, accumulator + begin, end - begin);
+    for (size_t x = 0; x < begin; ++x) {
+        accumulator[x] += row[x] * coefficient;
+    }
+    for (size_t x = end; x < width; ++x) {
+        accumulator[x] += row[x] * coefficient;
+    }
+}
+
+}  // namespace
+
+template <typename Accumulator>
+RowKernels<Accumulator> ActiveRowKernels(LightMode light) {
+    RowKernels<Accumulator> kernels = SimdRowKernels<Accumulator>();
+    if (light == LightMode::kLinear) {
+        kernels.widen = DecodeSrgbRow<Accumulator>;
+        kernels.narrow = EncodeSrgbRow<Accumulator>;
+    }
+    return kernels;
+}
+
+size_t BorderCoordinate(size_t position, long long offset, size_t extent) {
+    auto shifted = static_cast<long long>(position) + offset;
+    if (shifted < 0 || shifted >= static_cast<long long>(extent)) {
+        return position;
+    }
+    return static_cast<size_t>(shifted);
+}
+
+template <typename Accumulator>
+void Convolve(const Plane& source, Plane& destination, const CoefficientsMatrix& matrix, LightMode light) {
+    if (matrix.size() >= kFftConvolutionMinMatrixSize) {
+        ConvolveFft(source, destination, matrix, light);
+    } else {
+        ConvolveDirect<Accumulator>(source, destination, matrix, light);
+    }
+}
+
+template <typename Accumulator>
+void ConvolveDirect(const Plane& source, Plane& destination, const CoefficientsMatrix& matrix, LightMode light) {
+    destination = Plane(source.width, source.height);
+    ConvolveRows<Accumulator>(
+            source.width, source.height, matrix, [&source](size_t row_number) { return source.Row(row_number); },
+            [&destination](size_t row_number, const uint8_t* row) {
+                std::copy(row, row + destination.width, destination.Row(row_number));
+            },
+            light);
+}
+
+template <typename Accumulator>
+void ConvolveRows(size_t width, size_t height, const CoefficientsMatrix& matrix, const RowReader& read_row,
+                  const RowWriter& write_row, LightMode light) {
+    const RowKernels<Accumulator> kernels = ActiveRowKernels<Accumulator>(light);
+    size_t matrix_size = matrix.size();
+    auto radius = static_cast<long long>((matrix_size - 1) / 2);
+
+    std::vector<std::vector<Accumulator>> window(matrix_size, std::vector<Accumulator>(width));
+    std::vector<Accumulator> accumulator(width);
+    std::vector<uint8_t> narrowed(width);
+    size_t next_row = 0;
+
+    for (size_t y = 0; y < height; ++y) {
+        for (; next_row < height && next_row <= y + radius; ++next_row) {
+            kernels.widen(read_row(next_row), window[next_row % matrix_size].data(), width);
+        }
+
+        std::fill(accumulator.begin(), accumulator.end(), Accumulator());
+        for (auto y_diff = -radius; y_diff <= radius; ++y_diff) {
+            const Accumulator* row = window[BorderCoordinate(y, y_diff, height) % matrix_size].data();
+            for (auto x_diff = -radius; x_diff <= radius; ++x_diff) {
+                AccumulateShiftedRow(kernels, row, x_diff,
+                                     static_cast<Accumulator>(matrix[y_diff + radius][x_diff + radius]),
+                                     accumulator.data(), width);
+            }
+        }
+        kernels.narrow(accumulator.data(), narrowed.data(), width);
+        write_row(y, narrowed.data());
+    }
+}
+
+void ConvolveFft(const Plane& source, Plane& destination, const CoefficientsMatrix& matrix, LightMode light) {
+    const RowKernels<double> kernels = ActiveRowKernels<double>(light);
+    size_t matrix_size = matrix.size();
+    size_t radius = (matrix_size - 1) / 2;
+    size_t width = source.width;
+    size_t height = source.height;
+
+    size_t transform_size = NextPowerOfTwo(std::max(kFftMinimalTransformSize, 4 * matrix_size));
+    size_t tile_size = transform_size - matrix_size + 1;
+
+    // The transform computes a true convolution while matrices are applied as a
+    // correlation, hence the flipped kernel.
+    std::vector<Complex> kernel_spectrum(transform_size * transform_size);
+    for (size_t y = 0; y < matrix_size; ++y) {
+        for (size_t x = 0; x < matrix_size; ++x) {
+            kernel_spectrum[(matrix_size - 1 - y) * transform_size + matrix_size - 1 - x] = matrix[y][x];
+        }
+    }
+    FourierTransform(transform_size).Transform2d(kernel_spectrum, false);
+
+    // Zero padding drops the taps that leave the image; near the borders they are added
+    // back with the replaced coordinate. Prefix sums make each border pixel O(matrix_size).
+    std::vector<std::vector<double>> row_prefix(matrix_size, std::vector<double>(matrix_size + 1));
+    std::vector<std::vector<double>> column_prefix(matrix_size, std::vector<double>(matrix_size + 1));
+    for (size_t a = 0; a < matrix_size; ++a) {
+        for (size_t b = 0; b < matrix_size; ++b) {
+            row_prefix[a][b + 1] = row_prefix[a][b] + matrix[a][b];
+            column_prefix[a][b + 1] = column_prefix[a][b] + matrix[b][a];
+        }
+    }
+    auto outside_range = [matrix_size, radius](size_t position, size_t extent) {
+        auto low = static_cast<size_t>(std::clamp(static_cast<long long>(radius) - static_cast<long long>(position),
+                                                  0LL, static_cast<long long>(matrix_size)));
+        auto high = static_cast<size_t>(std::clamp(static_cast<long long>(extent + radius - position),
+                                                   static_cast<long long>(low), static_cast<long long>(matrix_size)));
+        return std::make_pair(low, high);
+    };
+    auto outside_sum = [matrix_size](const std::vector<double>& prefix, std::pair<size_t, size_t> range) {
+        return prefix[range.first] + prefix[matrix_size] - prefix[range.second];
+    };
+    std::array<uint8_t, kMaxRgb + 1> levels;
+    std::array<double, kMaxRgb + 1> widened_levels;
+    for (size_t level = 0; level < levels.size(); ++level) {
+        levels[level] = static_cast<uint8_t>(level);
+    }
+    kernels.widen(levels.data(), widened_levels.data(), levels.size());
+    auto value = [&source, &widened_levels](size_t y, size_t x) {
+        return widened_levels[source.Row(y)[x]];
+    };
+    // row holds pixels (y, 0) ... (y, width - 1) of the zero-padded convolution.
+    auto correct_row = [&](size_t y, double* row) {
+        bool border_row = y < radius || y + radius >= height;
+        auto rows = outside_range(y, height);
+        for (size_t x = 0; x < width; ++x) {
+            if (!border_row && x >= radius && x + radius < width) {
+                x = width - radius - 1;
+                continue;
+            }
+            auto columns = outside_range(x, width);
+            double correction = 0;
+            for (size_t a = rows.first; a < rows.second; ++a) {
+                correction += value(y + a - radius, x) * outside_sum(row_prefix[a], columns);
+            }
+            for (size_t b = columns.first; b < columns.second; ++b) {
+                correction += value(y, x + b - radius) * outside_sum(column_prefix[b], rows);
+            }
+            double corner_sum = 0;
+            for (size_t a = 0; a < matrix_size; ++a) {
+                if (a < rows.first || a >= rows.second) {
+                    corner_sum += outside_sum(row_prefix[a], columns);
+                }
+            }
+            row[x] += correction + corner_sum * value(y, x);
+        }
+    };
+
+    destination = Plane(width, height);
+    size_t padded_width = width + matrix_size - 1;
+    size_t band_height = tile_size + matrix_size - 1;
+    size_t tile_rows_count = (height + tile_size - 1) / tile_size;
+
+    ParallelFor(tile_rows_count, [&](size_t, size_t begin, size_t end) {
+        FourierTransform transform(transform_size);
+        std::vector<Complex> spectrum(transform_size * transform_size);
+        std::vector<double> widened(tile_size);
+        // Rows tile_y ... tile_y + band_height - 1 of the full convolution of the zero-padded
+        // image, where pixel (y, x) lands at (y + radius, x + radius). The last
+        // matrix_size - 1 rows overlap the next tile row and are carried over to it.
+        std::vector<double> band(padded_width * band_height);
+
+        // The kernel is real, so two neighbouring tiles share one transform as real and imaginary parts.
+        auto add_tile_row = [&](size_t tile_y) {
+            size_t tile_height = std::min(tile_size, height - tile_y);
+            for (size_t pair_x = 0; pair_x < width; pair_x += 2 * tile_size) {
+                size_t tiles_in_transform = pair_x + tile_size < width ? 2 : 1;
+                std::fill(spectrum.begin(), spectrum.end(), Complex());
+
+                for (size_t part = 0; part < tiles_in_transform; ++part) {
+                    size_t tile_x = pair_x + part * tile_size;
+                    size_t tile_width = std::min(tile_size, width - tile_x);
+                    for (size_t y = 0; y < tile_height; ++y) {
+                        kernels.widen(source.Row(tile_y + y) + tile_x, widened.data(), tile_width);
+                        for (size_t x = 0; x < tile_width; ++x) {
+                            reinterpret_cast<double*>(&spectrum[y * transform_size + x])[part] = widened[x];
+                        }
+                    }
+                }
+
+                transform.Transform2d(spectrum, false);
+                for (size_t i = 0; i < spectrum.size(); ++i) {
+                    spectrum[i] *= kernel_spectrum[i];
+                }
+                transform.Transform2d(spectrum, true);
+
+                for (size_t part = 0; part < tiles_in_transform; ++part) {
+                    size_t tile_x = pair_x + part * tile_size;
+                    size_t result_width = std::min(tile_size, width - tile_x) + matrix_size - 1;
+                    for (size_t y = 0; y < tile_height + matrix_size - 1; ++y) {
+                        double* row = band.data() + y * padded_width + tile_x;
+                        for (size_t x = 0; x < result_width; ++x) {
+                            row[x] += reinterpret_cast<const double*>(&spectrum[y * transform_size + x])[part];
+                        }
+                    }
+                }
+            }
+        };
+        auto carry_overlap = [&] {
+            std::copy(band.begin() + tile_size * padded_width, band.end(), band.begin());
+            std::fill(band.begin() + (matrix_size - 1) * padded_width, band.end(), 0.0);
+        };
+
+        // The overlap of the tile row before this band is recomputed rather than taken from
+        // the neighbouring band, so bands run independently and the sums don't depend on the
+        // number of threads.
+        if (begin > 0) {
+            add_tile_row((begin - 1) * tile_size);
+            carry_overlap();
+        }
+        for (size_t tile_row = begin; tile_row < end; ++tile_row) {
+            size_t tile_y = tile_row * tile_size;
+            add_tile_row(tile_y);
+            // Rows above the next tile row get nothing more from it.
+            size_t finished_rows = tile_row + 1 < tile_rows_count ? tile_size : height - tile_y + matrix_size - 1;
+            for (size_t band_y = 0; band_y < finished_rows; ++band_y) {
+                size_t padded_y = tile_y + band_y;
+                if (padded_y < radius || padded_y >= height + radius) {
+                    continue;
+                }
+                double* row = band.data() + band_y * padded_width + radius;
+                correct_row(padded_y - radius, row);
+                kernels.narrow(row, destination.Row(padded_y - radius), width);
+            }
+            carry_overlap();
+        }
+    });
+}
+
+template <typename Accumulator>
+void ConvolveSeparable(const Plane& source, Plane& destination, const std::vector<Accumulator>& vertical,
+                       const std::vector<Accumulator>& horizontal, LightMode light) {
+    const RowKernels<Accumulator> kernels = ActiveRowKernels<Accumulator>(light);
+    size_t vertical_size = vertical.size();
+    auto vertical_radius = static_cast<long long>((vertical_size - 1) / 2);
+    auto horizontal_radius = static_cast<long long>((horizontal.size() - 1) / 2);
+
+    destination = Plane(source.width, source.height);
+    std::vector<std::vector<Accumulator>> window(vertical_size, std::vector<Accumulator>(source.width));
+    std::vector<Accumulator> widened(source.width);
+    std::vector<Accumulator> accumulator(source.width);
+    size_t next_row = 0;
+
+    for (size_t y = 0; y < source.height; ++y) {
+        for (; next_row < source.height && next_row <= y + vertical_radius; ++next_row) {
+            std::vector<Accumulator>& filtered = window[next_row % vertical_size];
+            kernels.widen(source.Row(next_row), widened.data(), source.width);
+            std::fill(filtered.begin(), filtered.end(), Accumulator());
+            for (auto x_diff = -horizontal_radius; x_diff <= horizontal_radius; ++x_diff) {
+                AccumulateShiftedRow(kernels, widened.data(), x_diff, horizontal[x_diff + horizontal_radius],
+                                     filtered.data(), source.width);
+            }
+        }
+
+        std::fill(accumulator.begin(), accumulator.end(), Accumulator());
+        for (auto y_diff = -vertical_radius; y_diff <= vertical_radius; ++y_diff) {
+            kernels.accumulate(window[BorderCoordinate(y, y_diff, source.height) % vertical_size].data(),
+                               vertical[y_diff + vertical_radius], accumulator.data(), source.width);
+        }
+        kernels.narrow(accumulator.data(), destination.Row(y), source.width);
+    }
+}
+
+template void Convolve<float>(const Plane& source, Plane& destination, const CoefficientsMatrix& matrix,
+                             LightMode light);
+template void Convolve<double>(const Plane& source, Plane& destination, const CoefficientsMatrix& matrix,
+                              LightMode light);
+template void ConvolveDirect<float>(const Plane& source, Plane& destination, const CoefficientsMatrix& matrix,
+                                   LightMode light);
+template void ConvolveDirect<double>(const Plane& source, Plane& destination, const CoefficientsMatrix& matrix,
+                                    LightMode light);
+template void ConvolveRows<float>(size_t width, size_t height, const CoefficientsMatrix& matrix,
+                                  const RowReader& read_row, const RowWriter& write_row, LightMode light);
+template void ConvolveRows<double>(size_t width, size_t height, const CoefficientsMatrix& matrix,
+                                   const RowReader& read_row, const RowWriter& write_row, LightMode light);
+template void ConvolveSeparable<float>(const Plane& source, Plane& destination, const std::vector<float>& vertical,
+                                       const std::vector<float>& horizontal, LightMode light);
+template void ConvolveSeparable<double>(const Plane& source, Plane& destination, const std::vector<double>& vertical,
+                                        const std::vector<double>& horizontal, LightMode light);
+template RowKernels<float> ActiveRowKernels<float>(LightMode light);
+template RowKernels<double> ActiveRowKernels<double>(LightMode light);
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "bmp_processing.h"
+#include "simd.h"
+
+typedef std::vector<std::vector<double>> CoefficientsMatrix;
+typedef std::vector<double> CoefficientsVector;
+
+// Matrices of at least this size are convolved through FFT tiles; the crossover is
+// measured by bench/bench.cpp.
+constexpr size_t kFftConvolutionMinMatrixSize = 25;
+constexpr size_t kFftMinimalTransformSize = 128;
+
+enum class Precision : unsigned char {
+    kFloat,
+    kDouble,
+};
+
+// kLinear convolves linear light: levels are decoded from sRGB while rows are widened to the
+// accumulator and encoded back while they are narrowed, so it costs no extra pass.
+enum class LightMode : unsigned char {
+    kEncoded,
+    kLinear,
+};
+
+// Per-row steps every convolution is built from. Accumulators hold levels / 255, or linear
+// light for LightMode::kLinear; every SIMD level gives identical results.
+template <typename Accumulator>
+struct RowKernels {
+    void (*widen)(const uint8_t* source, Accumulator* destination, size_t count);
+    void (*accumulate)(const Accumulator* source, Accumulator coefficient, Accumulator* accumulator, size_t count);
+    void (*narrow)(const Accumulator* source, uint8_t* destination, size_t count);
+};
+
+template <typename Accumulator>
+RowKernels<Accumulator> ActiveRowKernels(LightMode light = LightMode::kEncoded);
+
+// Rows are handed out in increasing order and read_row's pointer only has to stay valid
+// until the next call. write_row(y) always comes after the last read_row a row y needs,
+// so callers may overwrite their source in place.
+typedef std::function<const uint8_t*(size_t row_number)> RowReader;
+typedef std::function<void(size_t row_number, const uint8_t* row)> RowWriter;
+
+// Border rule shared by every neighbourhood operation: a coordinate that falls outside
+// [0, extent) is replaced by the coordinate of the target pixel, separately per axis.
+size_t BorderCoordinate(size_t position, long long offset, size_t extent);
+
+// Accumulator is float or double. ConvolveDirect<double> reproduces the original per-pixel
+// double arithmetic bit for bit: value / 255 times coefficient, summed in matrix order,
+// then scaled back and rounded half away from zero. Convolve hands matrices of
+// kFftConvolutionMinMatrixSize and up to ConvolveFft and the rest to ConvolveDirect.
+template <typename Accumulator>
+void Convolve(const Plane& source, Plane& destination, const CoefficientsMatrix& matrix,
+              LightMode light = LightMode::kEncoded);
+template <typename Accumulator>
+void ConvolveDirect(const Plane& source, Plane& destination, const CoefficientsMatrix& matrix,
+                    LightMode light = LightMode::kEncoded);
+// ConvolveDirect over rows that are produced and consumed on the fly, so a whole source
+// or destination plane never has to exist.
+template <typename Accumulator>
+void ConvolveRows(size_t width, size_t height, const CoefficientsMatrix& matrix, const RowReader& read_row,
+                  const RowWriter& write_row, LightMode light = LightMode::kEncoded);
+// Overlap-add over square tiles. Results may differ from ConvolveDirect by one level
+// where the exact value lies on a rounding boundary. Rows of tiles are split across
+// threads, and each thread keeps only one row of tiles plus its overlap, so memory does not
+// grow with the image height.
+void ConvolveFft(const Plane& source, Plane& destination, const CoefficientsMatrix& matrix,
+                 LightMode light = LightMode::kEncoded);
+template <typename Accumulator>
+void ConvolveSeparable(const Plane& source, Plane& destination, const std::vector<Accumulator>& vertical,
+                       const std::vector<Accumulator>& horizontal, LightMode light = LightMode::kEncoded);
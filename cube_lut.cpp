@@ -0,0 +1,226 @@
+#include "cube_lut.h"
+
+#include <algorithm>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <shared_mutex>
+#include <sstream>
+#include <utility>
+
+#include "parallel.h"
+#include "simd.h"
+
+namespace {
+
+std::array<float, kAmountOfPrimaryColors> ReadTriple(std::istringstream& line, const std::string& path) {
+    std::array<float, kAmountOfPrimaryColors> triple{};
+    for (auto& value : triple) {
+        if (!(line >> value)) {
+            throw FileProcessingException(path + " is not valid cube LUT");
+        }
+    }
+    std::string rest;
+    if (line >> rest) {
+        throw FileProcessingException(path + " is not valid cube LUT");
+    }
+    return triple;
+}
+
+void FillCoordinates(CubeLut& lut, const std::array<float, kAmountOfPrimaryColors>& domain_min,
+                     const std::array<float, kAmountOfPrimaryColors>& domain_max) {
+    auto last_index = static_cast<double>(lut.size - 1);
+    for (size_t channel = 0; channel < kAmountOfPrimaryColors; ++channel) {
+        for (int level = kMinRgb; level <= kMaxRgb; ++level) {
+            double position = (static_cast<double>(level) / kMaxRgb - domain_min[channel]) /
+                              (domain_max[channel] - domain_min[channel]) * last_index;
+            position = std::clamp(position, 0.0, last_index);
+            double index = std::min(std::floor(position), last_index - 1);
+            lut.coordinates[channel][level] = {.index = static_cast<uint32_t>(index),
+                                               .fraction = static_cast<float>(position - index)};
+        }
+    }
+}
+
+// A pixel's cell is split into six tetrahedra along the order of its fractions; the
+// result is vertices[0] plus weights[i] times the step from vertices[i] to vertices[i + 1].
+struct Tetrahedron {
+    std::array<const float*, 4> vertices;
+    std::array<float, 3> weights;
+};
+
+Tetrahedron FindTetrahedron(const CubeLut& lut, const PixelColor& pixel) {
+    const CubeCoordinate& red = lut.coordinates[0][pixel.r];
+    const CubeCoordinate& green = lut.coordinates[1][pixel.g];
+    const CubeCoordinate& blue = lut.coordinates[2][pixel.b];
+    size_t red_step = kCubeEntryStride;
+    size_t green_step = lut.size * red_step;
+    size_t blue_step = lut.size * green_step;
+    const float* origin = lut.table.data() + blue.index * blue_step + green.index * green_step +
+                          red.index * red_step;
+
+    auto make = [origin](size_t first_step, size_t second_step, size_t third_step, float first, float second,
+                         float third) {
+        return Tetrahedron{.vertices = {origin, origin + first_step, origin + first_step + second_step,
+                                        origin + first_step + second_step + third_step},
+                           .weights = {first, second, third}};
+    };
+    if (red.fraction > green.fraction) {
+        if (green.fraction > blue.fraction) {
+            return make(red_step, green_step, blue_step, red.fraction, green.fraction, blue.fraction);
+        }
+        if (red.fraction > blue.fraction) {
+            return make(red_step, blue_step, green_step, red.fraction, blue.fraction, green.fraction);
+        }
+        return make(blue_step, red_step, green_step, blue.fraction, red.fraction, green.fraction);
+    }
+    if (blue.fraction > green.fraction) {
+        return make(blue_step, green_step, red_step, blue.fraction, green.fraction, red.fraction);
+    }
+    if (blue.fraction > red.fraction) {
+        return make(green_step, blue_step, red_step, green.fraction, blue.fraction, red.fraction);
+    }
+    return make(green_step, red_step, blue_step, green.fraction, red.fraction, blue.fraction);
+}
+
+uint8_t NarrowLevel(float value) {
+    return static_cast<uint8_t>(std::clamp(static_cast<int>(std::lround(value)), kMinRgb, kMaxRgb));
+}
+
+void ApplyCubeLutScalar(const CubeLut& lut, PixelColor* row, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        Tetrahedron tetrahedron = FindTetrahedron(lut, row[i]);
+        std::array<float, kAmountOfPrimaryColors> color{};
+        for (size_t channel = 0; channel < kAmountOfPrimaryColors; ++channel) {
+            float value = tetrahedron.vertices[0][channel];
+            for (size_t step = 0; step < tetrahedron.weights.size(); ++step) {
+                value += tetrahedron.weights[step] *
+                         (tetrahedron.vertices[step + 1][channel] - tetrahedron.vertices[step][channel]);
+            }
+            color[channel] = value * kMaxRgb;
+        }
+        row[i] = {NarrowLevel(color[0]), NarrowLevel(color[1]), NarrowLevel(color[2])};
+    }
+}
+
+#ifdef IMAGE_PROCESSOR_X86
+
+// All three channels of a pixel share one register; lanes repeat the scalar arithmetic.
+IMAGE_PROCESSOR_TARGET("sse4.1")
+void ApplyCubeLutSse41(const CubeLut& lut, PixelColor* row, size_t count) {
+    const __m128 max_rgb = _mm_set1_ps(kMaxRgb);
+    alignas(16) float color[kCubeEntryStride];
+    for (size_t i = 0; i < count; ++i) {
+        Tetrahedron tetrahedron = FindTetrahedron(lut, row[i]);
+        __m128 previous = _mm_loadu_ps(tetrahedron.vertices[0]);
+        __m128 value = previous;
+        for (size_t step = 0; step < tetrahedron.weights.size(); ++step) {
+            __m128 next = _mm_loadu_ps(tetrahedron.vertices[step + 1]);
+            value = _mm_add_ps(value, _mm_mul_ps(_mm_set1_ps(tetrahedron.weights[step]), _mm_sub_ps(next, previous)));
+            previous = next;
+        }
+        _mm_store_ps(color, _mm_mul_ps(value, max_rgb));
+        row[i] = {NarrowLevel(color[0]), NarrowLevel(color[1]), NarrowLevel(color[2])};
+    }
+}
+
+#endif
+
+struct CubeLutCache {
+    std::shared_mutex mutex;
+    std::map<std::pair<std::string, std::filesystem::file_time_type>, std::shared_ptr<const CubeLut>> luts;
+};
+
+}  // namespace
+
+CubeLut ReadCubeLut(const std::string& path) {
+    std::ifstream in(path);
+    if (!in.is_open()) {
+        throw FileProcessingException("can not open for reading " + path);
+    }
+
+    CubeLut lut;
+    std::array<float, kAmountOfPrimaryColors> domain_min = {0, 0, 0};
+    std::array<float, kAmountOfPrimaryColors> domain_max = {1, 1, 1};
+    std::string text;
+    while (std::getline(in, text)) {
+        std::istringstream line(text.substr(0, text.find('#')));
+        std::string keyword;
+        if (!(line >> keyword)) {
+            continue;
+        }
+
+        if (keyword == kCubeTitleKeyword) {
+            continue;
+        } else if (keyword == kCubeSizeKeyword) {
+            if (!(line >> lut.size) || lut.size < kCubeMinimalSize || lut.size > kCubeMaximalSize) {
+                throw FileProcessingException(path + " is not valid cube LUT");
+            }
+            lut.table.reserve(lut.size * lut.size * lut.size * kCubeEntryStride);
+        } else if (keyword == kCubeDomainMinKeyword) {
+            domain_min = ReadTriple(line, path);
+        } else if (keyword == kCubeDomainMaxKeyword) {
+            domain_max = ReadTriple(line, path);
+        } else {
+            std::istringstream entry(text.substr(0, text.find('#')));
+            auto color = ReadTriple(entry, path);
+            if (lut.size == 0) {
+                throw FileProcessingException(path + " is not valid cube LUT");
+            }
+            lut.table.insert(lut.table.end(), color.begin(), color.end());
+            lut.table.push_back(0);
+        }
+    }
+
+    if (lut.size == 0 || lut.table.size() != lut.size * lut.size * lut.size * kCubeEntryStride) {
+        throw FileProcessingException(path + " is not valid cube LUT");
+    }
+    for (size_t channel = 0; channel < kAmountOfPrimaryColors; ++channel) {
+        if (!(domain_min[channel] < domain_max[channel])) {
+            throw FileProcessingException(path + " is not valid cube LUT");
+        }
+    }
+    FillCoordinates(lut, domain_min, domain_max);
+    return lut;
+}
+
+std::shared_ptr<const CubeLut> GetCubeLut(const std::string& path) {
+    static CubeLutCache cache;
+    std::error_code error;
+    auto key = std::make_pair(path, std::filesystem::last_write_time(path, error));
+    if (error) {
+        throw FileProcessingException("can not open for reading " + path);
+    }
+
+    {
+        std::shared_lock lock(cache.mutex);
+        auto found = cache.luts.find(key);
+        if (found != cache.luts.end()) {
+            return found->second;
+        }
+    }
+
+    auto lut = std::make_shared<const CubeLut>(ReadCubeLut(path));
+    std::unique_lock lock(cache.mutex);
+    if (cache.luts.size() >= kCubeLutCacheLimit) {
+        return lut;
+    }
+    return cache.luts.try_emplace(std::move(key), std::move(lut)).first->second;
+}
+
+void ApplyCubeLut(const CubeLut& lut, PixelMatrix& pixels) {
+    auto apply_row = ApplyCubeLutScalar;
+#ifdef IMAGE_PROCESSOR_X86
+    if (GetSimdLevel() >= SimdLevel::kSse41) {
+        apply_row = ApplyCubeLutSse41;
+    }
+#endif
+
+    ParallelFor(pixels.size(), [&lut, &pixels, apply_row](size_t, size_t begin, size_t end) {
+        for (size_t y = begin; y < end; ++y) {
+            apply_row(lut, pixels[y].data(), pixels[y].size());
+        }
+    });
+}
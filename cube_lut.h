@@ -0,0 +1,41 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "bmp_processing.h"
+#include "exceptions.h"
+
+constexpr std::string_view kCubeTitleKeyword = "TITLE";
+constexpr std::string_view kCubeSizeKeyword = "LUT_3D_SIZE";
+constexpr std::string_view kCubeDomainMinKeyword = "DOMAIN_MIN";
+constexpr std::string_view kCubeDomainMaxKeyword = "DOMAIN_MAX";
+constexpr size_t kCubeMinimalSize = 2;
+constexpr size_t kCubeMaximalSize = 256;
+// Entries are padded to four floats so a whole colour is one aligned vector load.
+constexpr size_t kCubeEntryStride = 4;
+constexpr size_t kCubeLutCacheLimit = 16;
+
+// Lattice coordinate of one input level along one axis: the lower lattice index and the
+// fraction towards the next one.
+struct CubeCoordinate {
+    uint32_t index = 0;
+    float fraction = 0;
+};
+
+struct CubeLut {
+    size_t size = 0;
+    // Red varies fastest, as in the file: entry (r, g, b) starts at ((b * size + g) * size + r) * stride.
+    std::vector<float> table;
+    // Precomputed for every 8-bit level from the domain, per channel.
+    std::array<std::array<CubeCoordinate, kMaxRgb + 1>, kAmountOfPrimaryColors> coordinates;
+};
+
+CubeLut ReadCubeLut(const std::string& path);
+// Parsed cubes are kept process-wide, keyed by path and modification time.
+std::shared_ptr<const CubeLut> GetCubeLut(const std::string& path);
+// Tetrahedral interpolation, split into row bands across threads.
+void ApplyCubeLut(const CubeLut& lut, PixelMatrix& pixels);
@@ -0,0 +1,248 @@
+#include "downscale.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+
+#include "parallel.h"
+#include "simd.h"
+
+namespace {
+
+// Rounded division of block sums, at most kMaxRgb * divisor, as a multiply and a shift. With
+// reciprocal = 2^shift / divisor + 1 the quotient overshoots by less than (sum + half) / 2^shift,
+// and 2^shift > (kMaxRgb + 1) * divisor^2 keeps that below the 1 / divisor a quotient needs to
+// reach the next integer. The reciprocal then fits in 32 bits, as pmuludq takes it.
+struct RoundedDivisor {
+    uint32_t half;
+    int shift;
+    uint32_t reciprocal;
+
+    explicit RoundedDivisor(uint32_t divisor)
+        : half(divisor / 2),
+          shift(kDownscaleLevelBits + 2 * std::bit_width(divisor - 1)),
+          reciprocal(static_cast<uint32_t>((uint64_t{1} << shift) / divisor + 1)) {
+    }
+
+    uint8_t Divide(uint32_t sum) const {
+        return static_cast<uint8_t>((uint64_t{sum + half} * reciprocal) >> shift);
+    }
+};
+
+#ifdef IMAGE_PROCESSOR_X86
+
+IMAGE_PROCESSOR_TARGET("sse4.1")
+size_t AccumulateRowSse41(const uint8_t* row, uint16_t* sums, size_t count) {
+    const __m128i zero = _mm_setzero_si128();
+    size_t x = 0;
+    for (; x + 16 <= count; x += 16) {
+        __m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + x));
+        auto* low = reinterpret_cast<__m128i*>(sums + x);
+        auto* high = reinterpret_cast<__m128i*>(sums + x + 8);
+        _mm_storeu_si128(low, _mm_add_epi16(_mm_loadu_si128(low), _mm_unpacklo_epi8(pixels, zero)));
+        _mm_storeu_si128(high, _mm_add_epi16(_mm_loadu_si128(high), _mm_unpackhi_epi8(pixels, zero)));
+    }
+    return x;
+}
+
+IMAGE_PROCESSOR_TARGET("avx2")
+size_t AccumulateRowAvx2(const uint8_t* row, uint16_t* sums, size_t count) {
+    size_t x = 0;
+    for (; x + 32 <= count; x += 32) {
+        __m256i low = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(row + x)));
+        __m256i high = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(row + x + 16)));
+        auto* low_sums = reinterpret_cast<__m256i*>(sums + x);
+        auto* high_sums = reinterpret_cast<__m256i*>(sums + x + 16);
+        _mm256_storeu_si256(low_sums, _mm256_add_epi16(_mm256_loadu_si256(low_sums), low));
+        _mm256_storeu_si256(high_sums, _mm256_add_epi16(_mm256_loadu_si256(high_sums), high));
+    }
+    return x;
+}
+
+// Factors 2 and 4 add neighbouring column sums with pmaddwd and phaddd; the sums of at most
+// four rows are far from the signed 16-bit limit pmaddwd has.
+IMAGE_PROCESSOR_TARGET("sse4.1")
+size_t ReduceColumnSumsSse41(const uint16_t* sums, size_t factor, uint32_t* block_sums, size_t count) {
+    const __m128i ones = _mm_set1_epi16(1);
+    size_t x = 0;
+    if (factor == 2) {
+        for (; x + 4 <= count; x += 4) {
+            __m128i pairs = _mm_madd_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(sums + x * 2)), ones);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(block_sums + x), pairs);
+        }
+    } else if (factor == 4) {
+        for (; x + 4 <= count; x += 4) {
+            __m128i low = _mm_madd_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(sums + x * 4)), ones);
+            __m128i high = _mm_madd_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(sums + x * 4 + 8)), ones);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(block_sums + x), _mm_hadd_epi32(low, high));
+        }
+    }
+    return x;
+}
+
+IMAGE_PROCESSOR_TARGET("sse4.1")
+size_t DivideBlockSumsSse41(const uint32_t* sums, const RoundedDivisor& divisor, uint8_t* destination,
+                            size_t count) {
+    const __m128i half = _mm_set1_epi32(static_cast<int>(divisor.half));
+    const __m128i reciprocal = _mm_set1_epi32(static_cast<int>(divisor.reciprocal));
+    const __m128i shift = _mm_cvtsi32_si128(divisor.shift);
+    size_t x = 0;
+    for (; x + 4 <= count; x += 4) {
+        __m128i rounded = _mm_add_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(sums + x)), half);
+        __m128i even = _mm_srl_epi64(_mm_mul_epu32(rounded, reciprocal), shift);
+        __m128i odd = _mm_srl_epi64(_mm_mul_epu32(_mm_srli_epi64(rounded, 32), reciprocal), shift);
+        __m128i quotients = _mm_blend_epi16(even, _mm_slli_epi64(odd, 32), 0xCC);
+        __m128i words = _mm_packus_epi32(quotients, quotients);
+        int bytes = _mm_cvtsi128_si32(_mm_packus_epi16(words, words));
+        std::memcpy(destination + x, &bytes, sizeof(bytes));
+    }
+    return x;
+}
+
+#endif
+
+// Return how many leading values were handled, the caller finishes in scalar.
+size_t AccumulateRowVector(const uint8_t* row, uint16_t* sums, size_t count) {
+#ifdef IMAGE_PROCESSOR_X86
+    if (GetSimdLevel() >= SimdLevel::kAvx2) {
+        return AccumulateRowAvx2(row, sums, count);
+    }
+    if (GetSimdLevel() >= SimdLevel::kSse41) {
+        return AccumulateRowSse41(row, sums, count);
+    }
+#endif
+    return 0;
+}
+
+size_t ReduceColumnSumsVector(const uint16_t* sums, size_t factor, uint32_t* block_sums, size_t count) {
+#ifdef IMAGE_PROCESSOR_X86
+    if (GetSimdLevel() >= SimdLevel::kSse41) {
+        return ReduceColumnSumsSse41(sums, factor, block_sums, count);
+    }
+#endif
+    return 0;
+}
+
+size_t DivideBlockSumsVector(const uint32_t* sums, const RoundedDivisor& divisor, uint8_t* destination,
+                             size_t count) {
+#ifdef IMAGE_PROCESSOR_X86
+    if (GetSimdLevel() >= SimdLevel::kSse41) {
+        return DivideBlockSumsSse41(sums, divisor, destination, count);
+    }
+#endif
+    return 0;
+}
+
+void AccumulateRow(const uint8_t* row, uint16_t* sums, size_t count) {
+    for (size_t x = AccumulateRowVector(row, sums, count); x < count; ++x) {
+        sums[x] += row[x];
+    }
+}
+
+uint32_t SumColumns(const uint16_t* sums, size_t count) {
+    uint32_t sum = 0;
+    for (size_t x = 0; x < count; ++x) {
+        sum += sums[x];
+    }
+    return sum;
+}
+
+}  // namespace
+
+size_t GetDownscaledSize(size_t size, size_t factor) {
+    return (size + factor - 1) / factor;
+}
+
+BoxDownscaler::BoxDownscaler(size_t source_width, size_t source_height, size_t factor, Plane& destination)
+    : factor_(factor),
+      source_height_(source_height),
+      destination_(destination),
+      column_sums_(source_width),
+      block_sums_(destination.width) {
+}
+
+bool BoxDownscaler::AddRow(size_t y, const uint8_t* row) {
+    AccumulateRow(row, column_sums_.data(), column_sums_.size());
+    ++rows_count_;
+    size_t block = y / factor_;
+    if (rows_count_ != std::min(factor_, source_height_ - block * factor_)) {
+        return false;
+    }
+    FinishBlock(block);
+    return true;
+}
+
+void BoxDownscaler::FinishBlock(size_t block) {
+    size_t width = column_sums_.size();
+    size_t full_blocks_count = width / factor_;
+    for (size_t x = ReduceColumnSumsVector(column_sums_.data(), factor_, block_sums_.data(), full_blocks_count);
+         x < full_blocks_count; ++x) {
+        block_sums_[x] = SumColumns(column_sums_.data() + x * factor_, factor_);
+    }
+
+    uint8_t* destination = destination_.Row(block);
+    RoundedDivisor full_block(static_cast<uint32_t>(factor_ * rows_count_));
+    for (size_t x = DivideBlockSumsVector(block_sums_.data(), full_block, destination, full_blocks_count);
+         x < full_blocks_count; ++x) {
+        destination[x] = full_block.Divide(block_sums_[x]);
+    }
+    if (full_blocks_count < block_sums_.size()) {
+        size_t last_block_width = width - full_blocks_count * factor_;
+        RoundedDivisor last_block(static_cast<uint32_t>(last_block_width * rows_count_));
+        destination[full_blocks_count] = last_block.Divide(
+                SumColumns(column_sums_.data() + full_blocks_count * factor_, last_block_width));
+    }
+
+    std::fill(column_sums_.begin(), column_sums_.end(), 0);
+    rows_count_ = 0;
+}
+
+Plane DownscalePlane(const Plane& source, size_t factor) {
+    Plane destination(GetDownscaledSize(source.width, factor), GetDownscaledSize(source.height, factor));
+    ParallelFor(destination.height, [&](size_t, size_t begin, size_t end) {
+        BoxDownscaler downscaler(source.width, source.height, factor, destination);
+        for (size_t y = begin * factor; y < std::min(end * factor, source.height); ++y) {
+            downscaler.AddRow(y, source.Row(y));
+        }
+    });
+    return destination;
+}
+
+PyramidBuilder::PyramidBuilder(size_t width, size_t height, size_t levels_count) {
+    levels_.reserve(levels_count);
+    downscalers_.reserve(levels_count);
+    for (size_t level = 0; level < levels_count; ++level) {
+        levels_.emplace_back(GetDownscaledSize(width, kPyramidFactor), GetDownscaledSize(height, kPyramidFactor));
+        downscalers_.emplace_back(width, height, kPyramidFactor, levels_.back());
+        width = levels_.back().width;
+        height = levels_.back().height;
+    }
+}
+
+void PyramidBuilder::AddRow(size_t y, const uint8_t* row) {
+    for (size_t level = 0; level < levels_.size() && downscalers_[level].AddRow(y, row); ++level) {
+        y /= kPyramidFactor;
+        row = levels_[level].Row(y);
+    }
+}
+
+std::span<Plane> PyramidBuilder::Levels() {
+    return levels_;
+}
+
+ResampleWeights ComputeBoxWeights(size_t source_size, size_t factor) {
+    size_t destination_size = GetDownscaledSize(source_size, factor);
+    ResampleWeights weights;
+    weights.stride = (factor + kResampleLanes - 1) / kResampleLanes * kResampleLanes;
+    weights.starts.resize(destination_size);
+    weights.taps_counts.resize(destination_size);
+    weights.weights.resize(destination_size * weights.stride);
+    for (size_t i = 0; i < destination_size; ++i) {
+        size_t taps_count = std::min(factor, source_size - i * factor);
+        weights.starts[i] = static_cast<uint32_t>(i * factor);
+        weights.taps_counts[i] = static_cast<uint32_t>(taps_count);
+        std::fill_n(weights.weights.begin() + static_cast<std::ptrdiff_t>(i * weights.stride), taps_count,
+                    1.0f / static_cast<float>(taps_count));
+    }
+    return weights;
+}
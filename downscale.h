@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "bmp_processing.h"
+#include "resize.h"
+
+// Column sums of a block are kept in 16 bits.
+constexpr size_t kMaxDownscaleFactor = 256;
+// Bits of a channel level, which sets how precise the reciprocals of block sizes must be.
+constexpr int kDownscaleLevelBits = 8;
+// Each level of a pyramid halves the one before.
+constexpr size_t kPyramidFactor = 2;
+
+// Blocks at the right and bottom edges may be partial, so sizes are rounded up.
+size_t GetDownscaledSize(size_t size, size_t factor);
+
+// Averages factor x factor blocks of a plane that arrives one row at a time, so the source is
+// read once and only one row of column sums is kept. Each row is added to the sums as it
+// comes, and the sums are reduced horizontally when the last row of the block arrives.
+// Partial blocks at the edges average the pixels they have.
+class BoxDownscaler {
+    size_t factor_;
+    size_t source_height_;
+    Plane& destination_;
+    std::vector<uint16_t> column_sums_;
+    std::vector<uint32_t> block_sums_;
+    size_t rows_count_ = 0;
+
+    void FinishBlock(size_t block);
+
+public:
+    BoxDownscaler(size_t source_width, size_t source_height, size_t factor, Plane& destination);
+
+    // Rows may come top to bottom or bottom to top, but the rows of a block must come
+    // together. destination must already have the downscaled size. Returns whether the row
+    // finished its block, that is whether row y / factor of destination is ready.
+    bool AddRow(size_t y, const uint8_t* row);
+};
+
+// Halves a plane that arrives one row at a time levels_count times. Every finished row of a
+// level goes straight on to the next level, so the whole pyramid takes one pass over the
+// source and no level is read back; rows may come in either order, as for BoxDownscaler.
+class PyramidBuilder {
+    std::vector<Plane> levels_;
+    std::vector<BoxDownscaler> downscalers_;
+
+public:
+    PyramidBuilder(size_t width, size_t height, size_t levels_count);
+    // The downscalers refer to levels_, whose elements stay in place when the vector moves.
+    PyramidBuilder(const PyramidBuilder&) = delete;
+    PyramidBuilder(PyramidBuilder&&) = default;
+
+    void AddRow(size_t y, const uint8_t* row);
+    // Level i is 1 / 2^(i + 1) of the source, complete once every source row was added.
+    std::span<Plane> Levels();
+};
+
+// Output rows are split into bands across threads, each with its own BoxDownscaler.
+Plane DownscalePlane(const Plane& source, size_t factor);
+
+// factor taps of 1 / factor per output position, fewer at a partial edge block, so
+// ResamplePlane averages the same blocks in another light.
+ResampleWeights ComputeBoxWeights(size_t source_size, size_t factor);
@@ -0,0 +1,82 @@
+#include "fft.h"
+
+#include <numbers>
+#include <utility>
+
+FourierTransform::FourierTransform(size_t size) : size_(size), twiddles_(size / 2), bit_reversed_(size),
+                                                  column_(size) {
+    for (size_t i = 0; i < size_ / 2; ++i) {
+        twiddles_[i] = std::polar(1.0, -2 * std::numbers::pi_v<double> * static_cast<double>(i) /
+                                       static_cast<double>(size_));
+    }
+
+    size_t bits = 0;
+    while ((static_cast<size_t>(1) << bits) < size_) {
+        ++bits;
+    }
+    for (size_t i = 0; i < size_; ++i) {
+        size_t reversed = 0;
+        for (size_t bit = 0; bit < bits; ++bit) {
+            reversed |= ((i >> bit) & 1) << (bits - 1 - bit);
+        }
+        bit_reversed_[i] = reversed;
+    }
+}
+
+size_t FourierTransform::GetSize() const {
+    return size_;
+}
+
+void FourierTransform::Transform(Complex* data, bool inverse) const {
+    for (size_t i = 0; i < size_; ++i) {
+        if (i < bit_reversed_[i]) {
+            std::swap(data[i], data[bit_reversed_[i]]);
+        }
+    }
+
+    for (size_t length = 2; length <= size_; length *= 2) {
+        size_t half = length / 2;
+        size_t twiddle_step = size_ / length;
+        for (size_t start = 0; start < size_; start += length) {
+            for (size_t i = 0; i < half; ++i) {
+                Complex twiddle = twiddles_[i * twiddle_step];
+                if (inverse) {
+                    twiddle = std::conj(twiddle);
+                }
+                Complex odd = data[start + i + half] * twiddle;
+                data[start + i + half] = data[start + i] - odd;
+                data[start + i] += odd;
+            }
+        }
+    }
+
+    if (inverse) {
+        for (size_t i = 0; i < size_; ++i) {
+            data[i] /= static_cast<double>(size_);
+        }
+    }
+}
+
+void FourierTransform::Transform2d(std::vector<Complex>& data, bool inverse) {
+    for (size_t y = 0; y < size_; ++y) {
+        Transform(data.data() + y * size_, inverse);
+    }
+
+    for (size_t x = 0; x < size_; ++x) {
+        for (size_t y = 0; y < size_; ++y) {
+            column_[y] = data[y * size_ + x];
+        }
+        Transform(column_.data(), inverse);
+        for (size_t y = 0; y < size_; ++y) {
+            data[y * size_ + x] = column_[y];
+        }
+    }
+}
+
+size_t NextPowerOfTwo(size_t value) {
+    size_t power = 1;
+    while (power < value) {
+        power *= 2;
+    }
+    return power;
+}
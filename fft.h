@@ -0,0 +1,26 @@
+#pragma once
+
+#include <complex>
+#include <vector>
+
+typedef std::complex<double> Complex;
+
+// Radix-2 transform of a fixed power-of-two size. Twiddle factors and the bit-reversal
+// permutation are computed once in the constructor and reused by every call.
+class FourierTransform {
+    size_t size_;
+    std::vector<Complex> twiddles_;
+    std::vector<size_t> bit_reversed_;
+    std::vector<Complex> column_;
+
+public:
+    explicit FourierTransform(size_t size);
+
+    size_t GetSize() const;
+
+    void Transform(Complex* data, bool inverse) const;
+    // data holds size x size values row by row.
+    void Transform2d(std::vector<Complex>& data, bool inverse);
+};
+
+size_t NextPowerOfTwo(size_t value);
@@ -1,24 +1,45 @@
 #include "filters.h"
 
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <numeric>
+
+#include "parallel.h"
+
 void BaseFilter::CheckRightParamsCount(size_t params_count) {
-    if (params_count != required_params_count_) {
+    if (params_count < required_params_count_ || params_count > maximal_params_count_) {
         throw FiltersProcessingException("wrong amount of params for filter " + std::string(filter_name_));
     }
 }
 
 BaseFilter::BaseFilter(std::string_view filter_name, size_t required_params_count,
+                       const std::vector<std::string>& params) : BaseFilter(filter_name, required_params_count,
+                                                                            required_params_count, params) {
+}
+
+BaseFilter::BaseFilter(std::string_view filter_name, size_t required_params_count, size_t maximal_params_count,
                        const std::vector<std::string>& params) : filter_name_(filter_name),
                                                                  required_params_count_(required_params_count),
+                                                                 maximal_params_count_(maximal_params_count),
                                                                  invalid_arguments_message_(
                                                                          "wrong arguments for filter " +
                                                                          std::string(filter_name_)) {
     CheckRightParamsCount(params.size());
 }
 
-size_t Crop::ParseOrThrow(const std::string& argument) {
+void BaseFilter::Configure(const ProcessingOptions& options) {
+    options_ = options;
+}
+
+std::optional<PixelLayout> BaseFilter::GetLayout() const {
+    return PixelLayout::kInterleaved;
+}
+
+size_t Crop::ParseOrThrow(const std::string& argument, bool allow_zero) {
     try {
         auto converted_argument = std::stoull(argument);
-        if (converted_argument == 0) {
+        if (converted_argument == 0 && !allow_zero) {
             throw FiltersProcessingException(invalid_arguments_message_);
         }
         return converted_argument;
@@ -27,171 +48,873 @@ size_t Crop::ParseOrThrow(const std::string& argument) {
     }
 }
 
-Crop::Crop(const std::vector<std::string>& params) : BaseFilter(kFilterCropName, kFilterCropParamsCount, params) {
+Crop::Crop(const std::vector<std::string>& params) : BaseFilter(kFilterCropName, kFilterCropMinParamsCount,
+                                                               kFilterCropMaxParamsCount, params) {
     width_ = ParseOrThrow(params[0]);
     height_  = ParseOrThrow(params[1]);
+    if (params.size() == kFilterCropMaxParamsCount) {
+        x_ = ParseOrThrow(params[2], true);
+        y_ = ParseOrThrow(params[3], true);
+    } else if (params.size() != kFilterCropMinParamsCount) {
+        throw FiltersProcessingException(invalid_arguments_message_);
+    }
 }
 
-void Crop::Apply(BMP& image) {
-    if (height_ < image.GetHeight()) {
-        image.ResizeHeight(height_);
+std::optional<PixelLayout> Crop::GetLayout() const {
+    return std::nullopt;
+}
+
+std::pair<size_t, size_t> Crop::FitRegion(const BMP& image) const {
+    if (x_ >= image.GetWidth() || y_ >= image.GetHeight()) {
+        throw FiltersProcessingException("origin of " + std::string(filter_name_) + " is outside the image");
+    }
+    // A region running past the image keeps what there is of it.
+    return {std::min(width_, image.GetWidth() - x_), std::min(height_, image.GetHeight() - y_)};
+}
+
+bool Crop::OpenCropped(BMP& image, std::string_view input_file) const {
+    ColorPlanes planes;
+    bool streamed = image.OpenStreaming(input_file, [&](size_t y, const uint8_t* red, const uint8_t* green,
+                                                        const uint8_t* blue) {
+        auto [width, height] = FitRegion(image);
+        if (y < y_ || y - y_ >= height) {
+            return;
+        }
+        if (planes[0].height == 0) {
+            for (auto& plane : planes) {
+                plane = Plane(width, height);
+            }
+        }
+        const uint8_t* rows[] = {red, green, blue};
+        for (size_t channel = 0; channel < kAmountOfPrimaryColors; ++channel) {
+            std::copy(rows[channel] + x_, rows[channel] + x_ + width, planes[channel].Row(y - y_));
+        }
+    });
+    if (!streamed) {
+        return true;
     }
+    FitRegion(image);
+    image.SetPlanes(std::move(planes));
+    return false;
+}
 
-    if (width_ < image.GetWidth()) {
-        image.ResizeWidth(width_);
+void Crop::Apply(BMP& image) {
+    auto [width, height] = FitRegion(image);
+    if (width != image.GetWidth() || height != image.GetHeight()) {
+        image.Crop(x_, y_, width, height);
     }
 }
 
-std::tuple<double, double, double> ConvertPixelToDouble(const PixelColor& pixel) {
-    double red = static_cast<double>(pixel.r) / kMaxRgb;
-    double green = static_cast<double>(pixel.g) / kMaxRgb;
-    double blue = static_cast<double>(pixel.b) / kMaxRgb;
+template <typename Accumulator>
+void DetectEdges(size_t width, size_t height, const CoefficientsMatrix& matrix, int threshold,
+                 const RowReader& read_row, Plane& edges) {
+    ConvolveRows<Accumulator>(width, height, matrix, read_row,
+                              [&edges, threshold](size_t row_number, const uint8_t* convolved) {
+                                  uint8_t* row = edges.Row(row_number);
+                                  for (size_t x = 0; x < edges.width; ++x) {
+                                      row[x] = convolved[x] > threshold ? kMaxRgb : kMinRgb;
+                                  }
+                              });
+}
 
-    return std::tie(red, green, blue);
+std::optional<PixelLayout> Grayscale::GetLayout() const {
+    return std::nullopt;
 }
 
 void Grayscale::Apply(BMP& image) {
-    for (auto& row : image.PixelMatrix()) {
-        for (auto& pixel : row) {
-            auto pixel_double = ConvertPixelToDouble(pixel);
-
-            auto new_color = static_cast<uint8_t>(std::lround(((std::get<0>(pixel_double) * kRedToGray +
-                                                                std::get<1>(pixel_double) * kGreenToGray +
-                                                                std::get<2>(pixel_double) * kBlueToGray) *
-                                                               kMaxRgb)));
-            pixel.r = pixel.g = pixel.b = new_color;
-        }
-    }
-}
-
-void Negative::Apply(BMP& image) {
-    for (auto& row : image.PixelMatrix()) {
-        for (auto& pixel : row) {
-            pixel.r = kMaxRgb - pixel.r;
-            pixel.g = kMaxRgb - pixel.g;
-            pixel.b = kMaxRgb - pixel.b;
-        }
-    }
-}
-
-PixelColor MatrixFilter::CalculatePixel(const PixelMatrix& pixels, size_t pos_y, size_t pos_x, size_t matrix_size) {
-    double red = kMinRgb;
-    double green = kMinRgb;
-    double blue = kMinRgb;
-    auto radius = static_cast<long long>((matrix_size - 1) / 2);
-    size_t y, x;
-
-    for (auto y_diff = -radius; y_diff <= radius; ++y_diff) {
-        for (auto x_diff = -radius; x_diff <= radius; ++x_diff) {
-            if ((pos_x + x_diff == 0 || pos_x + x_diff > pixels[0].size()) &&
-                (pos_y + y_diff == 0 || pos_y + y_diff > pixels.size())) {
-                y = pos_y - 1;
-                x = pos_x - 1;
-            } else if (pos_x + x_diff == 0 || pos_x + x_diff > pixels[0].size()) {
-                y = pos_y + y_diff - 1;
-                x = pos_x - 1;
-            } else if (pos_y + y_diff == 0 || pos_y + y_diff > pixels.size()) {
-                y = pos_y - 1;
-                x = pos_x + x_diff - 1;
-            } else {
-                y = pos_y + y_diff - 1;
-                x = pos_x + x_diff - 1;
+    image.SetLayout(PixelLayout::kGray);
+}
+
+std::optional<PixelLayout> LutFilter::GetLayout() const {
+    return std::nullopt;
+}
+
+void LutFilter::Apply(BMP& image) {
+    ApplyLut(BuildLut(), image);
+}
+
+ColorLut Negative::BuildLut() const {
+    return MakeUniformLut(TabulateChannel([](int level) { return kMaxRgb - level; }));
+}
+
+void Gamma::ParseOrThrow(const std::string& argument) {
+    try {
+        gamma_ = std::stod(argument);
+        if (!std::isfinite(gamma_) || gamma_ <= 0) {
+            throw FiltersProcessingException(invalid_arguments_message_);
+        }
+    } catch (std::logic_error& e) {
+        throw FiltersProcessingException(invalid_arguments_message_);
+    }
+}
+
+Gamma::Gamma(const std::vector<std::string>& params) : LutFilter(kFilterGammaName, kFilterGammaParamsCount, params) {
+    ParseOrThrow(params[0]);
+}
+
+ColorLut Gamma::BuildLut() const {
+    return MakeUniformLut(TabulateChannel([this](int level) {
+        return std::pow(static_cast<double>(level) / kMaxRgb, 1 / gamma_) * kMaxRgb;
+    }));
+}
+
+int Levels::ParseOrThrow(const std::string& argument) {
+    try {
+        auto level = std::stoi(argument);
+        if (level < kMinRgb || level > kMaxRgb) {
+            throw FiltersProcessingException(invalid_arguments_message_);
+        }
+        return level;
+    } catch (std::logic_error& e) {
+        throw FiltersProcessingException(invalid_arguments_message_);
+    }
+}
+
+Levels::Levels(const std::vector<std::string>& params) : LutFilter(kFilterLevelsName, kFilterLevelsParamsCount,
+                                                                   params) {
+    input_low_ = ParseOrThrow(params[0]);
+    input_high_ = ParseOrThrow(params[1]);
+    output_low_ = ParseOrThrow(params[2]);
+    output_high_ = ParseOrThrow(params[3]);
+    if (input_low_ >= input_high_) {
+        throw FiltersProcessingException(invalid_arguments_message_);
+    }
+}
+
+ColorLut Levels::BuildLut() const {
+    return MakeUniformLut(TabulateChannel([this](int level) {
+        double position = static_cast<double>(std::clamp(level, input_low_, input_high_) - input_low_) /
+                          (input_high_ - input_low_);
+        return output_low_ + position * (output_high_ - output_low_);
+    }));
+}
+
+void Curve::ReadOrThrow(const std::string& path) {
+    std::ifstream in(path);
+    if (!in.is_open()) {
+        throw FileProcessingException("can not open for reading " + path);
+    }
+
+    int input = 0;
+    int output = 0;
+    while (in >> input >> output) {
+        if (input < kMinRgb || input > kMaxRgb || output < kMinRgb || output > kMaxRgb ||
+            (!points_.empty() && input <= points_.back().first)) {
+            throw FiltersProcessingException(invalid_arguments_message_);
+        }
+        points_.emplace_back(input, output);
+    }
+    if (!in.eof() || points_.size() < kMinimalCurvePointsCount) {
+        throw FiltersProcessingException(invalid_arguments_message_);
+    }
+}
+
+Curve::Curve(const std::vector<std::string>& params) : LutFilter(kFilterCurveName, kFilterCurveParamsCount, params) {
+    ReadOrThrow(params[0]);
+}
+
+ColorLut Curve::BuildLut() const {
+    return MakeUniformLut(TabulateChannel([this](int level) {
+        if (level <= points_.front().first) {
+            return static_cast<double>(points_.front().second);
+        }
+        auto next = std::lower_bound(points_.begin(), points_.end(), std::make_pair(level, kMinRgb));
+        if (next == points_.end()) {
+            return static_cast<double>(points_.back().second);
+        }
+        auto previous = std::prev(next);
+        double position = static_cast<double>(level - previous->first) / (next->first - previous->first);
+        return previous->second + position * (next->second - previous->second);
+    }));
+}
+
+void Brightness::ParseOrThrow(const std::string& argument) {
+    try {
+        delta_ = std::stoi(argument);
+        if (delta_ < -kMaxRgb || delta_ > kMaxRgb) {
+            throw FiltersProcessingException(invalid_arguments_message_);
+        }
+    } catch (std::logic_error& e) {
+        throw FiltersProcessingException(invalid_arguments_message_);
+    }
+}
+
+Brightness::Brightness(const std::vector<std::string>& params) : LutFilter(kFilterBrightnessName,
+                                                                           kFilterBrightnessParamsCount, params) {
+    ParseOrThrow(params[0]);
+}
+
+ColorLut Brightness::BuildLut() const {
+    return MakeUniformLut(TabulateChannel([this](int level) { return level + delta_; }));
+}
+
+void Contrast::ParseOrThrow(const std::string& argument) {
+    try {
+        factor_ = std::stod(argument);
+        if (!std::isfinite(factor_) || factor_ < 0) {
+            throw FiltersProcessingException(invalid_arguments_message_);
+        }
+    } catch (std::logic_error& e) {
+        throw FiltersProcessingException(invalid_arguments_message_);
+    }
+}
+
+Contrast::Contrast(const std::vector<std::string>& params) : LutFilter(kFilterContrastName,
+                                                                       kFilterContrastParamsCount, params) {
+    ParseOrThrow(params[0]);
+}
+
+ColorLut Contrast::BuildLut() const {
+    return MakeUniformLut(TabulateChannel([this](int level) {
+        return (level - kContrastPivot) * factor_ + kContrastPivot;
+    }));
+}
+
+Lut3d::Lut3d(const std::vector<std::string>& params) : BaseFilter(kFilterLut3dName, kFilterLut3dParamsCount, params) {
+    lut_ = GetCubeLut(params[0]);
+}
+
+void Lut3d::Apply(BMP& image) {
+    ApplyCubeLut(*lut_, image.PixelMatrix());
+}
+
+double ColorMatrixFilter::ParseOrThrow(const std::string& argument) {
+    try {
+        auto value = std::stod(argument);
+        if (!std::isfinite(value)) {
+            throw FiltersProcessingException(invalid_arguments_message_);
+        }
+        return value;
+    } catch (std::logic_error& e) {
+        throw FiltersProcessingException(invalid_arguments_message_);
+    }
+}
+
+ColorMatrixFilter::ColorMatrixFilter(const std::vector<std::string>& params) : BaseFilter(
+        kFilterColorMatrixName, kFilterColorMatrixMinParamsCount, kFilterColorMatrixMaxParamsCount, params) {
+    if (params.size() == kFilterColorMatrixMinParamsCount && params[0] == kColorMatrixSepiaName) {
+        matrix_ = kSepiaColorMatrix;
+    } else if (params.size() == kFilterColorMatrixMinParamsCount && params[0] == kColorMatrixSwapName) {
+        matrix_ = kChannelSwapColorMatrix;
+    } else if (params.size() == kFilterColorMatrixMinParamsCount && params[0] == kColorMatrixLumaName) {
+        matrix_ = kLumaColorMatrix;
+    } else if (params.size() == kFilterColorMatrixSaturationParamsCount &&
+               params[0] == kColorMatrixSaturationName) {
+        auto saturation = ParseOrThrow(params[1]);
+        if (saturation < 0) {
+            throw FiltersProcessingException(invalid_arguments_message_);
+        }
+        matrix_ = MakeSaturationColorMatrix(saturation);
+    } else if (params.size() == kFilterColorMatrixMaxParamsCount) {
+        for (size_t channel = 0; channel < kAmountOfPrimaryColors; ++channel) {
+            for (size_t column = 0; column < kColorMatrixColumns; ++column) {
+                matrix_[channel][column] = ParseOrThrow(params[channel * kColorMatrixColumns + column]);
             }
+        }
+    } else {
+        throw FiltersProcessingException(invalid_arguments_message_);
+    }
+}
+
+ColorMatrixFilter::ColorMatrixFilter(const ColorMatrix& matrix) : BaseFilter(kFilterColorMatrixName,
+                                                                             kComposedColorMatrixParamsCount, {}),
+                                                                  matrix_(matrix) {
+}
+
+const ColorMatrix& ColorMatrixFilter::GetMatrix() const {
+    return matrix_;
+}
+
+void ColorMatrixFilter::Apply(BMP& image) {
+    ApplyColorMatrix(matrix_, image.PixelMatrix());
+}
 
-            auto pixel_double = ConvertPixelToDouble(pixels[y][x]);
-            red += std::get<0>(pixel_double) * matrix_[y_diff + radius][x_diff + radius];
-            green += std::get<1>(pixel_double) * matrix_[y_diff + radius][x_diff + radius];
-            blue += std::get<2>(pixel_double) * matrix_[y_diff + radius][x_diff + radius];
+Equalize::Equalize(const std::vector<std::string>& params) : BaseFilter(kFilterEqualizeName,
+                                                                       kFilterEqualizeMinParamsCount,
+                                                                       kFilterEqualizeMaxParamsCount, params) {
+    if (!params.empty()) {
+        if (params[0] == kEqualizeChannelsName) {
+            per_channel_ = true;
+        } else if (params[0] != kEqualizeGlobalName) {
+            throw FiltersProcessingException(invalid_arguments_message_);
         }
     }
+}
 
-    PixelColor new_pixel;
-    new_pixel.r = std::clamp(static_cast<int>(std::lround(red * kMaxRgb)), kMinRgb, kMaxRgb);
-    new_pixel.g = std::clamp(static_cast<int>(std::lround(green * kMaxRgb)), kMinRgb, kMaxRgb);
-    new_pixel.b = std::clamp(static_cast<int>(std::lround(blue * kMaxRgb)), kMinRgb, kMaxRgb);
-    return new_pixel;
+std::optional<PixelLayout> Equalize::GetLayout() const {
+    return std::nullopt;
 }
 
-void Sharpening::Apply(BMP& image) {
-    const PixelMatrix read_only_pixels = image.PixelMatrix();
-    for (auto row_number = image.GetHeight(); row_number > 0; --row_number) {
-        for (auto col_number = image.GetWidth(); col_number > 0; --col_number) {
-            image.PixelMatrix()[row_number - 1][col_number - 1] = CalculatePixel(read_only_pixels, row_number,
-                                                                                 col_number);
+void Equalize::Apply(BMP& image) {
+    ColorHistogram histogram = ComputeHistogram(image);
+    ColorLut lut;
+    if (per_channel_) {
+        for (size_t channel = 0; channel < kAmountOfPrimaryColors; ++channel) {
+            lut.channels[channel] = MakeEqualizationLut(histogram.channels[channel]);
         }
+    } else {
+        lut = MakeUniformLut(MakeEqualizationLut(PoolChannels(histogram)));
     }
+    ApplyLut(lut, image);
 }
 
-void EdgeDetection::ParseOrThrow(const std::string& argument) {
+void AutoLevels::ParseOrThrow(const std::string& argument) {
     try {
-        threshold_ = std::stoi(argument);
-        if (threshold_ > kMaxRgb) {
+        auto clip_percent = std::stod(argument);
+        if (!std::isfinite(clip_percent) || clip_percent < 0 || clip_percent >= kAutoLevelsMaxClipPercent) {
             throw FiltersProcessingException(invalid_arguments_message_);
         }
+        clip_fraction_ = clip_percent / kPercentsInWhole;
     } catch (std::logic_error& e) {
         throw FiltersProcessingException(invalid_arguments_message_);
     }
 }
 
-EdgeDetection::EdgeDetection(const std::vector<std::string>& params) : BaseFilter(kFilterEdgeDetectionName,
-                                                                                  kFilterEdgeDetectionParamsCount,
-                                                                                  params),
-                                                                       MatrixFilter(kFilterEdgeDetectionMatrix) {
+AutoLevels::AutoLevels(const std::vector<std::string>& params) : BaseFilter(kFilterAutoLevelsName,
+                                                                           kFilterAutoLevelsMinParamsCount,
+                                                                           kFilterAutoLevelsMaxParamsCount,
+                                                                           params) {
+    if (!params.empty()) {
+        ParseOrThrow(params[0]);
+    }
+}
+
+std::optional<PixelLayout> AutoLevels::GetLayout() const {
+    return std::nullopt;
+}
+
+void AutoLevels::Apply(BMP& image) {
+    ColorHistogram histogram = ComputeHistogram(image,
+                                                GetStatisticsStep(image.GetHeight(), image.GetWidth()));
+    ColorLut lut;
+    for (size_t channel = 0; channel < kAmountOfPrimaryColors; ++channel) {
+        int low = FindPercentile(histogram.channels[channel], clip_fraction_);
+        int high = FindPercentile(histogram.channels[channel], 1 - clip_fraction_);
+        lut.channels[channel] = TabulateChannel([low, high](int level) {
+            if (high <= low) {
+                return static_cast<double>(level);
+            }
+            return static_cast<double>(level - low) / (high - low) * kMaxRgb;
+        });
+    }
+    ApplyLut(lut, image);
+}
+
+std::optional<PixelLayout> AutoWhiteBalance::GetLayout() const {
+    return std::nullopt;
+}
+
+void AutoWhiteBalance::Apply(BMP& image) {
+    ColorHistogram histogram = ComputeHistogram(image,
+                                                GetStatisticsStep(image.GetHeight(), image.GetWidth()));
+    std::array<double, kAmountOfPrimaryColors> means{};
+    for (size_t channel = 0; channel < kAmountOfPrimaryColors; ++channel) {
+        means[channel] = FindMean(histogram.channels[channel]);
+    }
+    double gray = (means[0] + means[1] + means[2]) / kAmountOfPrimaryColors;
+
+    ColorLut lut;
+    for (size_t channel = 0; channel < kAmountOfPrimaryColors; ++channel) {
+        double scale = means[channel] > 0 ? gray / means[channel] : 1;
+        lut.channels[channel] = TabulateChannel([scale](int level) { return level * scale; });
+    }
+    ApplyLut(lut, image);
+}
+
+void Quantize::ParseOrThrow(const std::string& argument) {
+    try {
+        auto colors_count = std::stoi(argument);
+        if (colors_count < static_cast<int>(kQuantizeMinColorsCount) || colors_count > static_cast<int>(kPaletteSize)) {
+            throw FiltersProcessingException(invalid_arguments_message_);
+        }
+        colors_count_ = static_cast<size_t>(colors_count);
+    } catch (std::logic_error& e) {
+        throw FiltersProcessingException(invalid_arguments_message_);
+    }
+}
+
+Quantize::Quantize(const std::vector<std::string>& params) : BaseFilter(kFilterQuantizeName,
+                                                                       kFilterQuantizeParamsCount, params) {
     ParseOrThrow(params[0]);
 }
 
-void EdgeDetection::Apply(BMP& image) {
-    Grayscale({}).Apply(image);
-
-    const PixelMatrix read_only_pixels = image.PixelMatrix();
-    for (auto row_number = image.GetHeight(); row_number > 0; --row_number) {
-        for (auto col_number = image.GetWidth(); col_number > 0; --col_number) {
-            if (CalculatePixel(read_only_pixels, row_number, col_number).r > threshold_) {
-                image.PixelMatrix()[row_number - 1][col_number - 1] = {kMaxRgb, kMaxRgb, kMaxRgb};
-            } else {
-                image.PixelMatrix()[row_number - 1][col_number - 1] = {kMinRgb, kMinRgb, kMinRgb};
+void Quantize::Apply(BMP& image) {
+    const PixelMatrix& pixels = image.PixelMatrix();
+    Palette palette = BuildPalette(pixels, colors_count_);
+    Plane indices = DitherToPalette(pixels, palette, InverseColorMap(palette));
+    image.SetIndexed(std::move(indices), std::move(palette));
+}
+
+size_t Resize::ParseOrThrow(const std::string& argument) {
+    try {
+        auto converted_argument = std::stoull(argument);
+        if (converted_argument == 0 || converted_argument > std::numeric_limits<Llong>::max()) {
+            throw FiltersProcessingException(invalid_arguments_message_);
+        }
+        return converted_argument;
+    } catch (std::logic_error& e) {
+        throw FiltersProcessingException(invalid_arguments_message_);
+    }
+}
+
+Resize::Resize(const std::vector<std::string>& params) : BaseFilter(kFilterResizeName, kFilterResizeMinParamsCount,
+                                                                   kFilterResizeMaxParamsCount, params) {
+    width_ = ParseOrThrow(params[0]);
+    height_ = ParseOrThrow(params[1]);
+    if (params.size() == kFilterResizeMaxParamsCount) {
+        if (params[2] == kResizeNearestName) {
+            filter_ = ResizeFilter::kNearest;
+        } else if (params[2] == kResizeBilinearName) {
+            filter_ = ResizeFilter::kBilinear;
+        } else if (params[2] == kResizeBicubicName) {
+            filter_ = ResizeFilter::kBicubic;
+        } else if (params[2] == kResizeLanczos3Name) {
+            filter_ = ResizeFilter::kLanczos3;
+        } else {
+            throw FiltersProcessingException(invalid_arguments_message_);
+        }
+    }
+}
+
+std::optional<PixelLayout> Resize::GetLayout() const {
+    return PixelLayout::kPlanar;
+}
+
+void Resize::Apply(BMP& image) {
+    ResampleWeights horizontal = ComputeResampleWeights(image.GetWidth(), width_, filter_);
+    ResampleWeights vertical = ComputeResampleWeights(image.GetHeight(), height_, filter_);
+    for (auto& plane : image.Planes()) {
+        Plane resized;
+        ResamplePlane(plane, resized, horizontal, vertical, options_.light);
+        plane = std::move(resized);
+    }
+    // The planes already have the new size, so this only updates the size of the image.
+    image.ResizeHeight(height_);
+    image.ResizeWidth(width_);
+}
+
+void Downscale::ParseOrThrow(const std::string& argument) {
+    try {
+        auto factor = std::stoi(argument);
+        if (factor < 1 || factor > static_cast<int>(kMaxDownscaleFactor)) {
+            throw FiltersProcessingException(invalid_arguments_message_);
+        }
+        factor_ = static_cast<size_t>(factor);
+    } catch (std::logic_error& e) {
+        throw FiltersProcessingException(invalid_arguments_message_);
+    }
+}
+
+Downscale::Downscale(const std::vector<std::string>& params) : BaseFilter(kFilterDownscaleName,
+                                                                         kFilterDownscaleParamsCount, params) {
+    ParseOrThrow(params[0]);
+}
+
+bool Downscale::OpenDownscaled(BMP& image, std::string_view input_file) const {
+    if (options_.light != LightMode::kEncoded) {
+        image.Open(input_file);
+        return true;
+    }
+
+    ColorPlanes planes;
+    std::vector<BoxDownscaler> downscalers;
+    bool streamed = image.OpenStreaming(input_file, [&](size_t y, const uint8_t* red, const uint8_t* green,
+                                                        const uint8_t* blue) {
+        if (downscalers.empty()) {
+            for (auto& plane : planes) {
+                plane = Plane(GetDownscaledSize(image.GetWidth(), factor_),
+                              GetDownscaledSize(image.GetHeight(), factor_));
+                downscalers.emplace_back(image.GetWidth(), image.GetHeight(), factor_, plane);
             }
         }
+        downscalers[0].AddRow(y, red);
+        downscalers[1].AddRow(y, green);
+        downscalers[2].AddRow(y, blue);
+    });
+    if (!streamed) {
+        return true;
+    }
+    if (downscalers.empty()) {
+        for (auto& plane : planes) {
+            plane = Plane(GetDownscaledSize(image.GetWidth(), factor_), 0);
+        }
+    }
+    image.SetPlanes(std::move(planes));
+    return false;
+}
+
+std::optional<PixelLayout> Downscale::GetLayout() const {
+    return PixelLayout::kPlanar;
+}
+
+void Downscale::Apply(BMP& image) {
+    size_t width = GetDownscaledSize(image.GetWidth(), factor_);
+    size_t height = GetDownscaledSize(image.GetHeight(), factor_);
+    if (options_.light == LightMode::kEncoded) {
+        for (auto& plane : image.Planes()) {
+            plane = DownscalePlane(plane, factor_);
+        }
+    } else {
+        ResampleWeights horizontal = ComputeBoxWeights(image.GetWidth(), factor_);
+        ResampleWeights vertical = ComputeBoxWeights(image.GetHeight(), factor_);
+        for (auto& plane : image.Planes()) {
+            Plane downscaled;
+            ResamplePlane(plane, downscaled, horizontal, vertical, options_.light);
+            plane = std::move(downscaled);
+        }
+    }
+    // The planes already have the new size, so this only updates the size of the image.
+    image.ResizeHeight(height);
+    image.ResizeWidth(width);
+}
+
+// Filters that only move pixels work on the indices of an indexed image and keep its palette.
+std::span<Plane> GetPlanesToMove(BMP& image) {
+    return image.GetLayout() == PixelLayout::kIndexed ? image.ActivePlanes() : image.Planes();
+}
+
+void ApplyRotation(BMP& image, Rotation rotation) {
+    for (auto& plane : GetPlanesToMove(image)) {
+        Plane rotated;
+        RotatePlane(plane, rotated, rotation);
+        plane = std::move(rotated);
+    }
+    // The planes already have the new size, so this only updates the size of the image.
+    if (rotation != Rotation::kRotate180) {
+        size_t width = image.GetWidth();
+        image.ResizeWidth(image.GetHeight());
+        image.ResizeHeight(width);
+        image.SwapResolutions();
+    }
+}
+
+Rotate::Rotate(const std::vector<std::string>& params) : BaseFilter(kFilterRotateName, kFilterRotateParamsCount,
+                                                                   params) {
+    if (params[0] == "90") {
+        rotation_ = Rotation::kRotate90;
+    } else if (params[0] == "180") {
+        rotation_ = Rotation::kRotate180;
+    } else if (params[0] == "270") {
+        rotation_ = Rotation::kRotate270;
+    } else {
+        throw FiltersProcessingException(invalid_arguments_message_);
+    }
+}
+
+std::optional<PixelLayout> Rotate::GetLayout() const {
+    return std::nullopt;
+}
+
+void Rotate::Apply(BMP& image) {
+    ApplyRotation(image, rotation_);
+}
+
+Transpose::Transpose(const std::vector<std::string>& params) : BaseFilter(kFilterTransposeName,
+                                                                         kFilterTransposeParamsCount, params) {
+}
+
+std::optional<PixelLayout> Transpose::GetLayout() const {
+    return std::nullopt;
+}
+
+void Transpose::Apply(BMP& image) {
+    ApplyRotation(image, Rotation::kTranspose);
+}
+
+FlipVertical::FlipVertical(const std::vector<std::string>& params) : BaseFilter(kFilterFlipVerticalName,
+                                                                               kFilterFlipVerticalParamsCount,
+                                                                               params) {
+}
+
+std::optional<PixelLayout> FlipVertical::GetLayout() const {
+    return std::nullopt;
+}
+
+void FlipVertical::Apply(BMP& image) {
+    image.FlipRows();
+}
+
+FlipHorizontal::FlipHorizontal(const std::vector<std::string>& params) : BaseFilter(kFilterFlipHorizontalName,
+                                                                                   kFilterFlipHorizontalParamsCount,
+                                                                                   params) {
+}
+
+std::optional<PixelLayout> FlipHorizontal::GetLayout() const {
+    return std::nullopt;
+}
+
+void FlipHorizontal::Apply(BMP& image) {
+    for (auto& plane : GetPlanesToMove(image)) {
+        FlipPlaneColumns(plane);
+    }
+}
+
+void ApplyWarp(BMP& image, const AffineMatrix& to_source, LightMode light) {
+    std::span<Plane> planes = image.Planes();
+    std::vector<Plane> warped(planes.size(), Plane(image.GetWidth(), image.GetHeight()));
+    WarpPlanes(planes, warped, to_source, light);
+    std::move(warped.begin(), warped.end(), planes.begin());
+}
+
+double Affine::ParseOrThrow(const std::string& argument) {
+    try {
+        auto value = std::stod(argument);
+        if (!std::isfinite(value)) {
+            throw FiltersProcessingException(invalid_arguments_message_);
+        }
+        return value;
+    } catch (std::logic_error& e) {
+        throw FiltersProcessingException(invalid_arguments_message_);
+    }
+}
+
+Affine::Affine(const std::vector<std::string>& params) : BaseFilter(kFilterAffineName, kFilterAffineParamsCount,
+                                                                   params) {
+    AffineMatrix to_destination;
+    for (size_t row = 0; row < to_destination.size(); ++row) {
+        for (size_t column = 0; column < kAffineMatrixColumns; ++column) {
+            to_destination[row][column] = ParseOrThrow(params[row * kAffineMatrixColumns + column]);
+        }
+    }
+    auto to_source = InvertAffineMatrix(to_destination);
+    if (!to_source) {
+        throw FiltersProcessingException(invalid_arguments_message_);
     }
+    to_source_ = *to_source;
+}
+
+std::optional<PixelLayout> Affine::GetLayout() const {
+    return PixelLayout::kPlanar;
 }
 
-void GaussianBlur::CalculateGaussianMatrix() {
-    int size = std::max(kMinimumGaussianBlurMatrixSize,
-                        static_cast<int>(std::lround((kMatrixSizeDependenceOnSigma * sigma_))));
-    if (size % 2 == 0) {
-        --size;
+void Affine::Apply(BMP& image) {
+    ApplyWarp(image, to_source_, options_.light);
+}
+
+void RotateDegrees::ParseOrThrow(const std::string& argument) {
+    try {
+        degrees_ = std::stod(argument);
+        if (!std::isfinite(degrees_)) {
+            throw FiltersProcessingException(invalid_arguments_message_);
+        }
+    } catch (std::logic_error& e) {
+        throw FiltersProcessingException(invalid_arguments_message_);
     }
-    matrix_.resize(size);
+}
 
-    double matrix_center = static_cast<double>(size) / 2;
-    double distance_y;
-    double distance_x;
-    double sigma_coefficient = kSigmaMultiplier * sigma_ * sigma_;
-    double sum = 0;
+RotateDegrees::RotateDegrees(const std::vector<std::string>& params) : BaseFilter(kFilterRotateDegreesName,
+                                                                                 kFilterRotateDegreesParamsCount,
+                                                                                 params) {
+    ParseOrThrow(params[0]);
+}
 
-    for (auto y = 0; y < size; ++y) {
-        distance_y = matrix_center - y;
-        matrix_[y].resize(size);
+std::optional<PixelLayout> RotateDegrees::GetLayout() const {
+    return PixelLayout::kPlanar;
+}
 
-        for (auto x = 0; x < size; ++x) {
-            distance_x = matrix_center - x;
+void RotateDegrees::Apply(BMP& image) {
+    // A rotation is never singular.
+    ApplyWarp(image, *InvertAffineMatrix(MakeRotationAffineMatrix(degrees_, image.GetWidth(), image.GetHeight())),
+              options_.light);
+}
 
-            matrix_[y][x] = exp(-(distance_y * distance_y + distance_x * distance_x) / sigma_coefficient) /
-                            (std::numbers::pi_v<double> * sigma_coefficient);
-            sum += matrix_[y][x];
+double Remap::ParseOrThrow(const std::string& argument) {
+    try {
+        auto value = std::stod(argument);
+        if (!std::isfinite(value)) {
+            throw FiltersProcessingException(invalid_arguments_message_);
         }
+        return value;
+    } catch (std::logic_error& e) {
+        throw FiltersProcessingException(invalid_arguments_message_);
     }
+}
 
-    for (auto y = 0; y < size; ++y) {
-        for (auto x = 0; x < size; ++x) {
-            matrix_[y][x] /= sum;
+Remap::Remap(const std::vector<std::string>& params) : BaseFilter(kFilterRemapName, kFilterRemapMinParamsCount,
+                                                                 kFilterRemapMaxParamsCount, params) {
+    size_t coefficients_count = params.size() - 1;
+    if (params[0] == kRemapLensName) {
+        model_.kind = RemapKind::kLens;
+        if (coefficients_count > kLensMaxCoefficientsCount) {
+            throw FiltersProcessingException(invalid_arguments_message_);
         }
+    } else if (params[0] == kRemapPerspectiveName) {
+        model_.kind = RemapKind::kPerspective;
+        if (coefficients_count != kPerspectiveCoefficientsCount) {
+            throw FiltersProcessingException(invalid_arguments_message_);
+        }
+    } else {
+        throw FiltersProcessingException(invalid_arguments_message_);
+    }
+    for (size_t index = 1; index < params.size(); ++index) {
+        model_.coefficients.push_back(ParseOrThrow(params[index]));
+    }
+
+    if (model_.kind == RemapKind::kPerspective && !InvertHomography(MakeHomography(model_.coefficients))) {
+        throw FiltersProcessingException(invalid_arguments_message_);
+    }
+}
+
+std::optional<PixelLayout> Remap::GetLayout() const {
+    return PixelLayout::kPlanar;
+}
+
+void Remap::Apply(BMP& image) {
+    auto map = GetRemapMap(model_, image.GetWidth(), image.GetHeight(), options_.remap_cache_directory);
+    std::span<Plane> planes = image.Planes();
+    std::vector<Plane> remapped(planes.size(), Plane(image.GetWidth(), image.GetHeight()));
+    RemapPlanes(planes, remapped, *map, options_.light);
+    std::move(remapped.begin(), remapped.end(), planes.begin());
+}
+
+size_t Pixelate::ParseOrThrow(const std::string& argument, bool allow_zero) {
+    try {
+        if (argument.starts_with('-')) {
+            throw FiltersProcessingException(invalid_arguments_message_);
+        }
+        auto converted_argument = std::stoull(argument);
+        if (converted_argument == 0 && !allow_zero) {
+            throw FiltersProcessingException(invalid_arguments_message_);
+        }
+        return converted_argument;
+    } catch (std::logic_error& e) {
+        throw FiltersProcessingException(invalid_arguments_message_);
+    }
+}
+
+Pixelate::Pixelate(const std::vector<std::string>& params) : BaseFilter(kFilterPixelateName,
+                                                                       kFilterPixelateMinParamsCount,
+                                                                       kFilterPixelateMaxParamsCount, params) {
+    size_ = ParseOrThrow(params[0]);
+    if (params.size() == kFilterPixelateMaxParamsCount) {
+        x_ = ParseOrThrow(params[1], true);
+        y_ = ParseOrThrow(params[2], true);
+        width_ = ParseOrThrow(params[3]);
+        height_ = ParseOrThrow(params[4]);
+    } else if (params.size() != kFilterPixelateMinParamsCount) {
+        throw FiltersProcessingException(invalid_arguments_message_);
+    }
+}
+
+std::optional<PixelLayout> Pixelate::GetLayout() const {
+    return PixelLayout::kPlanar;
+}
+
+// Block rows are split across threads; each block is one BoxMean and a fill.
+template <typename Sum>
+void PixelatePlane(Plane& plane, size_t x, size_t y, size_t width, size_t height, size_t size) {
+    IntegralImage<Sum> integral(plane, x, y, width, height);
+    ParallelFor((height + size - 1) / size, [&](size_t, size_t begin, size_t end) {
+        for (size_t block_y = begin * size; block_y < std::min(end * size, height); block_y += size) {
+            size_t block_height = std::min(size, height - block_y);
+            for (size_t block_x = 0; block_x < width; block_x += size) {
+                size_t block_width = std::min(size, width - block_x);
+                uint8_t mean = integral.BoxMean(block_x, block_y, block_width, block_height);
+                for (size_t row = block_y; row < block_y + block_height; ++row) {
+                    std::memset(plane.Row(y + row) + x + block_x, mean, block_width);
+                }
+            }
+        }
+    });
+}
+
+void Pixelate::Apply(BMP& image) {
+    if (x_ >= image.GetWidth() || y_ >= image.GetHeight()) {
+        throw FiltersProcessingException("rectangle of " + std::string(filter_name_) + " is outside the image");
+    }
+    size_t width = std::min(width_, image.GetWidth() - x_);
+    size_t height = std::min(height_, image.GetHeight() - y_);
+    size_t size = std::min(size_, std::max(width, height));
+    for (auto& plane : image.Planes()) {
+        if (size * size <= kMaxIntegral32BoxPixelsCount) {
+            PixelatePlane<uint32_t>(plane, x_, y_, width, height, size);
+        } else {
+            PixelatePlane<uint64_t>(plane, x_, y_, width, height, size);
+        }
+    }
+}
+
+ColorLut ComposedLut::BuildLut() const {
+    return lut_;
+}
+
+void MatrixFilter::ApplyMatrix(BMP& image, Precision precision, LightMode light) {
+    for (auto& plane : image.Planes()) {
+        Plane convolved;
+        if (precision == Precision::kDouble) {
+            Convolve<double>(plane, convolved, matrix_, light);
+        } else {
+            Convolve<float>(plane, convolved, matrix_, light);
+        }
+        plane = std::move(convolved);
+    }
+}
+
+std::optional<PixelLayout> Sharpening::GetLayout() const {
+    return PixelLayout::kPlanar;
+}
+
+void Sharpening::Apply(BMP& image) {
+    ApplyMatrix(image, options_.precision, options_.light);
+}
+
+void EdgeDetection::ParseOrThrow(const std::string& argument) {
+    try {
+        threshold_ = std::stoi(argument);
+        if (threshold_ > kMaxRgb) {
+            throw FiltersProcessingException(invalid_arguments_message_);
+        }
+    } catch (std::logic_error& e) {
+        throw FiltersProcessingException(invalid_arguments_message_);
+    }
+}
+
+EdgeDetection::EdgeDetection(const std::vector<std::string>& params) : BaseFilter(kFilterEdgeDetectionName,
+                                                                                  kFilterEdgeDetectionParamsCount,
+                                                                                  params),
+                                                                       MatrixFilter(kFilterEdgeDetectionMatrix) {
+    ParseOrThrow(params[0]);
+}
+
+std::optional<PixelLayout> EdgeDetection::GetLayout() const {
+    return std::nullopt;
+}
+
+// Luma of a colour image is computed one row at a time as the convolution asks for it, into a
+// fresh gray plane. A gray image is thresholded straight back into its plane: rows are
+// overwritten only after the last read of them. Neither a gray nor a convolved copy of the
+// image is ever built.
+void EdgeDetection::Apply(BMP& image) {
+    size_t width = image.GetWidth();
+    size_t height = image.GetHeight();
+    bool gray = image.GetLayout() == PixelLayout::kGray;
+    Plane edges = gray ? Plane() : Plane(width, height);
+    Plane& destination = gray ? image.ActivePlanes()[0] : edges;
+    std::vector<PixelColor> merged(width);
+    std::vector<uint8_t> luma(width);
+    RowReader read_row = [&](size_t row_number) -> const uint8_t* {
+        if (gray) {
+            return static_cast<const Plane&>(destination).Row(row_number);
+        }
+        image.ReadGrayRow(row_number, luma.data(), merged);
+        return luma.data();
+    };
+    if (options_.precision == Precision::kDouble) {
+        DetectEdges<double>(width, height, matrix_, threshold_, read_row, destination);
+    } else {
+        DetectEdges<float>(width, height, matrix_, threshold_, read_row, destination);
+    }
+    if (!gray) {
+        image.SetGray(std::move(edges));
     }
 }
 
 void GaussianBlur::ParseOrThrow(const std::string& argument) {
     try {
         sigma_ = std::stod(argument);
+        if (!std::isfinite(sigma_) || sigma_ < kMinGaussianSigma) {
+            throw FiltersProcessingException(invalid_arguments_message_);
+        }
     } catch (std::logic_error& e) {
         throw FiltersProcessingException(invalid_arguments_message_);
     }
@@ -201,16 +924,26 @@ GaussianBlur::GaussianBlur(const std::vector<std::string>& params) : BaseFilter(
                                                                                 kFilterGaussianBlurParamsCount,
                                                                                 params) {
     ParseOrThrow(params[0]);
-    CalculateGaussianMatrix();
+}
+
+std::optional<PixelLayout> GaussianBlur::GetLayout() const {
+    return PixelLayout::kPlanar;
 }
 
 void GaussianBlur::Apply(BMP& image) {
-    const PixelMatrix read_only_pixels = image.PixelMatrix();
-    for (auto row_number = image.GetHeight(); row_number > 0; --row_number) {
-        for (auto col_number = image.GetWidth(); col_number > 0; --col_number) {
-            image.PixelMatrix()[row_number - 1][col_number - 1] = CalculatePixel(read_only_pixels, row_number,
-                                                                                 col_number, matrix_.size());
-        }
+    if (options_.precision == Precision::kDouble) {
+        // The reference path convolves with the full matrix, as the README formula states;
+        // wide kernels go through Convolve's FFT path like any other large matrix.
+        matrix_ = GetGaussianKernel<double>(sigma_)->matrix;
+        ApplyMatrix(image, Precision::kDouble, options_.light);
+        return;
+    }
+
+    auto gaussian = GetGaussianKernel<float>(sigma_);
+    for (auto& plane : image.Planes()) {
+        Plane blurred;
+        ConvolveSeparable(plane, blurred, gaussian->kernel, gaussian->kernel, options_.light);
+        plane = std::move(blurred);
     }
 }
 
@@ -226,9 +959,63 @@ void Shuffle::ParseOrThrow(const std::string& argument) {
     }
 }
 
-Shuffle::Shuffle(const std::vector<std::string>& params) : BaseFilter(kFilterShuffleName,
-                                                                      kFilterShuffleParamsCount, params) {
+void Shuffle::ParseSeedOrThrow(const std::string& argument) {
+    try {
+        if (argument.starts_with('-')) {
+            throw FiltersProcessingException(invalid_arguments_message_);
+        }
+        seed_ = std::stoull(argument);
+    } catch (std::logic_error& e) {
+        throw FiltersProcessingException(invalid_arguments_message_);
+    }
+}
+
+Shuffle::Shuffle(const std::vector<std::string>& params) : BaseFilter(kFilterShuffleName, kFilterShuffleMinParamsCount,
+                                                                     kFilterShuffleMaxParamsCount, params) {
     ParseOrThrow(params[0]);
+    if (params.size() == kFilterShuffleMaxParamsCount) {
+        ParseSeedOrThrow(params[1]);
+    }
+}
+
+// Fisher-Yates with rejection sampling over std::mt19937_64, whose output the standard fixes,
+// unlike std::shuffle and std::uniform_int_distribution, so a seed gives the same order
+// with any standard library.
+std::vector<size_t> MakePermutation(size_t count, uint64_t seed) {
+    std::vector<size_t> permutation(count);
+    std::iota(permutation.begin(), permutation.end(), 0);
+    std::mt19937_64 generator(seed);
+    for (size_t i = count; i > 1; --i) {
+        uint64_t limit = std::numeric_limits<uint64_t>::max() - std::numeric_limits<uint64_t>::max() % i;
+        uint64_t value = generator();
+        while (value >= limit) {
+            value = generator();
+        }
+        std::swap(permutation[i - 1], permutation[value % i]);
+    }
+    return permutation;
+}
+
+// Destination piece i is source piece permutation[i]; bytes_per_pixel scales columns to bytes.
+template <typename GetRow, typename GetDestinationRow>
+void GatherPieces(const std::vector<size_t>& permutation, size_t pieces_on_one_side, size_t piece_width,
+                  size_t piece_height, size_t bytes_per_pixel, GetRow source_row, GetDestinationRow destination_row) {
+    ParallelFor(permutation.size(), [&](size_t, size_t begin, size_t end) {
+        for (size_t piece = begin; piece < end; ++piece) {
+            size_t source_x = permutation[piece] % pieces_on_one_side * piece_width;
+            size_t source_y = permutation[piece] / pieces_on_one_side * piece_height;
+            size_t destination_x = piece % pieces_on_one_side * piece_width;
+            size_t destination_y = piece / pieces_on_one_side * piece_height;
+            for (size_t y = 0; y < piece_height; ++y) {
+                std::memcpy(destination_row(destination_y + y) + destination_x * bytes_per_pixel,
+                            source_row(source_y + y) + source_x * bytes_per_pixel, piece_width * bytes_per_pixel);
+            }
+        }
+    });
+}
+
+std::optional<PixelLayout> Shuffle::GetLayout() const {
+    return std::nullopt;
 }
 
 void Shuffle::Apply(BMP& image) {
@@ -236,37 +1023,30 @@ void Shuffle::Apply(BMP& image) {
         return;
     }
 
-    Crop({std::to_string(image.GetHeight() - image.GetHeight() % pieces_on_one_side_),
-          std::to_string(image.GetWidth() - image.GetWidth() % pieces_on_one_side_)}).Apply(image);
-
     size_t piece_height = image.GetHeight() / pieces_on_one_side_;
     size_t piece_width = image.GetWidth() / pieces_on_one_side_;
+    size_t height = piece_height * pieces_on_one_side_;
+    size_t width = piece_width * pieces_on_one_side_;
+    std::vector<size_t> permutation = MakePermutation(pieces_count_, seed_);
 
-    std::vector<std::tuple<size_t, size_t>> pieces_starts;
-    for (size_t pos_y = 0; pos_y < image.GetHeight(); pos_y += piece_height) {
-        for (size_t pos_x = 0; pos_x < image.GetWidth(); pos_x += piece_width) {
-            pieces_starts.emplace_back(std::tie(pos_y, pos_x));
-        }
-    }
-    std::shuffle(pieces_starts.begin(), pieces_starts.end(), std::random_device());
-
-    for (auto piece_number = 0; piece_number < pieces_count_; piece_number += kAmountOfSwappingPieces) {
-        if (pieces_count_ - piece_number < kAmountOfSwappingPieces) {
-            break;
-        }
-
-        size_t first_piece_y = std::get<0>(pieces_starts[piece_number]);
-        size_t first_piece_x = std::get<1>(pieces_starts[piece_number]);
-        size_t second_piece_y = std::get<0>(pieces_starts[piece_number + 1]);
-        size_t second_piece_x = std::get<1>(pieces_starts[piece_number + 1]);
-
-        for (auto y_range = 0; y_range < piece_height; ++y_range) {
-            for (auto x_range = 0; x_range < piece_width; ++x_range) {
-                auto tmp = image.PixelMatrix()[first_piece_y + y_range][first_piece_x + x_range];
-                image.PixelMatrix()[first_piece_y + y_range][first_piece_x + x_range] =
-                        image.PixelMatrix()[second_piece_y + y_range][second_piece_x + x_range];
-                image.PixelMatrix()[second_piece_y + y_range][second_piece_x + x_range] = tmp;
-            }
+    if (image.GetLayout() == PixelLayout::kInterleaved) {
+        const PixelMatrix& source = image.PixelMatrix();
+        PixelMatrix shuffled(height, std::vector<PixelColor>(width));
+        GatherPieces(
+                permutation, pieces_on_one_side_, piece_width, piece_height, sizeof(PixelColor),
+                [&source](size_t y) { return reinterpret_cast<const Byte*>(source[y].data()); },
+                [&shuffled](size_t y) { return reinterpret_cast<Byte*>(shuffled[y].data()); });
+        image.PixelMatrix() = std::move(shuffled);
+    } else {
+        for (auto& plane : GetPlanesToMove(image)) {
+            Plane shuffled(width, height);
+            GatherPieces(
+                    permutation, pieces_on_one_side_, piece_width, piece_height, 1,
+                    [&plane](size_t y) { return static_cast<const Plane&>(plane).Row(y); },
+                    [&shuffled](size_t y) { return shuffled.Row(y); });
+            plane = std::move(shuffled);
         }
     }
+    image.ResizeHeight(height);
+    image.ResizeWidth(width);
 }
@@ -1,14 +1,28 @@
 #pragma once
 
 #include <algorithm>
+#include <utility>
 #include <cmath>
 #include <numbers>
+#include <optional>
 #include <random>
 
 #include "bmp_processing.h"
+#include "color_matrix.h"
+#include "convolution.h"
+#include "cube_lut.h"
+#include "downscale.h"
 #include "exceptions.h"
-
-typedef std::vector<std::vector<double>> CoefficientsMatrix;
+#include "gaussian.h"
+#include "grayscale.h"
+#include "histogram.h"
+#include "integral.h"
+#include "lut.h"
+#include "quantize.h"
+#include "resize.h"
+#include "remap.h"
+#include "rotate.h"
+#include "warp.h"
 
 constexpr std::string_view kFilterCropName = "-crop";
 constexpr std::string_view kFilterGrayscaleName = "-gs";
@@ -17,54 +31,158 @@ constexpr std::string_view kFilterSharpeningName = "-sharp";
 constexpr std::string_view kFilterEdgeDetectionName = "-edge";
 constexpr std::string_view kFilterGaussianBlurName = "-blur";
 constexpr std::string_view kFilterShuffleName = "-shuffle";
-
-constexpr size_t kFilterCropParamsCount = 2;
+constexpr std::string_view kFilterGammaName = "-gamma";
+constexpr std::string_view kFilterLevelsName = "-levels";
+constexpr std::string_view kFilterCurveName = "-curve";
+constexpr std::string_view kFilterBrightnessName = "-brightness";
+constexpr std::string_view kFilterContrastName = "-contrast";
+constexpr std::string_view kFilterLut3dName = "-lut3d";
+constexpr std::string_view kFilterColorMatrixName = "-colormatrix";
+constexpr std::string_view kFilterEqualizeName = "-equalize";
+constexpr std::string_view kFilterAutoLevelsName = "-autolevels";
+constexpr std::string_view kFilterAutoWhiteBalanceName = "-autowb";
+constexpr std::string_view kFilterQuantizeName = "-quantize";
+constexpr std::string_view kFilterResizeName = "-resize";
+constexpr std::string_view kFilterDownscaleName = "-downscale";
+constexpr std::string_view kFilterRotateName = "-rotate";
+constexpr std::string_view kFilterTransposeName = "-transpose";
+constexpr std::string_view kFilterFlipVerticalName = "-flipv";
+constexpr std::string_view kFilterFlipHorizontalName = "-fliph";
+constexpr std::string_view kFilterAffineName = "-affine";
+constexpr std::string_view kFilterRotateDegreesName = "-rotate-deg";
+constexpr std::string_view kFilterRemapName = "-remap";
+constexpr std::string_view kFilterPixelateName = "-pixelate";
+constexpr std::string_view kComposedLutName = "composed lookup table";
+
+constexpr size_t kFilterCropMinParamsCount = 2;
+// Width and height, then the origin.
+constexpr size_t kFilterCropMaxParamsCount = 4;
 constexpr size_t kFilterGrayscaleParamsCount = 0;
 constexpr size_t kFilterNegativeParamsCount = 0;
 constexpr size_t kFilterSharpeningParamsCount = 0;
 constexpr size_t kFilterEdgeDetectionParamsCount = 1;
 constexpr size_t kFilterGaussianBlurParamsCount = 1;
-constexpr size_t kFilterShuffleParamsCount = 1;
-
-constexpr double kRedToGray = 0.299;
-constexpr double kGreenToGray = 0.587;
-constexpr double kBlueToGray = 0.114;
+constexpr size_t kFilterShuffleMinParamsCount = 1;
+constexpr size_t kFilterShuffleMaxParamsCount = 2;
+constexpr size_t kFilterGammaParamsCount = 1;
+constexpr size_t kFilterLevelsParamsCount = 4;
+constexpr size_t kFilterCurveParamsCount = 1;
+constexpr size_t kFilterBrightnessParamsCount = 1;
+constexpr size_t kFilterContrastParamsCount = 1;
+constexpr size_t kFilterLut3dParamsCount = 1;
+constexpr size_t kFilterColorMatrixMinParamsCount = 1;
+constexpr size_t kFilterColorMatrixSaturationParamsCount = 2;
+constexpr size_t kFilterColorMatrixMaxParamsCount = kAmountOfPrimaryColors * kColorMatrixColumns;
+constexpr size_t kFilterEqualizeMinParamsCount = 0;
+constexpr size_t kFilterEqualizeMaxParamsCount = 1;
+constexpr size_t kFilterAutoLevelsMinParamsCount = 0;
+constexpr size_t kFilterAutoLevelsMaxParamsCount = 1;
+constexpr size_t kFilterAutoWhiteBalanceParamsCount = 0;
+constexpr size_t kFilterQuantizeParamsCount = 1;
+constexpr size_t kFilterResizeMinParamsCount = 2;
+constexpr size_t kFilterResizeMaxParamsCount = 3;
+constexpr size_t kFilterDownscaleParamsCount = 1;
+constexpr size_t kFilterRotateParamsCount = 1;
+constexpr size_t kFilterTransposeParamsCount = 0;
+constexpr size_t kFilterFlipVerticalParamsCount = 0;
+constexpr size_t kFilterFlipHorizontalParamsCount = 0;
+constexpr size_t kFilterAffineParamsCount = 2 * kAffineMatrixColumns;
+constexpr size_t kFilterRotateDegreesParamsCount = 1;
+// A model name followed by its coefficients.
+constexpr size_t kFilterRemapMinParamsCount = 1 + kLensMinCoefficientsCount;
+constexpr size_t kFilterRemapMaxParamsCount = 1 + kPerspectiveCoefficientsCount;
+// The block size, then optionally the rectangle as x y width height.
+constexpr size_t kFilterPixelateMinParamsCount = 1;
+constexpr size_t kFilterPixelateMaxParamsCount = 5;
+constexpr size_t kComposedLutParamsCount = 0;
+constexpr size_t kComposedColorMatrixParamsCount = 0;
+
+constexpr double kContrastPivot = kMaxRgb / 2.0;
+constexpr size_t kMinimalCurvePointsCount = 2;
+
+constexpr std::string_view kColorMatrixSepiaName = "sepia";
+constexpr std::string_view kColorMatrixSwapName = "swap";
+constexpr std::string_view kColorMatrixLumaName = "luma";
+constexpr std::string_view kColorMatrixSaturationName = "saturation";
+
+constexpr std::string_view kEqualizeGlobalName = "global";
+constexpr std::string_view kEqualizeChannelsName = "channels";
+
+constexpr double kAutoLevelsDefaultClipPercent = 0.5;
+constexpr double kAutoLevelsMaxClipPercent = 50;
+constexpr double kPercentsInWhole = 100;
+
+constexpr size_t kQuantizeMinColorsCount = 2;
 
 const CoefficientsMatrix kFilterSharpeningMatrix = {{0, -1, 0}, {-1, 5, -1}, {0, -1, 0}};
 const CoefficientsMatrix kFilterEdgeDetectionMatrix = {{0, -1, 0}, {-1, 4, -1}, {0, -1, 0}};
 
-constexpr double kMatrixSizeDependenceOnSigma = 3.0;
-constexpr int kMinimumGaussianBlurMatrixSize = 5;
-constexpr double kSigmaMultiplier = 2.0;
-
-constexpr size_t kAmountOfSwappingPieces = 2;
+// Seed of -shuffle when none is given, so the same image is always shuffled the same way.
+constexpr uint64_t kShuffleDefaultSeed = 0;
+
+struct ProcessingOptions {
+    Precision precision = Precision::kFloat;
+    // Light that convolution filters average, see LightMode.
+    LightMode light = LightMode::kEncoded;
+    // 0 means one thread per hardware thread.
+    size_t threads = 0;
+    // Bits per pixel BMP::Save uses for gray images.
+    Word gray_bits_per_pixel = kRequiredBitsPerPixel;
+    // Halved levels written next to the output, see ProcessImage.
+    size_t pyramid_levels = 0;
+    // Where Remap keeps its maps between runs; empty keeps them in memory only.
+    std::string remap_cache_directory;
+};
 
 class BaseFilter {
 protected:
     std::string_view filter_name_;
     size_t required_params_count_;
+    size_t maximal_params_count_;
     std::string invalid_arguments_message_;
+    ProcessingOptions options_;
 
     void CheckRightParamsCount(size_t params_count);
 
 public:
     explicit BaseFilter(std::string_view filter_name, size_t required_params_count,
                         const std::vector<std::string>& params);
+    // For filters with optional params: accepts from required to maximal params.
+    explicit BaseFilter(std::string_view filter_name, size_t required_params_count, size_t maximal_params_count,
+                        const std::vector<std::string>& params);
+
+    void Configure(const ProcessingOptions& options);
+
+    // Layout the image is converted to before Apply; nullopt if the filter works on any.
+    // Filters asking for kPlanar treat all planes alike, so they also get gray images as is.
+    virtual std::optional<PixelLayout> GetLayout() const;
 
     virtual void Apply(BMP& image) = 0;
 
     virtual ~BaseFilter() = default;
 };
 
+// Keeps a region from (x, y), the top left corner by default, as a view into the buffers of
+// a planar, gray or indexed image, so no pixel is copied until some stage needs its own buffer.
 class Crop : public BaseFilter {
     size_t width_;
     size_t height_;
+    size_t x_ = 0;
+    size_t y_ = 0;
 
-    size_t ParseOrThrow(const std::string& argument);
+    size_t ParseOrThrow(const std::string& argument, bool allow_zero = false);
+    // Size of the region inside image; throws if its origin lies outside.
+    std::pair<size_t, size_t> FitRegion(const BMP& image) const;
 
 public:
     explicit Crop(const std::vector<std::string>& params);
 
+    // Opens input_file into image and, for a 24-bit image, keeps only the rows and columns of
+    // the region while decoding, into planes. Returns whether Apply is still needed.
+    bool OpenCropped(BMP& image, std::string_view input_file) const;
+
+    std::optional<PixelLayout> GetLayout() const final;
+
     void Apply(BMP& image) final;
 };
 
@@ -73,17 +191,162 @@ public:
     explicit Grayscale(const std::vector<std::string>& params) : BaseFilter(kFilterGrayscaleName,
                                                                             kFilterGrayscaleParamsCount, params) {};
 
+    std::optional<PixelLayout> GetLayout() const final;
+
+    // Leaves the image in PixelLayout::kGray.
     void Apply(BMP& image) final;
 };
 
-class Negative : public BaseFilter {
+// Filters that map every channel level independently. They only describe their table, so
+// PlanFilters can compose a run of them into a single pass.
+class LutFilter : public BaseFilter {
 public:
-    explicit Negative(const std::vector<std::string>& params) : BaseFilter(kFilterNegativeName,
-                                                                           kFilterNegativeParamsCount, params) {};
+    using BaseFilter::BaseFilter;
+
+    virtual ColorLut BuildLut() const = 0;
+
+    std::optional<PixelLayout> GetLayout() const final;
 
     void Apply(BMP& image) final;
 };
 
+class Negative : public LutFilter {
+public:
+    explicit Negative(const std::vector<std::string>& params) : LutFilter(kFilterNegativeName,
+                                                                          kFilterNegativeParamsCount, params) {};
+
+    ColorLut BuildLut() const final;
+};
+
+class Gamma : public LutFilter {
+    double gamma_{};
+
+    void ParseOrThrow(const std::string& argument);
+
+public:
+    explicit Gamma(const std::vector<std::string>& params);
+
+    ColorLut BuildLut() const final;
+};
+
+class Levels : public LutFilter {
+    int input_low_{};
+    int input_high_{};
+    int output_low_{};
+    int output_high_{};
+
+    int ParseOrThrow(const std::string& argument);
+
+public:
+    explicit Levels(const std::vector<std::string>& params);
+
+    ColorLut BuildLut() const final;
+};
+
+class Curve : public LutFilter {
+    std::vector<std::pair<int, int>> points_;
+
+    void ReadOrThrow(const std::string& path);
+
+public:
+    explicit Curve(const std::vector<std::string>& params);
+
+    ColorLut BuildLut() const final;
+};
+
+class Brightness : public LutFilter {
+    int delta_{};
+
+    void ParseOrThrow(const std::string& argument);
+
+public:
+    explicit Brightness(const std::vector<std::string>& params);
+
+    ColorLut BuildLut() const final;
+};
+
+class Contrast : public LutFilter {
+    double factor_{};
+
+    void ParseOrThrow(const std::string& argument);
+
+public:
+    explicit Contrast(const std::vector<std::string>& params);
+
+    ColorLut BuildLut() const final;
+};
+
+class Lut3d : public BaseFilter {
+    std::shared_ptr<const CubeLut> lut_;
+
+public:
+    explicit Lut3d(const std::vector<std::string>& params);
+
+    void Apply(BMP& image) final;
+};
+
+class ColorMatrixFilter : public BaseFilter {
+    ColorMatrix matrix_{};
+
+    double ParseOrThrow(const std::string& argument);
+
+public:
+    explicit ColorMatrixFilter(const std::vector<std::string>& params);
+    explicit ColorMatrixFilter(const ColorMatrix& matrix);
+
+    const ColorMatrix& GetMatrix() const;
+
+    void Apply(BMP& image) final;
+};
+
+// The table depends on the image, so unlike LutFilters it is built in Apply and never composed.
+class Equalize : public BaseFilter {
+    bool per_channel_ = false;
+
+public:
+    explicit Equalize(const std::vector<std::string>& params);
+
+    std::optional<PixelLayout> GetLayout() const final;
+
+    void Apply(BMP& image) final;
+};
+
+// Stretches each channel so that clip percent of its samples fall below 0 and above 255.
+// Percentiles come from a subsampled histogram, see GetStatisticsStep.
+class AutoLevels : public BaseFilter {
+    double clip_fraction_ = kAutoLevelsDefaultClipPercent / kPercentsInWhole;
+
+    void ParseOrThrow(const std::string& argument);
+
+public:
+    explicit AutoLevels(const std::vector<std::string>& params);
+
+    std::optional<PixelLayout> GetLayout() const final;
+
+    void Apply(BMP& image) final;
+};
+
+// Gray world: scales each channel so that its mean matches the mean of all three.
+class AutoWhiteBalance : public BaseFilter {
+public:
+    explicit AutoWhiteBalance(const std::vector<std::string>& params) : BaseFilter(
+            kFilterAutoWhiteBalanceName, kFilterAutoWhiteBalanceParamsCount, params) {};
+
+    std::optional<PixelLayout> GetLayout() const final;
+
+    void Apply(BMP& image) final;
+};
+
+class ComposedLut : public LutFilter {
+    ColorLut lut_;
+
+public:
+    explicit ComposedLut(const ColorLut& lut) : LutFilter(kComposedLutName, kComposedLutParamsCount, {}),
+                                                lut_(lut) {};
+
+    ColorLut BuildLut() const final;
+};
+
 class MatrixFilter {
 protected:
     CoefficientsMatrix matrix_;
@@ -91,7 +354,7 @@ protected:
     MatrixFilter() = default;
     explicit MatrixFilter(CoefficientsMatrix matrix) : matrix_(std::move(matrix)) {};
 
-    PixelColor CalculatePixel(const PixelMatrix& pixels, size_t pos_x, size_t pos_y, size_t matrix_size = 3);
+    void ApplyMatrix(BMP& image, Precision precision, LightMode light);
 };
 
 class Sharpening : public BaseFilter, protected MatrixFilter {
@@ -100,6 +363,8 @@ public:
                                                                              kFilterSharpeningParamsCount, params),
                                                                   MatrixFilter(kFilterSharpeningMatrix) {};
 
+    std::optional<PixelLayout> GetLayout() const final;
+
     void Apply(BMP& image) final;
 };
 
@@ -111,6 +376,9 @@ class EdgeDetection : public BaseFilter, protected MatrixFilter {
 public:
     explicit EdgeDetection(const std::vector<std::string>& params);
 
+    std::optional<PixelLayout> GetLayout() const final;
+
+    // Leaves the image in PixelLayout::kGray.
     void Apply(BMP& image) final;
 };
 
@@ -118,22 +386,184 @@ class GaussianBlur : public BaseFilter, protected MatrixFilter {
     double sigma_{};
 
     void ParseOrThrow(const std::string& argument);
-    void CalculateGaussianMatrix();
 
 public:
     explicit GaussianBlur(const std::vector<std::string>& params);
 
+    std::optional<PixelLayout> GetLayout() const final;
+
+    void Apply(BMP& image) final;
+};
+
+// Reduces the image to a palette of at most the given number of colours with dithering.
+class Quantize : public BaseFilter {
+    size_t colors_count_{};
+
+    void ParseOrThrow(const std::string& argument);
+
+public:
+    explicit Quantize(const std::vector<std::string>& params);
+
+    // Leaves the image in PixelLayout::kIndexed.
+    void Apply(BMP& image) final;
+};
+
+// Resamples the image to exactly the given width and height.
+class Resize : public BaseFilter {
+    size_t width_{};
+    size_t height_{};
+    ResizeFilter filter_ = ResizeFilter::kBicubic;
+
+    size_t ParseOrThrow(const std::string& argument);
+
+public:
+    explicit Resize(const std::vector<std::string>& params);
+
+    std::optional<PixelLayout> GetLayout() const final;
+
+    void Apply(BMP& image) final;
+};
+
+// Shrinks the image by an integer factor, averaging every factor x factor block into a pixel.
+class Downscale : public BaseFilter {
+    size_t factor_{};
+
+    void ParseOrThrow(const std::string& argument);
+
+public:
+    explicit Downscale(const std::vector<std::string>& params);
+
+    // Opens input_file into image and, for a 24-bit image in encoded light, downscales it
+    // while decoding, so no full-resolution row is kept. Returns whether Apply is still needed.
+    bool OpenDownscaled(BMP& image, std::string_view input_file) const;
+
+    std::optional<PixelLayout> GetLayout() const final;
+
+    void Apply(BMP& image) final;
+};
+
+// Rotates the image clockwise by 90, 180 or 270 degrees.
+class Rotate : public BaseFilter {
+    Rotation rotation_ = Rotation::kRotate90;
+
+public:
+    explicit Rotate(const std::vector<std::string>& params);
+
+    std::optional<PixelLayout> GetLayout() const final;
+
+    void Apply(BMP& image) final;
+};
+
+// Mirrors the image about its main diagonal, swapping rows and columns.
+class Transpose : public BaseFilter {
+public:
+    explicit Transpose(const std::vector<std::string>& params);
+
+    std::optional<PixelLayout> GetLayout() const final;
+
+    void Apply(BMP& image) final;
+};
+
+// Turns the image upside down in any layout without moving pixels, see BMP::FlipRows.
+class FlipVertical : public BaseFilter {
+public:
+    explicit FlipVertical(const std::vector<std::string>& params);
+
+    std::optional<PixelLayout> GetLayout() const final;
+
+    void Apply(BMP& image) final;
+};
+
+// Mirrors the image left to right.
+class FlipHorizontal : public BaseFilter {
+public:
+    explicit FlipHorizontal(const std::vector<std::string>& params);
+
+    std::optional<PixelLayout> GetLayout() const final;
+
     void Apply(BMP& image) final;
 };
 
+// Moves pixel (x, y) to (a x + b y + c, d x + e y + f) for parameters a b c d e f, keeping the
+// size of the image; pixels nothing maps to are black.
+class Affine : public BaseFilter {
+    AffineMatrix to_source_ = kIdentityAffineMatrix;
+
+    double ParseOrThrow(const std::string& argument);
+
+public:
+    explicit Affine(const std::vector<std::string>& params);
+
+    std::optional<PixelLayout> GetLayout() const final;
+
+    void Apply(BMP& image) final;
+};
+
+// Rotates the image clockwise by any angle in degrees about its centre, keeping its size.
+class RotateDegrees : public BaseFilter {
+    double degrees_{};
+
+    void ParseOrThrow(const std::string& argument);
+
+public:
+    explicit RotateDegrees(const std::vector<std::string>& params);
+
+    std::optional<PixelLayout> GetLayout() const final;
+
+    void Apply(BMP& image) final;
+};
+
+// Corrects lens distortion or perspective with a per-pixel map of source coordinates, see
+// RemapModel. The map depends only on the model and the image size, so it is built once,
+// by GetRemapMap, for every image of the same camera.
+class Remap : public BaseFilter {
+    RemapModel model_;
+
+    double ParseOrThrow(const std::string& argument);
+
+public:
+    explicit Remap(const std::vector<std::string>& params);
+
+    std::optional<PixelLayout> GetLayout() const final;
+
+    void Apply(BMP& image) final;
+};
+
+// Replaces size x size blocks of a rectangle, the whole image by default, with their means;
+// blocks start at the corner of the rectangle and are cut short at its far edges. Means come
+// from an IntegralImage of the rectangle, so they cost the same for any block size.
+class Pixelate : public BaseFilter {
+    size_t size_{};
+    size_t x_ = 0;
+    size_t y_ = 0;
+    size_t width_ = std::numeric_limits<size_t>::max();
+    size_t height_ = std::numeric_limits<size_t>::max();
+
+    size_t ParseOrThrow(const std::string& argument, bool allow_zero = false);
+
+public:
+    explicit Pixelate(const std::vector<std::string>& params);
+
+    std::optional<PixelLayout> GetLayout() const final;
+
+    void Apply(BMP& image) final;
+};
+
+// Cuts the image into a square grid of pieces and puts them back in an order drawn from seed.
+// Each destination piece is copied row by row from its source piece, the pieces split across
+// threads; rows left over at the right and bottom edges are dropped.
 class Shuffle : public BaseFilter {
     size_t pieces_on_one_side_{};
     size_t pieces_count_{};
+    uint64_t seed_ = kShuffleDefaultSeed;
 
     void ParseOrThrow(const std::string& argument);
+    void ParseSeedOrThrow(const std::string& argument);
 
 public:
     explicit Shuffle(const std::vector<std::string>& params);
 
+    std::optional<PixelLayout> GetLayout() const final;
+
     void Apply(BMP& image) final;
 };
@@ -1,5 +1,12 @@
 #include "filters_processing.h"
 
+#include <filesystem>
+#include <optional>
+#include <span>
+
+#include "downscale.h"
+#include "parallel.h"
+
 FiltersList GetFilter(const std::string& filter_name) {
     if (filter_name == kFilterCropName) {
         return FiltersList::kCrop;
@@ -15,11 +22,167 @@ FiltersList GetFilter(const std::string& filter_name) {
         return FiltersList::kGaussianBlur;
     } else if (filter_name == kFilterShuffleName) {
         return FiltersList::kShuffle;
+    } else if (filter_name == kFilterGammaName) {
+        return FiltersList::kGamma;
+    } else if (filter_name == kFilterLevelsName) {
+        return FiltersList::kLevels;
+    } else if (filter_name == kFilterCurveName) {
+        return FiltersList::kCurve;
+    } else if (filter_name == kFilterBrightnessName) {
+        return FiltersList::kBrightness;
+    } else if (filter_name == kFilterContrastName) {
+        return FiltersList::kContrast;
+    } else if (filter_name == kFilterLut3dName) {
+        return FiltersList::kLut3d;
+    } else if (filter_name == kFilterColorMatrixName) {
+        return FiltersList::kColorMatrix;
+    } else if (filter_name == kFilterEqualizeName) {
+        return FiltersList::kEqualize;
+    } else if (filter_name == kFilterAutoLevelsName) {
+        return FiltersList::kAutoLevels;
+    } else if (filter_name == kFilterAutoWhiteBalanceName) {
+        return FiltersList::kAutoWhiteBalance;
+    } else if (filter_name == kFilterQuantizeName) {
+        return FiltersList::kQuantize;
+    } else if (filter_name == kFilterResizeName) {
+        return FiltersList::kResize;
+    } else if (filter_name == kFilterDownscaleName) {
+        return FiltersList::kDownscale;
+    } else if (filter_name == kFilterRotateName) {
+        return FiltersList::kRotate;
+    } else if (filter_name == kFilterTransposeName) {
+        return FiltersList::kTranspose;
+    } else if (filter_name == kFilterFlipVerticalName) {
+        return FiltersList::kFlipVertical;
+    } else if (filter_name == kFilterFlipHorizontalName) {
+        return FiltersList::kFlipHorizontal;
+    } else if (filter_name == kFilterAffineName) {
+        return FiltersList::kAffine;
+    } else if (filter_name == kFilterRotateDegreesName) {
+        return FiltersList::kRotateDegrees;
+    } else if (filter_name == kFilterRemapName) {
+        return FiltersList::kRemap;
+    } else if (filter_name == kFilterPixelateName) {
+        return FiltersList::kPixelate;
     }
     return FiltersList::kNone;
 }
 
-void ApplyFilters(const std::vector<Filter>& filters, BMP& image) {
+OptionsList GetOption(const std::string& option_name) {
+    if (option_name == kOptionPrecisionName) {
+        return OptionsList::kPrecision;
+    } else if (option_name == kOptionThreadsName) {
+        return OptionsList::kThreads;
+    } else if (option_name == kOptionGrayBitsName) {
+        return OptionsList::kGrayBits;
+    } else if (option_name == kOptionLinearName) {
+        return OptionsList::kLinear;
+    } else if (option_name == kOptionPyramidName) {
+        return OptionsList::kPyramid;
+    } else if (option_name == kOptionRemapCacheName) {
+        return OptionsList::kRemapCache;
+    }
+    return OptionsList::kNone;
+}
+
+Precision ParsePrecision(const Option& option) {
+    if (option.option_params.size() == kOptionPrecisionParamsCount) {
+        if (option.option_params[0] == kPrecisionFloatName) {
+            return Precision::kFloat;
+        } else if (option.option_params[0] == kPrecisionDoubleName) {
+            return Precision::kDouble;
+        }
+    }
+    throw ParserException("wrong arguments for option " + option.option_name);
+}
+
+size_t ParseThreads(const Option& option) {
+    std::string invalid_arguments_message = "wrong arguments for option " + option.option_name;
+    if (option.option_params.size() != kOptionThreadsParamsCount) {
+        throw ParserException(invalid_arguments_message);
+    }
+    try {
+        auto threads = std::stoll(option.option_params[0]);
+        if (threads <= 0) {
+            throw ParserException(invalid_arguments_message);
+        }
+        return static_cast<size_t>(threads);
+    } catch (std::logic_error& e) {
+        throw ParserException(invalid_arguments_message);
+    }
+}
+
+Word ParseGrayBits(const Option& option) {
+    if (option.option_params.size() == kOptionGrayBitsParamsCount) {
+        if (option.option_params[0] == std::to_string(kPalettedBitsPerPixel)) {
+            return kPalettedBitsPerPixel;
+        } else if (option.option_params[0] == std::to_string(kRequiredBitsPerPixel)) {
+            return kRequiredBitsPerPixel;
+        }
+    }
+    throw ParserException("wrong arguments for option " + option.option_name);
+}
+
+size_t ParsePyramidLevels(const Option& option) {
+    std::string invalid_arguments_message = "wrong arguments for option " + option.option_name;
+    if (option.option_params.size() != kOptionPyramidParamsCount) {
+        throw ParserException(invalid_arguments_message);
+    }
+    try {
+        auto levels = std::stoll(option.option_params[0]);
+        if (levels <= 0 || static_cast<size_t>(levels) > kMaxPyramidLevels) {
+            throw ParserException(invalid_arguments_message);
+        }
+        return static_cast<size_t>(levels);
+    } catch (std::logic_error& e) {
+        throw ParserException(invalid_arguments_message);
+    }
+}
+
+ProcessingOptions GetProcessingOptions(const std::vector<Option>& options) {
+    ProcessingOptions processing_options;
+
+    for (const auto& option : options) {
+        switch (GetOption(option.option_name)) {
+            case OptionsList::kPrecision: {
+                processing_options.precision = ParsePrecision(option);
+                continue;
+            }
+            case OptionsList::kThreads: {
+                processing_options.threads = ParseThreads(option);
+                continue;
+            }
+            case OptionsList::kGrayBits: {
+                processing_options.gray_bits_per_pixel = ParseGrayBits(option);
+                continue;
+            }
+            case OptionsList::kLinear: {
+                if (option.option_params.size() != kOptionLinearParamsCount) {
+                    throw ParserException("wrong arguments for option " + option.option_name);
+                }
+                processing_options.light = LightMode::kLinear;
+                continue;
+            }
+            case OptionsList::kPyramid: {
+                processing_options.pyramid_levels = ParsePyramidLevels(option);
+                continue;
+            }
+            case OptionsList::kRemapCache: {
+                if (option.option_params.size() != kOptionRemapCacheParamsCount) {
+                    throw ParserException("wrong arguments for option " + option.option_name);
+                }
+                processing_options.remap_cache_directory = option.option_params[0];
+                continue;
+            }
+            default:
+                throw ParserException(option.option_name + " is not valid option name");
+        }
+    }
+
+    return processing_options;
+}
+
+std::vector<std::shared_ptr<BaseFilter>> CreateFilters(const std::vector<Filter>& filters) {
     std::vector<std::shared_ptr<BaseFilter>> requested_filters;
 
     for (const auto& filter : filters) {
@@ -52,12 +215,268 @@ void ApplyFilters(const std::vector<Filter>& filters, BMP& image) {
                 requested_filters.push_back(std::make_shared<Shuffle>(filter.filter_params));
                 continue;
             }
+            case FiltersList::kGamma: {
+                requested_filters.push_back(std::make_shared<Gamma>(filter.filter_params));
+                continue;
+            }
+            case FiltersList::kLevels: {
+                requested_filters.push_back(std::make_shared<Levels>(filter.filter_params));
+                continue;
+            }
+            case FiltersList::kCurve: {
+                requested_filters.push_back(std::make_shared<Curve>(filter.filter_params));
+                continue;
+            }
+            case FiltersList::kBrightness: {
+                requested_filters.push_back(std::make_shared<Brightness>(filter.filter_params));
+                continue;
+            }
+            case FiltersList::kContrast: {
+                requested_filters.push_back(std::make_shared<Contrast>(filter.filter_params));
+                continue;
+            }
+            case FiltersList::kLut3d: {
+                requested_filters.push_back(std::make_shared<Lut3d>(filter.filter_params));
+                continue;
+            }
+            case FiltersList::kColorMatrix: {
+                requested_filters.push_back(std::make_shared<ColorMatrixFilter>(filter.filter_params));
+                continue;
+            }
+            case FiltersList::kEqualize: {
+                requested_filters.push_back(std::make_shared<Equalize>(filter.filter_params));
+                continue;
+            }
+            case FiltersList::kAutoLevels: {
+                requested_filters.push_back(std::make_shared<AutoLevels>(filter.filter_params));
+                continue;
+            }
+            case FiltersList::kAutoWhiteBalance: {
+                requested_filters.push_back(std::make_shared<AutoWhiteBalance>(filter.filter_params));
+                continue;
+            }
+            case FiltersList::kQuantize: {
+                requested_filters.push_back(std::make_shared<Quantize>(filter.filter_params));
+                continue;
+            }
+            case FiltersList::kResize: {
+                requested_filters.push_back(std::make_shared<Resize>(filter.filter_params));
+                continue;
+            }
+            case FiltersList::kDownscale: {
+                requested_filters.push_back(std::make_shared<Downscale>(filter.filter_params));
+                continue;
+            }
+            case FiltersList::kRotate: {
+                requested_filters.push_back(std::make_shared<Rotate>(filter.filter_params));
+                continue;
+            }
+            case FiltersList::kTranspose: {
+                requested_filters.push_back(std::make_shared<Transpose>(filter.filter_params));
+                continue;
+            }
+            case FiltersList::kFlipVertical: {
+                requested_filters.push_back(std::make_shared<FlipVertical>(filter.filter_params));
+                continue;
+            }
+            case FiltersList::kFlipHorizontal: {
+                requested_filters.push_back(std::make_shared<FlipHorizontal>(filter.filter_params));
+                continue;
+            }
+            case FiltersList::kAffine: {
+                requested_filters.push_back(std::make_shared<Affine>(filter.filter_params));
+                continue;
+            }
+            case FiltersList::kRotateDegrees: {
+                requested_filters.push_back(std::make_shared<RotateDegrees>(filter.filter_params));
+                continue;
+            }
+            case FiltersList::kRemap: {
+                requested_filters.push_back(std::make_shared<Remap>(filter.filter_params));
+                continue;
+            }
+            case FiltersList::kPixelate: {
+                requested_filters.push_back(std::make_shared<Pixelate>(filter.filter_params));
+                continue;
+            }
             default:
                 throw FiltersProcessingException(filter.filter_name + " is not valid filter name");
         }
     }
 
-    for (const auto& applied_filter : requested_filters) {
+    return requested_filters;
+}
+
+std::optional<ColorMatrix> GetColorMatrix(const std::shared_ptr<BaseFilter>& filter) {
+    if (auto color_matrix_filter = std::dynamic_pointer_cast<ColorMatrixFilter>(filter)) {
+        return color_matrix_filter->GetMatrix();
+    }
+    if (std::dynamic_pointer_cast<Grayscale>(filter)) {
+        return kLumaColorMatrix;
+    }
+    return std::nullopt;
+}
+
+std::vector<std::shared_ptr<BaseFilter>> PlanFilters(const std::vector<std::shared_ptr<BaseFilter>>& filters) {
+    std::vector<std::shared_ptr<BaseFilter>> planned_filters;
+
+    for (const auto& filter : filters) {
+        if (planned_filters.empty()) {
+            planned_filters.push_back(filter);
+            continue;
+        }
+
+        auto lut_filter = std::dynamic_pointer_cast<LutFilter>(filter);
+        auto previous_lut_filter = std::dynamic_pointer_cast<LutFilter>(planned_filters.back());
+        if (lut_filter && previous_lut_filter) {
+            planned_filters.back() = std::make_shared<ComposedLut>(
+                    ComposeLuts(previous_lut_filter->BuildLut(), lut_filter->BuildLut()));
+            continue;
+        }
+
+        auto color_matrix = GetColorMatrix(filter);
+        auto previous_color_matrix = GetColorMatrix(planned_filters.back());
+        bool has_color_matrix_filter = std::dynamic_pointer_cast<ColorMatrixFilter>(filter) ||
+                                       std::dynamic_pointer_cast<ColorMatrixFilter>(planned_filters.back());
+        if (color_matrix && previous_color_matrix && has_color_matrix_filter) {
+            planned_filters.back() = std::make_shared<ColorMatrixFilter>(
+                    ComposeColorMatrices(*previous_color_matrix, *color_matrix));
+            continue;
+        }
+
+        planned_filters.push_back(filter);
+    }
+
+    return planned_filters;
+}
+
+void RunFilters(std::span<const std::shared_ptr<BaseFilter>> filters, BMP& image, const ProcessingOptions& options) {
+    for (const auto& applied_filter : filters) {
+        applied_filter->Configure(options);
+        auto layout = applied_filter->GetLayout();
+        if (layout && !(layout == PixelLayout::kPlanar && image.GetLayout() == PixelLayout::kGray)) {
+            image.SetLayout(*layout);
+        }
         applied_filter->Apply(image);
     }
 }
+
+void ApplyFilters(const std::vector<Filter>& filters, BMP& image, const ProcessingOptions& options) {
+    SetThreadCount(options.threads);
+    RunFilters(PlanFilters(CreateFilters(filters)), image, options);
+}
+
+void OpenAndApplyFilters(std::string_view input_file, const std::vector<Filter>& filters, BMP& image,
+                         const ProcessingOptions& options) {
+    SetThreadCount(options.threads);
+    auto planned_filters = PlanFilters(CreateFilters(filters));
+    std::span<const std::shared_ptr<BaseFilter>> remaining_filters = planned_filters;
+    auto downscale = planned_filters.empty() ? nullptr : std::dynamic_pointer_cast<Downscale>(planned_filters[0]);
+    auto crop = planned_filters.empty() ? nullptr : std::dynamic_pointer_cast<Crop>(planned_filters[0]);
+    if (downscale) {
+        downscale->Configure(options);
+        if (!downscale->OpenDownscaled(image, input_file)) {
+            remaining_filters = remaining_filters.subspan(1);
+        }
+    } else if (crop) {
+        if (!crop->OpenCropped(image, input_file)) {
+            remaining_filters = remaining_filters.subspan(1);
+        }
+    } else {
+        image.Open(input_file);
+    }
+    RunFilters(remaining_filters, image, options);
+}
+
+namespace {
+
+// Decodes a 24-bit input_file into planes and feeds every row to a pyramid of its channel as
+// it is read. Returns false, with the image opened as by Open, for a paletted image.
+bool OpenWithPyramids(BMP& image, std::string_view input_file, size_t levels_count,
+                      std::vector<PyramidBuilder>& pyramids) {
+    ColorPlanes planes;
+    bool streamed = image.OpenStreaming(input_file, [&](size_t y, const uint8_t* red, const uint8_t* green,
+                                                        const uint8_t* blue) {
+        if (pyramids.empty()) {
+            for (auto& plane : planes) {
+                plane = Plane(image.GetWidth(), image.GetHeight());
+                pyramids.emplace_back(image.GetWidth(), image.GetHeight(), levels_count);
+            }
+        }
+        const uint8_t* rows[] = {red, green, blue};
+        for (size_t channel = 0; channel < kAmountOfPrimaryColors; ++channel) {
+            std::copy(rows[channel], rows[channel] + planes[channel].width, planes[channel].Row(y));
+            pyramids[channel].AddRow(y, planes[channel].Row(y));
+        }
+    });
+    if (streamed) {
+        image.SetPlanes(std::move(planes));
+    }
+    return streamed;
+}
+
+// One pass over each plane, the planes split across threads.
+std::vector<PyramidBuilder> BuildPyramids(std::span<const Plane> planes, size_t levels_count) {
+    std::vector<PyramidBuilder> pyramids;
+    for (const auto& plane : planes) {
+        pyramids.emplace_back(plane.width, plane.height, levels_count);
+    }
+    ParallelFor(planes.size(), [&](size_t, size_t begin, size_t end) {
+        for (size_t channel = begin; channel < end; ++channel) {
+            for (size_t y = 0; y < planes[channel].height; ++y) {
+                pyramids[channel].AddRow(y, planes[channel].Row(y));
+            }
+        }
+    });
+    return pyramids;
+}
+
+// Planes() expands an indexed image, which must still be saved with its palette, so the
+// pyramid of one is built from an expanded copy.
+std::vector<PyramidBuilder> BuildPyramids(BMP& image, size_t levels_count) {
+    if (image.GetLayout() == PixelLayout::kIndexed) {
+        BMP expanded = image;
+        return BuildPyramids(expanded.Planes(), levels_count);
+    }
+    return BuildPyramids(image.Planes(), levels_count);
+}
+
+}  // namespace
+
+std::string GetPyramidLevelPath(std::string_view output_file, size_t level) {
+    std::filesystem::path path(output_file);
+    std::filesystem::path name = path.stem();
+    name += "_" + std::to_string(level);
+    name += path.extension();
+    return path.replace_filename(name).string();
+}
+
+void ProcessImage(std::string_view input_file, std::string_view output_file, const std::vector<Filter>& filters,
+                  const ProcessingOptions& options) {
+    SetThreadCount(options.threads);
+    BMP image;
+    std::vector<PyramidBuilder> pyramids;
+    if (options.pyramid_levels > 0 && filters.empty()) {
+        if (!OpenWithPyramids(image, input_file, options.pyramid_levels, pyramids)) {
+            pyramids = BuildPyramids(image, options.pyramid_levels);
+        }
+    } else {
+        OpenAndApplyFilters(input_file, filters, image, options);
+        if (options.pyramid_levels > 0) {
+            pyramids = BuildPyramids(image, options.pyramid_levels);
+        }
+    }
+    bool gray = image.GetLayout() == PixelLayout::kGray;
+    image.Save(output_file, options.gray_bits_per_pixel);
+
+    // Each level takes over the image, so the planes of a level are written without a copy.
+    for (size_t level = 0; level < options.pyramid_levels; ++level) {
+        if (gray) {
+            image.SetGray(std::move(pyramids[0].Levels()[level]));
+        } else {
+            image.SetPlanes({std::move(pyramids[0].Levels()[level]), std::move(pyramids[1].Levels()[level]),
+                             std::move(pyramids[2].Levels()[level])});
+        }
+        image.Save(GetPyramidLevelPath(output_file, level + 1), options.gray_bits_per_pixel);
+    }
+}
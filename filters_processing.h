@@ -9,6 +9,26 @@
 #include "exceptions.h"
 #include "filters.h"
 
+constexpr std::string_view kOptionPrecisionName = "--precision";
+constexpr std::string_view kPrecisionFloatName = "float";
+constexpr std::string_view kPrecisionDoubleName = "double";
+
+constexpr std::string_view kOptionThreadsName = "--threads";
+constexpr std::string_view kOptionGrayBitsName = "--gray-bits";
+constexpr std::string_view kOptionLinearName = "--linear";
+constexpr std::string_view kOptionPyramidName = "--pyramid";
+constexpr std::string_view kOptionRemapCacheName = "--remap-cache";
+
+constexpr size_t kOptionPrecisionParamsCount = 1;
+constexpr size_t kOptionThreadsParamsCount = 1;
+constexpr size_t kOptionGrayBitsParamsCount = 1;
+constexpr size_t kOptionLinearParamsCount = 0;
+constexpr size_t kOptionPyramidParamsCount = 1;
+constexpr size_t kOptionRemapCacheParamsCount = 1;
+
+// Halving a BMP side, at most 2^31 pixels, this many times leaves a single pixel.
+constexpr size_t kMaxPyramidLevels = 31;
+
 enum class FiltersList : unsigned char {
     kNone,
     kCrop,
@@ -18,8 +38,64 @@ enum class FiltersList : unsigned char {
     kEdgeDetection,
     kGaussianBlur,
     kShuffle,
+    kGamma,
+    kLevels,
+    kCurve,
+    kBrightness,
+    kContrast,
+    kLut3d,
+    kColorMatrix,
+    kEqualize,
+    kAutoLevels,
+    kAutoWhiteBalance,
+    kQuantize,
+    kResize,
+    kDownscale,
+    kRotate,
+    kTranspose,
+    kFlipVertical,
+    kFlipHorizontal,
+    kAffine,
+    kRotateDegrees,
+    kRemap,
+    kPixelate,
+};
+
+enum class OptionsList : unsigned char {
+    kNone,
+    kPrecision,
+    kThreads,
+    kGrayBits,
+    kLinear,
+    kPyramid,
+    kRemapCache,
 };
 
 FiltersList GetFilter(const std::string& filter_name);
+OptionsList GetOption(const std::string& option_name);
+
+ProcessingOptions GetProcessingOptions(const std::vector<Option>& options);
+
+std::vector<std::shared_ptr<BaseFilter>> CreateFilters(const std::vector<Filter>& filters);
+// Rewrites the requested chain into the one that is actually run: adjacent LutFilters are
+// composed into a single table, and adjacent colour matrices, with Grayscale taken as the
+// luma matrix, into a single matrix, so each such run costs one pass. Grayscale on its
+// own, or next to another Grayscale only, keeps its exact integer path.
+std::vector<std::shared_ptr<BaseFilter>> PlanFilters(const std::vector<std::shared_ptr<BaseFilter>>& filters);
+
+// The image changes layout only before a filter that requires another one; filters that
+// accept any run in the current layout, and gray images stay gray for planar filters.
+// This greedy choice needs the fewest conversions, and Save converts back at most once.
+void ApplyFilters(const std::vector<Filter>& filters, BMP& image, const ProcessingOptions& options = {});
+// Opens input_file into image and applies filters as ApplyFilters does, except that a leading
+// Downscale or Crop runs while the image is decoded.
+void OpenAndApplyFilters(std::string_view input_file, const std::vector<Filter>& filters, BMP& image,
+                         const ProcessingOptions& options = {});
 
-void ApplyFilters(const std::vector<Filter>& filters, BMP& image);
+// Level 1 of out.bmp is out_1.bmp, next to it.
+std::string GetPyramidLevelPath(std::string_view output_file, size_t level);
+// Opens input_file, applies filters and saves the result to output_file, followed by
+// options.pyramid_levels levels, each half the size of the one before. The levels are built
+// in one pass over the result; without filters that pass is the decoding itself.
+void ProcessImage(std::string_view input_file, std::string_view output_file, const std::vector<Filter>& filters,
+                  const ProcessingOptions& options = {});
@@ -0,0 +1,159 @@
+#include "gaussian.h"
+
+#include <algorithm>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <numbers>
+#include <shared_mutex>
+#include <utility>
+
+namespace {
+
+// Compile-time tables and runtime cache misses share this exponent, so a standard sigma
+// gives the same coefficients whichever way its kernel was produced.
+constexpr double ConstexprExp(double value) {
+    constexpr long double kLn2 = 0.693147180559945309417232121458176568L;
+    constexpr int kTaylorTerms = 30;
+    // exp of anything lower is below the smallest subnormal double.
+    constexpr double kMinExpArgument = -745.2;
+    // exp of anything higher overflows a double.
+    constexpr double kMaxExpArgument = 709.8;
+
+    if (value < kMinExpArgument) {
+        return 0;
+    }
+    if (value > kMaxExpArgument) {
+        return std::numeric_limits<double>::infinity();
+    }
+    long double scaled = value / kLn2;
+    auto power = static_cast<long long>(scaled < 0 ? scaled - 0.5L : scaled + 0.5L);
+    long double remainder = value - power * kLn2;
+    long double term = 1;
+    long double sum = 1;
+    for (int i = 1; i < kTaylorTerms; ++i) {
+        term *= remainder / i;
+        sum += term;
+    }
+    // Multiplies by 2^power through the binary digits of power, which the bounds above keep
+    // within the exponent range; the steps are powers of two, so the product stays exact.
+    long double factor = power < 0 ? 0.5L : 2.0L;
+    for (auto digits = static_cast<unsigned long long>(power < 0 ? -power : power); digits != 0; digits >>= 1) {
+        if (digits & 1) {
+            sum *= factor;
+        }
+        factor *= factor;
+    }
+    return static_cast<double>(sum);
+}
+
+constexpr size_t GaussianMatrixSize(double sigma) {
+    int size = std::max(kMinimumGaussianBlurMatrixSize,
+                        static_cast<int>(kMatrixSizeDependenceOnSigma * sigma + 0.5));
+    if (size % 2 == 0) {
+        --size;
+    }
+    return static_cast<size_t>(size);
+}
+
+template <typename Matrix, typename Vector>
+constexpr void FillGaussianKernel(double sigma, size_t size, Matrix& matrix, Vector& kernel) {
+    double center = static_cast<double>(size) / 2;
+    double sigma_coefficient = kSigmaMultiplier * sigma * sigma;
+    double matrix_sum = 0;
+    double kernel_sum = 0;
+
+    for (size_t y = 0; y < size; ++y) {
+        double distance_y = center - static_cast<double>(y);
+        for (size_t x = 0; x < size; ++x) {
+            double distance_x = center - static_cast<double>(x);
+            matrix[y][x] = ConstexprExp(-(distance_y * distance_y + distance_x * distance_x) / sigma_coefficient) /
+                           (std::numbers::pi_v<double> * sigma_coefficient);
+            matrix_sum += matrix[y][x];
+        }
+        kernel[y] = ConstexprExp(-distance_y * distance_y / sigma_coefficient);
+        kernel_sum += kernel[y];
+    }
+
+    for (size_t y = 0; y < size; ++y) {
+        for (size_t x = 0; x < size; ++x) {
+            matrix[y][x] /= matrix_sum;
+        }
+        kernel[y] /= kernel_sum;
+    }
+}
+
+template <size_t Size>
+struct GaussianTable {
+    std::array<std::array<double, Size>, Size> matrix{};
+    std::array<double, Size> kernel{};
+};
+
+template <size_t Index>
+constexpr auto MakeStandardGaussianTable() {
+    constexpr double kSigma = kStandardGaussianSigmas[Index];
+    GaussianTable<GaussianMatrixSize(kSigma)> table;
+    FillGaussianKernel(kSigma, table.kernel.size(), table.matrix, table.kernel);
+    return table;
+}
+
+template <size_t Index>
+constexpr auto kStandardGaussianTable = MakeStandardGaussianTable<Index>();
+
+template <typename Coefficient, typename Source>
+std::shared_ptr<const GaussianKernel<Coefficient>> ConvertGaussianKernel(const Source& source) {
+    auto kernel = std::make_shared<GaussianKernel<Coefficient>>();
+    for (const auto& row : source.matrix) {
+        kernel->matrix.emplace_back(row.begin(), row.end());
+    }
+    kernel->kernel.assign(source.kernel.begin(), source.kernel.end());
+    return kernel;
+}
+
+template <typename Coefficient>
+struct GaussianKernelCache {
+    std::shared_mutex mutex;
+    std::map<double, std::shared_ptr<const GaussianKernel<Coefficient>>> kernels;
+
+    GaussianKernelCache() {
+        AddStandardKernels(std::make_index_sequence<kStandardGaussianSigmas.size()>());
+    }
+
+    template <size_t... Indices>
+    void AddStandardKernels(std::index_sequence<Indices...>) {
+        (kernels.emplace(kStandardGaussianSigmas[Indices],
+                         ConvertGaussianKernel<Coefficient>(kStandardGaussianTable<Indices>)), ...);
+    }
+};
+
+}  // namespace
+
+GaussianKernel<double> CalculateGaussianKernel(double sigma) {
+    size_t size = GaussianMatrixSize(sigma);
+    GaussianKernel<double> kernel{.matrix = std::vector<std::vector<double>>(size, std::vector<double>(size)),
+                                  .kernel = std::vector<double>(size)};
+    FillGaussianKernel(sigma, size, kernel.matrix, kernel.kernel);
+    return kernel;
+}
+
+template <typename Coefficient>
+std::shared_ptr<const GaussianKernel<Coefficient>> GetGaussianKernel(double sigma) {
+    static GaussianKernelCache<Coefficient> cache;
+    {
+        std::shared_lock lock(cache.mutex);
+        auto found = cache.kernels.find(sigma);
+        if (found != cache.kernels.end()) {
+            return found->second;
+        }
+    }
+
+    auto kernel = ConvertGaussianKernel<Coefficient>(CalculateGaussianKernel(sigma));
+    std::unique_lock lock(cache.mutex);
+    if (cache.kernels.size() >= kGaussianKernelCacheLimit) {
+        return kernel;
+    }
+    return cache.kernels.try_emplace(sigma, std::move(kernel)).first->second;
+}
+
+template std::shared_ptr<const GaussianKernel<float>> GetGaussianKernel<float>(double sigma);
+template std::shared_ptr<const GaussianKernel<double>> GetGaussianKernel<double>(double sigma);
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <array>
+#include <memory>
+#include <vector>
+
+constexpr double kMatrixSizeDependenceOnSigma = 3.0;
+constexpr int kMinimumGaussianBlurMatrixSize = 5;
+constexpr double kSigmaMultiplier = 2.0;
+// Taps of kernels for much smaller sigmas underflow to zero, leaving nothing to normalise.
+constexpr double kMinGaussianSigma = 0.1;
+
+// Kernels for these sigmas are generated at compile time.
+constexpr std::array<double, 5> kStandardGaussianSigmas = {0.5, 1.0, 2.0, 3.0, 5.0};
+constexpr size_t kGaussianKernelCacheLimit = 256;
+
+template <typename Coefficient>
+struct GaussianKernel {
+    // Normalised matrix from the README formula.
+    std::vector<std::vector<Coefficient>> matrix;
+    // Normalised factor of the matrix: matrix[y][x] == kernel[y] * kernel[x] up to rounding.
+    std::vector<Coefficient> kernel;
+};
+
+// Process-wide, thread-safe cache keyed by sigma and, through the template argument, by
+// coefficient precision.
+template <typename Coefficient>
+std::shared_ptr<const GaussianKernel<Coefficient>> GetGaussianKernel(double sigma);
+
+GaussianKernel<double> CalculateGaussianKernel(double sigma);
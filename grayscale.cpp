@@ -0,0 +1,128 @@
+#include "grayscale.h"
+
+#include <bit>
+#include <cmath>
+
+#include "packed_rgb.h"
+
+namespace {
+
+uint32_t RoundedWeightedSum(const PixelColor& pixel) {
+    return kRedToGrayPerMille * pixel.r + kGreenToGrayPerMille * pixel.g + kBlueToGrayPerMille * pixel.b +
+           kGrayWeightsScale / 2;
+}
+
+// When the exact weighted sum ends in .5 the double formula rounds either way, depending
+// on how its products happened to round, so such pixels are evaluated the original way.
+bool IsTie(uint32_t rounded_sum) {
+    return rounded_sum % kGrayWeightsScale == 0;
+}
+
+uint8_t CalculateGrayOnTie(const PixelColor& pixel) {
+    double red = static_cast<double>(pixel.r) / kMaxRgb;
+    double green = static_cast<double>(pixel.g) / kMaxRgb;
+    double blue = static_cast<double>(pixel.b) / kMaxRgb;
+
+    return static_cast<uint8_t>(std::lround((red * kRedToGray + green * kGreenToGray + blue * kBlueToGray) *
+                                            kMaxRgb));
+}
+
+void ConvertRowToGrayScalar(const PixelColor* row, uint8_t* gray, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        gray[i] = CalculateGray(row[i]);
+    }
+}
+
+#ifdef IMAGE_PROCESSOR_X86
+
+// Division of the rounded sum by 1000 in 16-bit lanes: sum / 8 fits them, and the
+// quotient of that by 125 is mulhi(sum / 8, 33555) / 2^6, exact for every pixel.
+constexpr int kGrayDivisionPreShift = 3;
+constexpr int kGrayDivisionPreMask = (1 << kGrayDivisionPreShift) - 1;
+constexpr int kGrayDivisionDivisor = static_cast<int>(kGrayWeightsScale) >> kGrayDivisionPreShift;
+constexpr int kGrayDivisionMultiplier = 33555;
+constexpr int kGrayDivisionShift = 6;
+
+// Rounded weighted sums of eight pixels given as 16-bit lanes: lanes 0-3 go to low, 4-7 to high.
+IMAGE_PROCESSOR_TARGET("sse4.1")
+void RoundedWeightedSumsSse41(const __m128i* channels, __m128i& low, __m128i& high) {
+    const __m128i red_green_weights = _mm_set1_epi32(static_cast<int>(kGreenToGrayPerMille << 16 |
+                                                                      kRedToGrayPerMille));
+    const __m128i blue_rounding_weights = _mm_set1_epi32(static_cast<int>((kGrayWeightsScale / 2) << 16 |
+                                                                          kBlueToGrayPerMille));
+    const __m128i ones = _mm_set1_epi16(1);
+    low = _mm_add_epi32(_mm_madd_epi16(_mm_unpacklo_epi16(channels[0], channels[1]), red_green_weights),
+                        _mm_madd_epi16(_mm_unpacklo_epi16(channels[2], ones), blue_rounding_weights));
+    high = _mm_add_epi32(_mm_madd_epi16(_mm_unpackhi_epi16(channels[0], channels[1]), red_green_weights),
+                         _mm_madd_epi16(_mm_unpackhi_epi16(channels[2], ones), blue_rounding_weights));
+}
+
+// Quotients of eight rounded sums as 16-bit lanes; tie gets all ones where IsTie holds.
+IMAGE_PROCESSOR_TARGET("sse4.1")
+__m128i DivideByWeightsScaleSse41(__m128i low, __m128i high, __m128i& tie) {
+    __m128i reduced = _mm_packus_epi32(_mm_srli_epi32(low, kGrayDivisionPreShift),
+                                       _mm_srli_epi32(high, kGrayDivisionPreShift));
+    __m128i dropped = _mm_packus_epi32(_mm_and_si128(low, _mm_set1_epi32(kGrayDivisionPreMask)),
+                                       _mm_and_si128(high, _mm_set1_epi32(kGrayDivisionPreMask)));
+    __m128i quotient = _mm_srli_epi16(_mm_mulhi_epu16(reduced, _mm_set1_epi16(kGrayDivisionMultiplier)),
+                                      kGrayDivisionShift);
+    __m128i remainder = _mm_sub_epi16(reduced, _mm_mullo_epi16(quotient, _mm_set1_epi16(kGrayDivisionDivisor)));
+    tie = _mm_cmpeq_epi16(_mm_or_si128(remainder, dropped), _mm_setzero_si128());
+    return quotient;
+}
+
+// Wider registers gain nothing here: the row is read once and the kernel is bound by
+// memory bandwidth, so every level from SSE4.1 up uses this one.
+IMAGE_PROCESSOR_TARGET("sse4.1")
+void ConvertRowToGraySse41(const PixelColor* row, uint8_t* gray, size_t count) {
+    size_t i = 0;
+    for (; i + kPackedRgbPixelsPerStep <= count; i += kPackedRgbPixelsPerStep) {
+        __m128i channels[kAmountOfPrimaryColors];
+        DeinterleaveRgbSse41(row + i, channels);
+
+        __m128i low_words[kAmountOfPrimaryColors];
+        __m128i high_words[kAmountOfPrimaryColors];
+        for (size_t channel = 0; channel < kAmountOfPrimaryColors; ++channel) {
+            low_words[channel] = _mm_cvtepu8_epi16(channels[channel]);
+            high_words[channel] = _mm_cvtepu8_epi16(_mm_srli_si128(channels[channel], 8));
+        }
+
+        __m128i sums[4];
+        RoundedWeightedSumsSse41(low_words, sums[0], sums[1]);
+        RoundedWeightedSumsSse41(high_words, sums[2], sums[3]);
+        __m128i low_ties;
+        __m128i high_ties;
+        __m128i low_quotients = DivideByWeightsScaleSse41(sums[0], sums[1], low_ties);
+        __m128i high_quotients = DivideByWeightsScaleSse41(sums[2], sums[3], high_ties);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(gray + i), _mm_packus_epi16(low_quotients, high_quotients));
+
+        auto tie_lanes = static_cast<unsigned>(_mm_movemask_epi8(_mm_packs_epi16(low_ties, high_ties)));
+        for (; tie_lanes != 0; tie_lanes &= tie_lanes - 1) {
+            size_t lane = std::countr_zero(tie_lanes);
+            gray[i + lane] = CalculateGrayOnTie(row[i + lane]);
+        }
+    }
+    ConvertRowToGrayScalar(row + i, gray + i, count - i);
+}
+
+#endif
+
+}  // namespace
+
+uint8_t CalculateGray(const PixelColor& pixel) {
+    uint32_t rounded_sum = RoundedWeightedSum(pixel);
+    if (IsTie(rounded_sum)) {
+        return CalculateGrayOnTie(pixel);
+    }
+    return static_cast<uint8_t>(rounded_sum / kGrayWeightsScale);
+}
+
+void ConvertRowToGray(const PixelColor* row, uint8_t* gray, size_t count) {
+#ifdef IMAGE_PROCESSOR_X86
+    if (GetSimdLevel() >= SimdLevel::kSse41) {
+        ConvertRowToGraySse41(row, gray, count);
+        return;
+    }
+#endif
+    ConvertRowToGrayScalar(row, gray, count);
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <cstdint>
+
+#include "bmp_processing.h"
+
+constexpr double kRedToGray = 0.299;
+constexpr double kGreenToGray = 0.587;
+constexpr double kBlueToGray = 0.114;
+
+// The same weights in thousandths, so the weighted sum of a pixel is exact in integers.
+constexpr uint32_t kRedToGrayPerMille = 299;
+constexpr uint32_t kGreenToGrayPerMille = 587;
+constexpr uint32_t kBlueToGrayPerMille = 114;
+constexpr uint32_t kGrayWeightsScale = 1000;
+
+// Bit-identical to lround((r / 255 * 0.299 + g / 255 * 0.587 + b / 255 * 0.114) * 255)
+// evaluated in double.
+uint8_t CalculateGray(const PixelColor& pixel);
+// Dispatched over SimdLevel; every level gives the same bytes as CalculateGray.
+void ConvertRowToGray(const PixelColor* row, uint8_t* gray, size_t count);
@@ -0,0 +1,160 @@
+#include "histogram.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "parallel.h"
+
+ColorHistogram ComputeHistogram(const PixelMatrix& pixels, size_t step) {
+    size_t sampled_rows = (pixels.size() + step - 1) / step;
+    std::vector<ColorHistogram> band_histograms(GetBandsCount(sampled_rows));
+    ParallelFor(sampled_rows, [&pixels, &band_histograms, step](size_t band_number, size_t begin, size_t end) {
+        auto& [red, green, blue] = band_histograms[band_number].channels;
+        for (size_t sample = begin; sample < end; ++sample) {
+            const auto& row = pixels[sample * step];
+            for (size_t x = 0; x < row.size(); x += step) {
+                ++red[row[x].r];
+                ++green[row[x].g];
+                ++blue[row[x].b];
+            }
+        }
+    });
+
+    ColorHistogram histogram;
+    for (const auto& band_histogram : band_histograms) {
+        for (size_t channel = 0; channel < kAmountOfPrimaryColors; ++channel) {
+            for (size_t level = 0; level < kLutSize; ++level) {
+                histogram.channels[channel][level] += band_histogram.channels[channel][level];
+            }
+        }
+    }
+    return histogram;
+}
+
+namespace {
+
+// Samples the same pixels in the same band order as the PixelMatrix overload.
+ChannelHistogram ComputeHistogram(const Plane& plane, size_t step) {
+    size_t sampled_rows = (plane.height + step - 1) / step;
+    std::vector<ChannelHistogram> band_histograms(GetBandsCount(sampled_rows));
+    ParallelFor(sampled_rows, [&plane, &band_histograms, step](size_t band_number, size_t begin, size_t end) {
+        auto& histogram = band_histograms[band_number];
+        for (size_t sample = begin; sample < end; ++sample) {
+            const uint8_t* row = plane.Row(sample * step);
+            for (size_t x = 0; x < plane.width; x += step) {
+                ++histogram[row[x]];
+            }
+        }
+    });
+
+    ChannelHistogram histogram{};
+    for (const auto& band_histogram : band_histograms) {
+        for (size_t level = 0; level < kLutSize; ++level) {
+            histogram[level] += band_histogram[level];
+        }
+    }
+    return histogram;
+}
+
+}  // namespace
+
+ColorHistogram ComputeHistogram(BMP& image, size_t step) {
+    ColorHistogram histogram;
+    switch (image.GetLayout()) {
+        case PixelLayout::kInterleaved:
+            return ComputeHistogram(image.PixelMatrix(), step);
+        case PixelLayout::kGray:
+            histogram.channels[0] = ComputeHistogram(image.ActivePlanes()[0], step);
+            histogram.channels[1] = histogram.channels[0];
+            histogram.channels[2] = histogram.channels[0];
+            return histogram;
+        case PixelLayout::kIndexed: {
+            ChannelHistogram indices = ComputeHistogram(image.ActivePlanes()[0], step);
+            const Palette& palette = image.GetPalette();
+            for (size_t index = 0; index < palette.size(); ++index) {
+                histogram.channels[0][palette[index].r] += indices[index];
+                histogram.channels[1][palette[index].g] += indices[index];
+                histogram.channels[2][palette[index].b] += indices[index];
+            }
+            return histogram;
+        }
+        default:
+            for (size_t channel = 0; channel < kAmountOfPrimaryColors; ++channel) {
+                histogram.channels[channel] = ComputeHistogram(image.ActivePlanes()[channel], step);
+            }
+            return histogram;
+    }
+}
+
+size_t GetStatisticsStep(size_t height, size_t width) {
+    auto ratio = static_cast<double>(height * width) / kStatisticsSamplePixels;
+    return std::max(static_cast<size_t>(std::sqrt(ratio)), static_cast<size_t>(1));
+}
+
+int FindPercentile(const ChannelHistogram& histogram, double fraction) {
+    uint64_t total = 0;
+    for (auto count : histogram) {
+        total += count;
+    }
+
+    auto threshold = fraction * static_cast<double>(total);
+    uint64_t cumulative = 0;
+    int last_present = kMinRgb;
+    for (int level = kMinRgb; level <= kMaxRgb; ++level) {
+        if (histogram[level] == 0) {
+            continue;
+        }
+        cumulative += histogram[level];
+        last_present = level;
+        if (static_cast<double>(cumulative) > threshold) {
+            return level;
+        }
+    }
+    return last_present;
+}
+
+double FindMean(const ChannelHistogram& histogram) {
+    uint64_t total = 0;
+    uint64_t sum = 0;
+    for (size_t level = 0; level < kLutSize; ++level) {
+        total += histogram[level];
+        sum += histogram[level] * level;
+    }
+    return total == 0 ? 0 : static_cast<double>(sum) / static_cast<double>(total);
+}
+
+ChannelHistogram PoolChannels(const ColorHistogram& histogram) {
+    ChannelHistogram pooled{};
+    for (const auto& channel : histogram.channels) {
+        for (size_t level = 0; level < kLutSize; ++level) {
+            pooled[level] += channel[level];
+        }
+    }
+    return pooled;
+}
+
+ChannelLut MakeEqualizationLut(const ChannelHistogram& histogram) {
+    ChannelHistogram cumulative{};
+    uint64_t total = 0;
+    for (size_t level = 0; level < kLutSize; ++level) {
+        total += histogram[level];
+        cumulative[level] = total;
+    }
+
+    uint64_t first_nonzero = 0;
+    for (size_t level = 0; level < kLutSize && first_nonzero == 0; ++level) {
+        first_nonzero = cumulative[level];
+    }
+    if (total == first_nonzero) {
+        return MakeIdentityLut().channels[0];
+    }
+
+    return TabulateChannel([&cumulative, total, first_nonzero](int level) {
+        if (cumulative[level] < first_nonzero) {
+            return 0.0;
+        }
+        return static_cast<double>(cumulative[level] - first_nonzero) /
+               static_cast<double>(total - first_nonzero) * kMaxRgb;
+    });
+}
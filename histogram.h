@@ -0,0 +1,34 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+#include "bmp_processing.h"
+#include "lut.h"
+
+// Statistics of larger images are gathered from a regular subsample of about this many pixels.
+constexpr size_t kStatisticsSamplePixels = 1 << 20;
+
+typedef std::array<uint64_t, kLutSize> ChannelHistogram;
+
+struct ColorHistogram {
+    std::array<ChannelHistogram, kAmountOfPrimaryColors> channels{};
+};
+
+// Counts every step-th pixel of every step-th row. Each band of rows fills a private
+// histogram; they are summed in band order, so the result is the same for any thread count.
+ColorHistogram ComputeHistogram(const PixelMatrix& pixels, size_t step = 1);
+// The same counts for an image in any layout, without converting it: a gray plane counts once
+// for all three channels, indices are counted and then looked up in the palette.
+ColorHistogram ComputeHistogram(BMP& image, size_t step = 1);
+// Step for ComputeHistogram that samples about kStatisticsSamplePixels pixels.
+size_t GetStatisticsStep(size_t height, size_t width);
+// Lowest level whose cumulative count exceeds fraction of the total, or the highest occupied
+// level when none does.
+int FindPercentile(const ChannelHistogram& histogram, double fraction);
+double FindMean(const ChannelHistogram& histogram);
+// Sum of the three channel histograms.
+ChannelHistogram PoolChannels(const ColorHistogram& histogram);
+// Table spreading the cumulative distribution over [0, 255]; a histogram of a single level
+// maps to the identity.
+ChannelLut MakeEqualizationLut(const ChannelHistogram& histogram);
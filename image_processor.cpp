@@ -1,18 +1,15 @@
 #include <iostream>
 
-#include "bmp_processing.h"
 #include "console_read.h"
 #include "exceptions.h"
 #include "filters_processing.h"
 
 int main(int argc, char* argv[]) {
-    BMP image;
     Parser parser;
     try {
         auto args = parser(argc, argv);
-        image.Open(args.input_path);
-        ApplyFilters(args.filters, image);
-        image.Save(args.output_path);
+        auto options = GetProcessingOptions(args.options);
+        ProcessImage(args.input_path, args.output_path, args.filters, options);
     } catch (BaseException& e) {
         std::cout << e.what() << std::endl;
     }
@@ -0,0 +1,38 @@
+#include "integral.h"
+
+#include "parallel.h"
+
+template <typename Sum>
+IntegralImage<Sum>::IntegralImage(const Plane& plane, size_t x, size_t y, size_t width, size_t height)
+    : width_(width), height_(height), sums_((width + 1) * (height + 1)) {
+    size_t stride = width + 1;
+    ParallelFor(height, [&](size_t, size_t begin, size_t end) {
+        for (size_t row = begin; row < end; ++row) {
+            const uint8_t* pixels = plane.Row(y + row) + x;
+            Sum* sums = sums_.data() + (row + 1) * stride;
+            Sum sum = 0;
+            for (size_t column = 0; column < width; ++column) {
+                sum += pixels[column];
+                sums[column + 1] = sum;
+            }
+        }
+    });
+    // Each band walks down the table a row at a time, so the reads stay sequential and the
+    // inner loop vectorises.
+    ParallelFor(stride, [&](size_t, size_t begin, size_t end) {
+        for (size_t row = 2; row <= height; ++row) {
+            const Sum* above = sums_.data() + (row - 1) * stride;
+            Sum* sums = sums_.data() + row * stride;
+            for (size_t column = begin; column < end; ++column) {
+                sums[column] += above[column];
+            }
+        }
+    });
+}
+
+template <typename Sum>
+IntegralImage<Sum>::IntegralImage(const Plane& plane) : IntegralImage(plane, 0, 0, plane.width, plane.height) {
+}
+
+template class IntegralImage<uint32_t>;
+template class IntegralImage<uint64_t>;
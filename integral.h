@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include "bmp_processing.h"
+
+// Box sums are differences of table entries, which modular arithmetic keeps exact while the
+// box itself sums below the range of Sum: IntegralImage<uint32_t> serves boxes of up to this
+// many pixels in an image of any size, IntegralImage<uint64_t> any box.
+constexpr size_t kMaxIntegral32BoxPixelsCount = std::numeric_limits<uint32_t>::max() / kMaxRgb;
+
+// Summed-area table of a region of one plane: entry (x, y) holds the sum of the pixels above
+// and to the left of it, with a zero first row and column, so the sum or mean of any box costs
+// four reads whatever its size. Multi-channel images keep one table per plane.
+template <typename Sum>
+class IntegralImage {
+    size_t width_ = 0;
+    size_t height_ = 0;
+    // (width_ + 1) x (height_ + 1) entries, row by row.
+    std::vector<Sum> sums_;
+
+    const Sum* Row(size_t y) const {
+        return sums_.data() + y * (width_ + 1);
+    }
+
+public:
+    IntegralImage() = default;
+    // The region is width x height pixels from (x, y). Rows are prefix-summed in bands of rows
+    // across threads, then the columns are accumulated down the table in bands of columns.
+    IntegralImage(const Plane& plane, size_t x, size_t y, size_t width, size_t height);
+    explicit IntegralImage(const Plane& plane);
+
+    size_t Width() const {
+        return width_;
+    }
+
+    size_t Height() const {
+        return height_;
+    }
+
+    // The box is width x height pixels from (x, y) of the region.
+    Sum BoxSum(size_t x, size_t y, size_t width, size_t height) const {
+        const Sum* top = Row(y);
+        const Sum* bottom = Row(y + height);
+        return static_cast<Sum>(bottom[x + width] - bottom[x] - top[x + width] + top[x]);
+    }
+
+    // Rounded as BoxDownscaler rounds block averages.
+    uint8_t BoxMean(size_t x, size_t y, size_t width, size_t height) const {
+        uint64_t count = width * height;
+        return static_cast<uint8_t>((uint64_t{BoxSum(x, y, width, height)} + count / 2) / count);
+    }
+};
@@ -0,0 +1,82 @@
+#include "lut.h"
+
+#include "parallel.h"
+
+ColorLut MakeIdentityLut() {
+    return MakeUniformLut(TabulateChannel([](int level) { return level; }));
+}
+
+ColorLut MakeUniformLut(const ChannelLut& table) {
+    return {.channels = {table, table, table}};
+}
+
+bool IsUniformLut(const ColorLut& lut) {
+    return lut.channels[0] == lut.channels[1] && lut.channels[1] == lut.channels[2];
+}
+
+ColorLut ComposeLuts(const ColorLut& first, const ColorLut& second) {
+    ColorLut composed;
+    for (size_t channel = 0; channel < kAmountOfPrimaryColors; ++channel) {
+        for (size_t level = 0; level < kLutSize; ++level) {
+            composed.channels[channel][level] = second.channels[channel][first.channels[channel][level]];
+        }
+    }
+    return composed;
+}
+
+void ApplyLut(const ColorLut& lut, PixelMatrix& pixels) {
+    ParallelFor(pixels.size(), [&](size_t, size_t begin, size_t end) {
+        for (size_t y = begin; y < end; ++y) {
+            ApplyLut(lut, pixels[y]);
+        }
+    });
+}
+
+void ApplyLut(const ColorLut& lut, std::span<PixelColor> colors) {
+    const ChannelLut& red = lut.channels[0];
+    const ChannelLut& green = lut.channels[1];
+    const ChannelLut& blue = lut.channels[2];
+    for (auto& color : colors) {
+        color = {red[color.r], green[color.g], blue[color.b]};
+    }
+}
+
+namespace {
+
+void ApplyLutToRows(const ChannelLut& table, Plane& plane, size_t begin, size_t end) {
+    for (size_t y = begin; y < end; ++y) {
+        uint8_t* row = plane.Row(y);
+        for (size_t x = 0; x < plane.width; ++x) {
+            row[x] = table[row[x]];
+        }
+    }
+}
+
+}  // namespace
+
+void ApplyLut(const ColorLut& lut, std::span<Plane> planes) {
+    ParallelFor(planes[0].height, [&](size_t, size_t begin, size_t end) {
+        for (size_t channel = 0; channel < kAmountOfPrimaryColors; ++channel) {
+            ApplyLutToRows(lut.channels[channel], planes[channel], begin, end);
+        }
+    });
+}
+
+void ApplyLut(const ChannelLut& table, Plane& plane) {
+    ParallelFor(plane.height, [&](size_t, size_t begin, size_t end) {
+        ApplyLutToRows(table, plane, begin, end);
+    });
+}
+
+void ApplyLut(const ColorLut& lut, BMP& image) {
+    if (image.GetLayout() == PixelLayout::kGray && IsUniformLut(lut)) {
+        ApplyLut(lut.channels[0], image.Planes()[0]);
+    } else if (image.GetLayout() == PixelLayout::kIndexed) {
+        ApplyLut(lut, image.GetPalette());
+    } else if (image.GetLayout() == PixelLayout::kInterleaved) {
+        ApplyLut(lut, image.PixelMatrix());
+    } else {
+        image.SetLayout(PixelLayout::kPlanar);
+        ApplyLut(lut, image.Planes());
+    }
+}
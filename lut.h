@@ -0,0 +1,43 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <span>
+
+#include "bmp_processing.h"
+
+constexpr size_t kLutSize = kMaxRgb + 1;
+
+typedef std::array<uint8_t, kLutSize> ChannelLut;
+
+// One table per channel, in PixelColor order.
+struct ColorLut {
+    std::array<ChannelLut, kAmountOfPrimaryColors> channels;
+};
+
+// Tabulates function(level) for every level; results are rounded and clamped to [0, 255].
+template <typename Function>
+ChannelLut TabulateChannel(Function&& function) {
+    ChannelLut table;
+    for (int level = kMinRgb; level <= kMaxRgb; ++level) {
+        table[level] = static_cast<uint8_t>(
+                std::clamp(static_cast<int>(std::lround(function(level))), kMinRgb, kMaxRgb));
+    }
+    return table;
+}
+
+ColorLut MakeIdentityLut();
+ColorLut MakeUniformLut(const ChannelLut& table);
+// The table of applying first and then second.
+ColorLut ComposeLuts(const ColorLut& first, const ColorLut& second);
+void ApplyLut(const ColorLut& lut, PixelMatrix& pixels);
+void ApplyLut(const ColorLut& lut, std::span<PixelColor> colors);
+// One plane per channel, in PixelColor order.
+void ApplyLut(const ColorLut& lut, std::span<Plane> planes);
+void ApplyLut(const ChannelLut& table, Plane& plane);
+// Keeps the layout where it can: a gray image stays gray under a uniform table, an indexed one
+// only has its palette recoloured.
+void ApplyLut(const ColorLut& lut, BMP& image);
+bool IsUniformLut(const ColorLut& lut);
@@ -0,0 +1,95 @@
+#include "mapped_file.h"
+
+#include "exceptions.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+
+MappedFile::MappedFile(const std::string& path) {
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                              FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        throw FileProcessingException("can not open for reading " + path);
+    }
+    file_ = file;
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size)) {
+        Close();
+        throw FileProcessingException("can not read size of " + path);
+    }
+    size_ = static_cast<size_t>(size.QuadPart);
+    if (size_ == 0) {
+        return;
+    }
+    mapping_ = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mapping_ != nullptr) {
+        data_ = static_cast<const std::byte*>(MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0));
+    }
+    if (data_ == nullptr) {
+        Close();
+        throw FileProcessingException("can not map " + path);
+    }
+}
+
+void MappedFile::Close() {
+    if (data_ != nullptr) {
+        UnmapViewOfFile(data_);
+    }
+    if (mapping_ != nullptr) {
+        CloseHandle(mapping_);
+    }
+    if (file_ != nullptr) {
+        CloseHandle(file_);
+    }
+}
+
+#else
+
+MappedFile::MappedFile(const std::string& path) {
+    int file = open(path.c_str(), O_RDONLY);
+    if (file < 0) {
+        throw FileProcessingException("can not open for reading " + path);
+    }
+    struct stat status {};
+    if (fstat(file, &status) != 0) {
+        close(file);
+        throw FileProcessingException("can not read size of " + path);
+    }
+    size_ = static_cast<size_t>(status.st_size);
+    if (size_ != 0) {
+        void* data = mmap(nullptr, size_, PROT_READ, MAP_SHARED, file, 0);
+        if (data == MAP_FAILED) {
+            close(file);
+            throw FileProcessingException("can not map " + path);
+        }
+        data_ = static_cast<const std::byte*>(data);
+    }
+    // The mapping outlives the descriptor.
+    close(file);
+}
+
+void MappedFile::Close() {
+    if (data_ != nullptr) {
+        munmap(const_cast<std::byte*>(data_), size_);
+    }
+}
+
+#endif
+
+MappedFile::~MappedFile() {
+    Close();
+}
+
+std::span<const std::byte> MappedFile::Bytes() const {
+    return {data_, size_};
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstddef>
+#include <span>
+#include <string>
+
+// A whole file mapped read-only into memory, so pages are read on first touch and shared
+// between processes mapping the same file.
+class MappedFile {
+    const std::byte* data_ = nullptr;
+    size_t size_ = 0;
+#ifdef _WIN32
+    void* file_ = nullptr;
+    void* mapping_ = nullptr;
+#endif
+
+    void Close();
+
+public:
+    // Throws FileProcessingException if the file can not be opened or mapped.
+    explicit MappedFile(const std::string& path);
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    ~MappedFile();
+
+    std::span<const std::byte> Bytes() const;
+};
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+#include "bmp_processing.h"
+#include "simd.h"
+
+static_assert(sizeof(PixelColor) == kAmountOfPrimaryColors, "rows are read as packed r, g, b bytes");
+
+#ifdef IMAGE_PROCESSOR_X86
+
+constexpr size_t kPackedRgbPixelsPerStep = 16;
+
+typedef std::array<std::array<std::array<int8_t, kPackedRgbPixelsPerStep>, kAmountOfPrimaryColors>,
+                   kAmountOfPrimaryColors> PackedRgbMasks;
+
+// [part][channel]: pshufb mask collecting the channel of 16 packed pixels from the
+// part-th 16 bytes of them; lanes fed by another part are zeroed.
+constexpr PackedRgbMasks kDeinterleaveRgbMasks = [] {
+    PackedRgbMasks masks{};
+    for (size_t part = 0; part < kAmountOfPrimaryColors; ++part) {
+        for (size_t channel = 0; channel < kAmountOfPrimaryColors; ++channel) {
+            for (size_t lane = 0; lane < kPackedRgbPixelsPerStep; ++lane) {
+                size_t byte = lane * kAmountOfPrimaryColors + channel;
+                masks[part][channel][lane] = static_cast<int8_t>(
+                        byte / kPackedRgbPixelsPerStep == part ? byte % kPackedRgbPixelsPerStep : 0x80);
+            }
+        }
+    }
+    return masks;
+}();
+
+// [part][channel]: pshufb mask moving the channel's lanes to their bytes within the
+// part-th 16 bytes of packed pixels; bytes of other channels are zeroed.
+constexpr PackedRgbMasks kInterleaveRgbMasks = [] {
+    PackedRgbMasks masks{};
+    for (size_t part = 0; part < kAmountOfPrimaryColors; ++part) {
+        for (size_t channel = 0; channel < kAmountOfPrimaryColors; ++channel) {
+            for (size_t lane = 0; lane < kPackedRgbPixelsPerStep; ++lane) {
+                size_t byte = part * kPackedRgbPixelsPerStep + lane;
+                masks[part][channel][lane] = static_cast<int8_t>(
+                        byte % kAmountOfPrimaryColors == channel ? byte / kAmountOfPrimaryColors : 0x80);
+            }
+        }
+    }
+    return masks;
+}();
+
+// Splits 16 packed pixels into one register of bytes per channel.
+IMAGE_PROCESSOR_TARGET("sse4.1")
+inline void DeinterleaveRgbSse41(const PixelColor* pixels, __m128i* channels) {
+    const auto* bytes = reinterpret_cast<const __m128i*>(pixels);
+    const __m128i parts[kAmountOfPrimaryColors] = {_mm_loadu_si128(bytes), _mm_loadu_si128(bytes + 1),
+                                                   _mm_loadu_si128(bytes + 2)};
+    for (size_t channel = 0; channel < kAmountOfPrimaryColors; ++channel) {
+        channels[channel] = _mm_setzero_si128();
+        for (size_t part = 0; part < kAmountOfPrimaryColors; ++part) {
+            __m128i mask = _mm_loadu_si128(
+                    reinterpret_cast<const __m128i*>(kDeinterleaveRgbMasks[part][channel].data()));
+            channels[channel] = _mm_or_si128(channels[channel], _mm_shuffle_epi8(parts[part], mask));
+        }
+    }
+}
+
+// Inverse of DeinterleaveRgbSse41.
+IMAGE_PROCESSOR_TARGET("sse4.1")
+inline void InterleaveRgbSse41(const __m128i* channels, PixelColor* pixels) {
+    auto* bytes = reinterpret_cast<__m128i*>(pixels);
+    for (size_t part = 0; part < kAmountOfPrimaryColors; ++part) {
+        __m128i packed = _mm_setzero_si128();
+        for (size_t channel = 0; channel < kAmountOfPrimaryColors; ++channel) {
+            __m128i mask = _mm_loadu_si128(reinterpret_cast<const __m128i*>(kInterleaveRgbMasks[part][channel].data()));
+            packed = _mm_or_si128(packed, _mm_shuffle_epi8(channels[channel], mask));
+        }
+        _mm_storeu_si128(bytes + part, packed);
+    }
+}
+
+#endif
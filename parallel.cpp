@@ -0,0 +1,47 @@
+#include "parallel.h"
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+namespace {
+
+size_t& RequestedThreadCount() {
+    static size_t count = 0;
+    return count;
+}
+
+}  // namespace
+
+void SetThreadCount(size_t count) {
+    RequestedThreadCount() = count;
+}
+
+size_t GetThreadCount() {
+    if (RequestedThreadCount() != 0) {
+        return RequestedThreadCount();
+    }
+    return std::max(std::thread::hardware_concurrency(), 1U);
+}
+
+size_t GetBandsCount(size_t count) {
+    return std::max(std::min(GetThreadCount(), count), static_cast<size_t>(1));
+}
+
+void ParallelFor(size_t count, const std::function<void(size_t band_number, size_t begin, size_t end)>& body) {
+    size_t bands_count = GetBandsCount(count);
+    if (bands_count == 1) {
+        body(0, 0, count);
+        return;
+    }
+
+    std::vector<std::thread> threads;
+    threads.reserve(bands_count - 1);
+    for (size_t band = 1; band < bands_count; ++band) {
+        threads.emplace_back(body, band, count * band / bands_count, count * (band + 1) / bands_count);
+    }
+    body(0, 0, count / bands_count);
+    for (auto& thread : threads) {
+        thread.join();
+    }
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+
+// 0 means one thread per hardware thread.
+void SetThreadCount(size_t count);
+size_t GetThreadCount();
+
+// Splits [0, count) into contiguous bands, one per thread, in increasing order, and
+// returns when all of them are done. band_number is the index of the band, so callers can
+// keep per-band results and merge them in a fixed order.
+void ParallelFor(size_t count, const std::function<void(size_t band_number, size_t begin, size_t end)>& body);
+size_t GetBandsCount(size_t count);
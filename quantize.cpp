@@ -0,0 +1,333 @@
+#include "quantize.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <limits>
+#include <thread>
+
+#include "histogram.h"
+#include "parallel.h"
+
+namespace {
+
+typedef std::array<int, kAmountOfPrimaryColors> Color;
+
+// Band histograms count at most about 4 * kStatisticsSamplePixels samples, so their sums of
+// levels fit 32 bits; merged statistics do not need to.
+template <typename Count>
+struct ColorStatistics {
+    Count count = 0;
+    std::array<Count, kAmountOfPrimaryColors> sums{};
+
+    template <typename OtherCount>
+    void Add(const ColorStatistics<OtherCount>& other) {
+        count += other.count;
+        for (size_t channel = 0; channel < kAmountOfPrimaryColors; ++channel) {
+            sums[channel] += other.sums[channel];
+        }
+    }
+
+    Color GetMean() const {
+        Color mean;
+        for (size_t channel = 0; channel < kAmountOfPrimaryColors; ++channel) {
+            mean[channel] = static_cast<int>((sums[channel] + count / 2) / count);
+        }
+        return mean;
+    }
+};
+
+// An occupied histogram cell with the mean of the samples that fell into it.
+struct ColorCell {
+    ColorStatistics<uint64_t> statistics;
+    Color mean{};
+};
+
+// A run of cells, sorted along its longest axis when it is split.
+struct ColorBox {
+    size_t begin = 0;
+    size_t end = 0;
+    uint64_t count = 0;
+    size_t axis = 0;
+    int spread = 0;
+};
+
+Color ToColor(PixelColor pixel) {
+    return {pixel.r, pixel.g, pixel.b};
+}
+
+PixelColor ToPixelColor(const Color& color) {
+    return {static_cast<uint8_t>(color[0]), static_cast<uint8_t>(color[1]), static_cast<uint8_t>(color[2])};
+}
+
+int GetSquaredDistance(const Color& first, const Color& second) {
+    int distance = 0;
+    for (size_t channel = 0; channel < kAmountOfPrimaryColors; ++channel) {
+        distance += (first[channel] - second[channel]) * (first[channel] - second[channel]);
+    }
+    return distance;
+}
+
+// Ties go to the lower index.
+size_t FindNearest(const Palette& palette, const Color& color) {
+    size_t nearest = 0;
+    int nearest_distance = std::numeric_limits<int>::max();
+    for (size_t index = 0; index < palette.size(); ++index) {
+        int distance = GetSquaredDistance(ToColor(palette[index]), color);
+        if (distance < nearest_distance) {
+            nearest = index;
+            nearest_distance = distance;
+        }
+    }
+    return nearest;
+}
+
+std::vector<ColorCell> CollectCells(const PixelMatrix& pixels) {
+    size_t step = GetStatisticsStep(pixels.size(), pixels.empty() ? 0 : pixels[0].size());
+    size_t sampled_rows = (pixels.size() + step - 1) / step;
+    std::vector<std::vector<ColorStatistics<uint32_t>>> band_histograms(GetBandsCount(sampled_rows));
+    ParallelFor(sampled_rows, [&pixels, &band_histograms, step](size_t band_number, size_t begin, size_t end) {
+        auto& histogram = band_histograms[band_number];
+        histogram.resize(kQuantizeCellsCount);
+        for (size_t sample = begin; sample < end; ++sample) {
+            const auto& row = pixels[sample * step];
+            for (size_t x = 0; x < row.size(); x += step) {
+                auto& cell = histogram[GetQuantizeCell(row[x].r, row[x].g, row[x].b)];
+                ++cell.count;
+                cell.sums[0] += row[x].r;
+                cell.sums[1] += row[x].g;
+                cell.sums[2] += row[x].b;
+            }
+        }
+    });
+
+    std::vector<ColorCell> cells;
+    for (size_t cell_number = 0; cell_number < kQuantizeCellsCount; ++cell_number) {
+        ColorCell cell;
+        for (const auto& histogram : band_histograms) {
+            if (!histogram.empty()) {
+                cell.statistics.Add(histogram[cell_number]);
+            }
+        }
+        if (cell.statistics.count != 0) {
+            cell.mean = cell.statistics.GetMean();
+            cells.push_back(cell);
+        }
+    }
+    return cells;
+}
+
+ColorBox MakeBox(const std::vector<ColorCell>& cells, size_t begin, size_t end) {
+    ColorBox box{.begin = begin, .end = end};
+    Color low = cells[begin].mean;
+    Color high = cells[begin].mean;
+    for (size_t index = begin; index < end; ++index) {
+        box.count += cells[index].statistics.count;
+        for (size_t channel = 0; channel < kAmountOfPrimaryColors; ++channel) {
+            low[channel] = std::min(low[channel], cells[index].mean[channel]);
+            high[channel] = std::max(high[channel], cells[index].mean[channel]);
+        }
+    }
+    for (size_t channel = 0; channel < kAmountOfPrimaryColors; ++channel) {
+        if (high[channel] - low[channel] > box.spread) {
+            box.axis = channel;
+            box.spread = high[channel] - low[channel];
+        }
+    }
+    return box;
+}
+
+// Splits the box at the sample median of its longest axis; both halves keep at least one cell.
+std::pair<ColorBox, ColorBox> SplitBox(std::vector<ColorCell>& cells, const ColorBox& box) {
+    auto begin = cells.begin() + static_cast<std::ptrdiff_t>(box.begin);
+    auto end = cells.begin() + static_cast<std::ptrdiff_t>(box.end);
+    size_t axis = box.axis;
+    std::sort(begin, end, [axis](const ColorCell& first, const ColorCell& second) {
+        return first.mean[axis] < second.mean[axis];
+    });
+
+    size_t middle = box.begin + 1;
+    uint64_t below = cells[box.begin].statistics.count;
+    while (middle + 1 < box.end && below * 2 < box.count) {
+        below += cells[middle].statistics.count;
+        ++middle;
+    }
+    return {MakeBox(cells, box.begin, middle), MakeBox(cells, middle, box.end)};
+}
+
+// Boxes holding many samples spread over a long axis are split first.
+Palette CutMedians(std::vector<ColorCell>& cells, size_t colors_count) {
+    std::vector<ColorBox> boxes = {MakeBox(cells, 0, cells.size())};
+    while (boxes.size() < colors_count) {
+        auto widest = std::max_element(boxes.begin(), boxes.end(), [](const ColorBox& first, const ColorBox& second) {
+            return first.count * first.spread < second.count * second.spread;
+        });
+        if (widest->spread == 0) {
+            break;
+        }
+        auto [first, second] = SplitBox(cells, *widest);
+        *widest = first;
+        boxes.push_back(second);
+    }
+
+    Palette palette;
+    for (const auto& box : boxes) {
+        ColorStatistics<uint64_t> statistics;
+        for (size_t index = box.begin; index < box.end; ++index) {
+            statistics.Add(cells[index].statistics);
+        }
+        palette.push_back(ToPixelColor(statistics.GetMean()));
+    }
+    return palette;
+}
+
+// One Lloyd iteration: moves every colour to the mean of the samples of the cells nearest to it.
+void RefinePalette(const std::vector<ColorCell>& cells, Palette& palette) {
+    std::vector<std::vector<ColorStatistics<uint64_t>>> band_clusters(GetBandsCount(cells.size()));
+    ParallelFor(cells.size(), [&cells, &palette, &band_clusters](size_t band_number, size_t begin, size_t end) {
+        auto& clusters = band_clusters[band_number];
+        clusters.resize(palette.size());
+        for (size_t index = begin; index < end; ++index) {
+            clusters[FindNearest(palette, cells[index].mean)].Add(cells[index].statistics);
+        }
+    });
+
+    std::vector<ColorStatistics<uint64_t>> clusters(palette.size());
+    for (const auto& band : band_clusters) {
+        for (size_t index = 0; index < band.size(); ++index) {
+            clusters[index].Add(band[index]);
+        }
+    }
+    for (size_t index = 0; index < palette.size(); ++index) {
+        if (clusters[index].count != 0) {
+            palette[index] = ToPixelColor(clusters[index].GetMean());
+        }
+    }
+}
+
+// Errors are kept in sixteenths, the unit of the Floyd-Steinberg weights.
+typedef std::array<int32_t, kAmountOfPrimaryColors> DiffusedError;
+
+constexpr int32_t kDitherRightWeight = 7;
+constexpr int32_t kDitherBelowLeftWeight = 3;
+constexpr int32_t kDitherBelowWeight = 5;
+constexpr int32_t kDitherBelowRightWeight = 1;
+constexpr int kDitherWeightBits = 4;
+
+// Padded to a cache line, so neighbouring rows do not share one.
+struct alignas(64) RowProgress {
+    std::atomic<size_t> done_pixels = 0;
+};
+
+struct DitherState {
+    const PixelMatrix& pixels;
+    const Palette& palette;
+    const InverseColorMap& inverse_map;
+    Plane& indices;
+    // Errors pushed down into the row with the same parity. Row y reads its buffer while
+    // writing the other one, which row y - 1 reads, so both rows touch a pixel x only after
+    // row y - 1 has passed x + 1.
+    std::array<std::vector<DiffusedError>, 2> below;
+    std::vector<RowProgress> progress;
+};
+
+void WaitForRow(const RowProgress& progress, size_t pixels_count) {
+    while (progress.done_pixels.load(std::memory_order_acquire) < pixels_count) {
+        std::this_thread::yield();
+    }
+}
+
+void DitherRow(DitherState& state, size_t y) {
+    size_t width = state.indices.width;
+    const PixelColor* row = state.pixels[y].data();
+    uint8_t* indices = state.indices.Row(y);
+    const DiffusedError* incoming = state.below[y % 2].data();
+    DiffusedError* outgoing = state.below[(y + 1) % 2].data();
+
+    DiffusedError right{};
+    for (size_t block_begin = 0; block_begin < width; block_begin += kDitherBlockWidth) {
+        size_t block_end = std::min(block_begin + kDitherBlockWidth, width);
+        if (y > 0) {
+            WaitForRow(state.progress[y - 1], std::min(block_end + 1, width));
+        }
+        if (block_begin == 0) {
+            outgoing[0] = {};
+        }
+
+        for (size_t x = block_begin; x < block_end; ++x) {
+            Color color = ToColor(row[x]);
+            for (size_t channel = 0; channel < kAmountOfPrimaryColors; ++channel) {
+                int32_t error = incoming[x][channel] + right[channel];
+                color[channel] += (error + (1 << (kDitherWeightBits - 1))) >> kDitherWeightBits;
+                color[channel] = std::clamp(color[channel], kMinRgb, kMaxRgb);
+            }
+
+            uint8_t index = state.inverse_map.Find(color[0], color[1], color[2]);
+            indices[x] = index;
+            Color chosen = ToColor(state.palette[index]);
+            for (size_t channel = 0; channel < kAmountOfPrimaryColors; ++channel) {
+                int32_t error = color[channel] - chosen[channel];
+                right[channel] = error * kDitherRightWeight;
+                outgoing[x][channel] += error * kDitherBelowWeight;
+                if (x > 0) {
+                    outgoing[x - 1][channel] += error * kDitherBelowLeftWeight;
+                }
+                if (x + 1 < width) {
+                    outgoing[x + 1][channel] = error * kDitherBelowRightWeight;
+                }
+            }
+        }
+        state.progress[y].done_pixels.store(block_end, std::memory_order_release);
+    }
+}
+
+}  // namespace
+
+Palette BuildPalette(const PixelMatrix& pixels, size_t colors_count) {
+    std::vector<ColorCell> cells = CollectCells(pixels);
+    if (cells.empty()) {
+        return {};
+    }
+    Palette palette = CutMedians(cells, colors_count);
+    for (size_t iteration = 0; iteration < kQuantizeRefineIterations; ++iteration) {
+        RefinePalette(cells, palette);
+    }
+    return palette;
+}
+
+InverseColorMap::InverseColorMap(const Palette& palette) : indices_(kQuantizeCellsCount) {
+    constexpr size_t kCellMask = kQuantizeCellsPerChannel - 1;
+    constexpr int kCellCentre = 1 << (kQuantizeDroppedBits - 1);
+    ParallelFor(kQuantizeCellsCount, [this, &palette](size_t, size_t begin, size_t end) {
+        for (size_t cell = begin; cell < end; ++cell) {
+            Color centre = {static_cast<int>(cell >> (2 * kQuantizeCellBits)),
+                            static_cast<int>((cell >> kQuantizeCellBits) & kCellMask),
+                            static_cast<int>(cell & kCellMask)};
+            for (auto& level : centre) {
+                level = (level << kQuantizeDroppedBits) + kCellCentre;
+            }
+            indices_[cell] = static_cast<uint8_t>(FindNearest(palette, centre));
+        }
+    });
+}
+
+Plane DitherToPalette(const PixelMatrix& pixels, const Palette& palette, const InverseColorMap& inverse_map) {
+    size_t height = pixels.size();
+    size_t width = pixels.empty() ? 0 : pixels[0].size();
+    Plane indices(width, height);
+    DitherState state{.pixels = pixels,
+                      .palette = palette,
+                      .inverse_map = inverse_map,
+                      .indices = indices,
+                      .below = {std::vector<DiffusedError>(width), std::vector<DiffusedError>(width)},
+                      .progress = std::vector<RowProgress>(height)};
+
+    // One band per thread; each takes every bands_count-th row.
+    size_t bands_count = GetBandsCount(height);
+    ParallelFor(bands_count, [&state, height, bands_count](size_t band_number, size_t, size_t) {
+        for (size_t y = band_number; y < height; y += bands_count) {
+            DitherRow(state, y);
+        }
+    });
+    return indices;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "bmp_processing.h"
+
+// Colours are histogrammed and looked up by the top bits of each channel.
+constexpr size_t kQuantizeCellBits = 5;
+constexpr size_t kQuantizeCellsPerChannel = 1 << kQuantizeCellBits;
+constexpr size_t kQuantizeCellsCount = kQuantizeCellsPerChannel * kQuantizeCellsPerChannel *
+                                       kQuantizeCellsPerChannel;
+constexpr size_t kQuantizeRefineIterations = 3;
+// Pixels a dithered row handles between publishing its progress to the row below.
+constexpr size_t kDitherBlockWidth = 64;
+
+constexpr int kQuantizeDroppedBits = 8 - static_cast<int>(kQuantizeCellBits);
+
+// Red in the high bits, blue in the low ones.
+inline size_t GetQuantizeCell(int red, int green, int blue) {
+    return (static_cast<size_t>(red >> kQuantizeDroppedBits) << (2 * kQuantizeCellBits)) |
+           (static_cast<size_t>(green >> kQuantizeDroppedBits) << kQuantizeCellBits) |
+           static_cast<size_t>(blue >> kQuantizeDroppedBits);
+}
+
+// Median cut over a sampled colour histogram (see GetStatisticsStep), then a few k-means
+// passes over the occupied cells. Gives at most colors_count colours, fewer if the image has
+// fewer occupied cells, and the same palette for any thread count.
+Palette BuildPalette(const PixelMatrix& pixels, size_t colors_count);
+
+// Nearest palette entry to the centre of every cell, so mapping a colour is a single lookup.
+class InverseColorMap {
+    std::vector<uint8_t> indices_;
+
+public:
+    explicit InverseColorMap(const Palette& palette);
+
+    uint8_t Find(int red, int green, int blue) const {
+        return indices_[GetQuantizeCell(red, green, blue)];
+    }
+};
+
+// Floyd-Steinberg error diffusion. A pixel needs the errors of its three neighbours in the
+// row above, so rows run on all threads as a wavefront: each row trails the one above by a
+// block of pixels. The result does not depend on the thread count.
+Plane DitherToPalette(const PixelMatrix& pixels, const Palette& palette, const InverseColorMap& inverse_map);
@@ -0,0 +1,413 @@
+#include "remap.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <random>
+#include <tuple>
+
+#include "exceptions.h"
+#include "parallel.h"
+#include "simd.h"
+
+namespace {
+
+// A cache file is used only if its header matches the one a fresh map would get, byte for byte.
+constexpr uint32_t kRemapFileMagic = 0x4D525049;
+constexpr uint32_t kRemapFileVersion = 1;
+constexpr std::string_view kRemapFileExtension = ".remap";
+
+struct RemapFileHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t kind;
+    uint32_t coefficients_count;
+    uint64_t width;
+    uint64_t height;
+    double coefficients[kPerspectiveCoefficientsCount];
+};
+
+static_assert(sizeof(RemapFileHeader) == kRemapFileHeaderBytesCount);
+
+constexpr uint64_t kFnvOffsetBasis = 0xCBF29CE484222325;
+constexpr uint64_t kFnvPrime = 0x100000001B3;
+
+RemapFileHeader MakeRemapFileHeader(const RemapModel& model, size_t width, size_t height) {
+    RemapFileHeader header{};
+    header.magic = kRemapFileMagic;
+    header.version = kRemapFileVersion;
+    header.kind = static_cast<uint32_t>(model.kind);
+    header.coefficients_count = static_cast<uint32_t>(model.coefficients.size());
+    header.width = width;
+    header.height = height;
+    std::copy(model.coefficients.begin(), model.coefficients.end(), header.coefficients);
+    return header;
+}
+
+// The name carries a hash of the header, so maps of different models and sizes never share a file.
+std::string GetRemapFileName(const RemapFileHeader& header) {
+    uint64_t hash = kFnvOffsetBasis;
+    const auto* bytes = reinterpret_cast<const unsigned char*>(&header);
+    for (size_t index = 0; index < sizeof(header); ++index) {
+        hash = (hash ^ bytes[index]) * kFnvPrime;
+    }
+    char hex[17];
+    std::snprintf(hex, sizeof(hex), "%016llx", static_cast<unsigned long long>(hash));
+    std::string_view kind = header.kind == static_cast<uint32_t>(RemapKind::kLens) ? kRemapLensName
+                                                                                   : kRemapPerspectiveName;
+    return std::string(kind) + "_" + std::to_string(header.width) + "x" + std::to_string(header.height) + "_" +
+           hex + std::string(kRemapFileExtension);
+}
+
+// Another run may read the cache at the same time, so the file appears under its name only
+// once it is complete. The cache only saves time, so a directory that can not be written leaves
+// no file behind and returns false instead of failing the run.
+bool WriteRemapFile(const std::filesystem::path& path, const RemapFileHeader& header, const RemapMap& map) {
+    std::error_code error;
+    std::filesystem::create_directories(path.parent_path(), error);
+    if (error) {
+        return false;
+    }
+    std::filesystem::path temporary = path;
+    temporary += "." + std::to_string(std::random_device()());
+    bool written = false;
+    {
+        std::ofstream out(temporary, std::ios::out | std::ios::binary);
+        if (out) {
+            out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            for (const auto& row : {&RemapMap::RowXs, &RemapMap::RowYs}) {
+                out.write(reinterpret_cast<const char*>((map.*row)(0)),
+                          static_cast<std::streamsize>(map.Width() * map.Height() * sizeof(float)));
+            }
+            out.close();
+            written = static_cast<bool>(out);
+        }
+    }
+    if (written) {
+        std::filesystem::rename(temporary, path, error);
+        written = !error;
+    }
+    if (!written) {
+        std::filesystem::remove(temporary, error);
+    }
+    return written;
+}
+
+std::shared_ptr<const RemapMap> OpenCachedRemapMap(const RemapModel& model, size_t width, size_t height,
+                                                   const std::string& cache_directory) {
+    RemapFileHeader header = MakeRemapFileHeader(model, width, height);
+    std::filesystem::path path = std::filesystem::path(cache_directory) / GetRemapFileName(header);
+    std::error_code error;
+    if (std::filesystem::exists(path, error)) {
+        try {
+            auto file = std::make_unique<MappedFile>(path.string());
+            std::span<const std::byte> bytes = file->Bytes();
+            if (bytes.size() == sizeof(header) + 2 * width * height * sizeof(float) &&
+                std::memcmp(bytes.data(), &header, sizeof(header)) == 0) {
+                return std::make_shared<RemapMap>(std::move(file), bytes.subspan(sizeof(header)), width, height);
+            }
+        } catch (const FileProcessingException&) {
+            // An unreadable cache file is computed again, like a stale one.
+        }
+    }
+    auto map = std::make_shared<RemapMap>(model, width, height);
+    WriteRemapFile(path, header, *map);
+    return map;
+}
+
+void FillLensRow(const std::vector<double>& coefficients, size_t width, size_t height, size_t y, float* xs,
+                 float* ys) {
+    double k1 = coefficients[0];
+    double k2 = coefficients.size() == kLensMaxCoefficientsCount ? coefficients[1] : 0;
+    double centre_x = (static_cast<double>(width) - 1) / 2;
+    double centre_y = (static_cast<double>(height) - 1) / 2;
+    double radius_squared = std::max(centre_x * centre_x + centre_y * centre_y, 1.0);
+    double dy = static_cast<double>(y) - centre_y;
+    for (size_t x = 0; x < width; ++x) {
+        double dx = static_cast<double>(x) - centre_x;
+        double distance = (dx * dx + dy * dy) / radius_squared;
+        double scale = 1 + (k1 + k2 * distance) * distance;
+        xs[x] = static_cast<float>(centre_x + dx * scale);
+        ys[x] = static_cast<float>(centre_y + dy * scale);
+    }
+}
+
+void FillPerspectiveRow(const Homography& to_source, size_t width, size_t y, float* xs, float* ys) {
+    auto row = static_cast<double>(y);
+    for (size_t x = 0; x < width; ++x) {
+        auto column = static_cast<double>(x);
+        double w = to_source[2][0] * column + to_source[2][1] * row + to_source[2][2];
+        if (w <= 0) {
+            // Behind the camera: nothing there to sample.
+            xs[x] = std::numeric_limits<float>::quiet_NaN();
+            ys[x] = std::numeric_limits<float>::quiet_NaN();
+            continue;
+        }
+        xs[x] = static_cast<float>((to_source[0][0] * column + to_source[0][1] * row + to_source[0][2]) / w);
+        ys[x] = static_cast<float>((to_source[1][0] * column + to_source[1][1] * row + to_source[1][2]) / w);
+    }
+}
+
+// Samples of one destination row segment, xs and ys are its source coordinates.
+struct RemapSpan {
+    std::span<const Plane> sources;
+    const float* levels;
+    const float* xs;
+    const float* ys;
+    float last_x;
+    float last_y;
+};
+
+// NaN coordinates fail the comparisons too, so they count as outside.
+void RemapPixelScalar(const RemapSpan& span, size_t x, float* const* values) {
+    float source_x = span.xs[x];
+    float source_y = span.ys[x];
+    if (!(source_x >= 0 && source_x <= span.last_x && source_y >= 0 && source_y <= span.last_y)) {
+        for (size_t plane = 0; plane < span.sources.size(); ++plane) {
+            values[plane][x] = 0;
+        }
+        return;
+    }
+    float floor_x = std::floor(source_x);
+    float floor_y = std::floor(source_y);
+    float fraction_x = source_x - floor_x;
+    float fraction_y = source_y - floor_y;
+    auto left = static_cast<size_t>(floor_x);
+    auto top = static_cast<size_t>(floor_y);
+    size_t right = BorderCoordinate(left, 1, span.sources[0].width);
+    size_t bottom = BorderCoordinate(top, 1, span.sources[0].height);
+
+    for (size_t plane = 0; plane < span.sources.size(); ++plane) {
+        const uint8_t* top_row = span.sources[plane].Row(top);
+        const uint8_t* bottom_row = span.sources[plane].Row(bottom);
+        float top_value = span.levels[top_row[left]] * (1 - fraction_x) + span.levels[top_row[right]] * fraction_x;
+        float bottom_value = span.levels[bottom_row[left]] * (1 - fraction_x) +
+                             span.levels[bottom_row[right]] * fraction_x;
+        values[plane][x] = top_value * (1 - fraction_y) + bottom_value * fraction_y;
+    }
+}
+
+#ifdef IMAGE_PROCESSOR_X86
+
+// As in WarpPlanes, each gather reads four bytes from the left tap on, so a vector only runs
+// when all its coordinates are inside and its taps at least four pixels from the right edge
+// and above the last row; other vectors go through RemapPixelScalar.
+IMAGE_PROCESSOR_TARGET("avx2")
+size_t RemapSpanAvx2(const RemapSpan& span, size_t count, float* const* values) {
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 one = _mm256_set1_ps(1.0f);
+    const __m256 last_x = _mm256_set1_ps(span.last_x);
+    const __m256 last_y = _mm256_set1_ps(span.last_y);
+    const __m256i byte_mask = _mm256_set1_epi32(0xFF);
+    const __m256i last_left = _mm256_set1_epi32(static_cast<int>(span.sources[0].width) - 4);
+    const __m256i last_top = _mm256_set1_epi32(static_cast<int>(span.sources[0].height) - 2);
+    const __m256i stride = _mm256_set1_epi32(static_cast<int>(span.sources[0].stride));
+    for (const auto& source : span.sources) {
+        if (source.stride != span.sources[0].stride) {
+            return 0;
+        }
+    }
+    size_t x = 0;
+    for (; x + kRemapLanes <= count; x += kRemapLanes) {
+        __m256 source_x = _mm256_loadu_ps(span.xs + x);
+        __m256 source_y = _mm256_loadu_ps(span.ys + x);
+        __m256 inside = _mm256_and_ps(
+                _mm256_and_ps(_mm256_cmp_ps(source_x, zero, _CMP_GE_OQ), _mm256_cmp_ps(source_x, last_x, _CMP_LE_OQ)),
+                _mm256_and_ps(_mm256_cmp_ps(source_y, zero, _CMP_GE_OQ), _mm256_cmp_ps(source_y, last_y, _CMP_LE_OQ)));
+        __m256 floor_x = _mm256_floor_ps(source_x);
+        __m256 floor_y = _mm256_floor_ps(source_y);
+        __m256i left = _mm256_cvttps_epi32(floor_x);
+        __m256i top = _mm256_cvttps_epi32(floor_y);
+        __m256i near_edge = _mm256_or_si256(_mm256_cmpgt_epi32(left, last_left), _mm256_cmpgt_epi32(top, last_top));
+        if (_mm256_movemask_ps(inside) != 0xFF || !_mm256_testz_si256(near_edge, near_edge)) {
+            for (size_t lane = 0; lane < kRemapLanes; ++lane) {
+                RemapPixelScalar(span, x + lane, values);
+            }
+            continue;
+        }
+
+        __m256 fraction_x = _mm256_sub_ps(source_x, floor_x);
+        __m256 fraction_y = _mm256_sub_ps(source_y, floor_y);
+        __m256 rest_x = _mm256_sub_ps(one, fraction_x);
+        __m256 rest_y = _mm256_sub_ps(one, fraction_y);
+        __m256i offsets = _mm256_add_epi32(_mm256_mullo_epi32(top, stride), left);
+        for (size_t plane = 0; plane < span.sources.size(); ++plane) {
+            const uint8_t* top_row = span.sources[plane].Row(0);
+            const uint8_t* bottom_row = span.sources[plane].Row(1);
+            __m256i top_taps = _mm256_i32gather_epi32(reinterpret_cast<const int*>(top_row), offsets, 1);
+            __m256i bottom_taps = _mm256_i32gather_epi32(reinterpret_cast<const int*>(bottom_row), offsets, 1);
+            __m256 top_left = _mm256_i32gather_ps(span.levels, _mm256_and_si256(top_taps, byte_mask), 4);
+            __m256 top_right = _mm256_i32gather_ps(
+                    span.levels, _mm256_and_si256(_mm256_srli_epi32(top_taps, 8), byte_mask), 4);
+            __m256 bottom_left = _mm256_i32gather_ps(span.levels, _mm256_and_si256(bottom_taps, byte_mask), 4);
+            __m256 bottom_right = _mm256_i32gather_ps(
+                    span.levels, _mm256_and_si256(_mm256_srli_epi32(bottom_taps, 8), byte_mask), 4);
+            __m256 top_value = _mm256_add_ps(_mm256_mul_ps(top_left, rest_x), _mm256_mul_ps(top_right, fraction_x));
+            __m256 bottom_value = _mm256_add_ps(_mm256_mul_ps(bottom_left, rest_x),
+                                                _mm256_mul_ps(bottom_right, fraction_x));
+            _mm256_storeu_ps(values[plane] + x, _mm256_add_ps(_mm256_mul_ps(top_value, rest_y),
+                                                              _mm256_mul_ps(bottom_value, fraction_y)));
+        }
+    }
+    return x;
+}
+
+#endif
+
+// Returns the first pixel left for RemapPixelScalar.
+size_t RemapSpanVector(const RemapSpan& span, size_t count, float* const* values) {
+#ifdef IMAGE_PROCESSOR_X86
+    if (GetSimdLevel() >= SimdLevel::kAvx2) {
+        return RemapSpanAvx2(span, count, values);
+    }
+#endif
+    return 0;
+}
+
+}  // namespace
+
+Homography MakeHomography(std::span<const double> coefficients) {
+    Homography homography;
+    for (size_t index = 0; index < kPerspectiveCoefficientsCount; ++index) {
+        homography[index / kHomographySize][index % kHomographySize] = coefficients[index];
+    }
+    homography[kHomographySize - 1][kHomographySize - 1] = 1;
+    return homography;
+}
+
+std::optional<Homography> InvertHomography(const Homography& homography) {
+    const auto& h = homography;
+    Homography adjugate;
+    for (size_t row = 0; row < kHomographySize; ++row) {
+        for (size_t column = 0; column < kHomographySize; ++column) {
+            size_t first_row = (column + 1) % kHomographySize;
+            size_t second_row = (column + 2) % kHomographySize;
+            size_t first_column = (row + 1) % kHomographySize;
+            size_t second_column = (row + 2) % kHomographySize;
+            adjugate[row][column] = h[first_row][first_column] * h[second_row][second_column] -
+                                    h[first_row][second_column] * h[second_row][first_column];
+        }
+    }
+    double determinant = h[0][0] * adjugate[0][0] + h[0][1] * adjugate[1][0] + h[0][2] * adjugate[2][0];
+    if (determinant == 0 || !std::isfinite(determinant)) {
+        return std::nullopt;
+    }
+    for (auto& row : adjugate) {
+        for (auto& value : row) {
+            value /= determinant;
+        }
+    }
+    return adjugate;
+}
+
+RemapMap::RemapMap(const RemapModel& model, size_t width, size_t height)
+    : width_(width), height_(height), coordinates_(2 * width * height) {
+    xs_ = coordinates_.data();
+    ys_ = xs_ + width * height;
+    float* xs = coordinates_.data();
+    float* ys = xs + width * height;
+    // The filter checked that the homography is invertible.
+    Homography to_source = model.kind == RemapKind::kPerspective
+                                   ? *InvertHomography(MakeHomography(model.coefficients))
+                                   : Homography{};
+    ParallelFor(height, [&](size_t, size_t begin, size_t end) {
+        for (size_t y = begin; y < end; ++y) {
+            if (model.kind == RemapKind::kLens) {
+                FillLensRow(model.coefficients, width, height, y, xs + y * width, ys + y * width);
+            } else {
+                FillPerspectiveRow(to_source, width, y, xs + y * width, ys + y * width);
+            }
+        }
+    });
+}
+
+RemapMap::RemapMap(std::unique_ptr<MappedFile> file, std::span<const std::byte> bytes, size_t width,
+                   size_t height)
+    : width_(width), height_(height), file_(std::move(file)) {
+    xs_ = reinterpret_cast<const float*>(bytes.data());
+    ys_ = xs_ + width * height;
+}
+
+size_t RemapMap::Width() const {
+    return width_;
+}
+
+size_t RemapMap::Height() const {
+    return height_;
+}
+
+const float* RemapMap::RowXs(size_t y) const {
+    return xs_ + y * width_;
+}
+
+const float* RemapMap::RowYs(size_t y) const {
+    return ys_ + y * width_;
+}
+
+std::shared_ptr<const RemapMap> GetRemapMap(const RemapModel& model, size_t width, size_t height,
+                                            const std::string& cache_directory) {
+    static std::mutex mutex;
+    static std::map<std::tuple<RemapModel, size_t, size_t>, std::shared_ptr<const RemapMap>> maps;
+
+    std::lock_guard lock(mutex);
+    auto key = std::make_tuple(model, width, height);
+    auto found = maps.find(key);
+    if (found != maps.end()) {
+        return found->second;
+    }
+    std::shared_ptr<const RemapMap> map = cache_directory.empty()
+                                                  ? std::make_shared<const RemapMap>(model, width, height)
+                                                  : OpenCachedRemapMap(model, width, height, cache_directory);
+    maps.emplace(std::move(key), map);
+    return map;
+}
+
+void RemapPlanes(std::span<const Plane> sources, std::span<Plane> destinations, const RemapMap& map,
+                 LightMode light) {
+    const RowKernels<float> kernels = ActiveRowKernels<float>(light);
+    std::array<uint8_t, kMaxRgb + 1> all_levels;
+    for (size_t level = 0; level <= kMaxRgb; ++level) {
+        all_levels[level] = static_cast<uint8_t>(level);
+    }
+    std::array<float, kMaxRgb + 1> levels;
+    kernels.widen(all_levels.data(), levels.data(), levels.size());
+
+    size_t width = map.Width();
+    size_t height = map.Height();
+    auto last_x = static_cast<float>(sources[0].width) - 1;
+    auto last_y = static_cast<float>(sources[0].height) - 1;
+    ParallelFor((height + kRemapTileSize - 1) / kRemapTileSize, [&](size_t, size_t begin, size_t end) {
+        std::vector<float> buffer(sources.size() * kRemapTileSize);
+        std::vector<float*> values(sources.size());
+        for (size_t plane = 0; plane < sources.size(); ++plane) {
+            values[plane] = buffer.data() + plane * kRemapTileSize;
+        }
+
+        for (size_t tile_y = begin * kRemapTileSize; tile_y < std::min(end * kRemapTileSize, height);
+             tile_y += kRemapTileSize) {
+            for (size_t tile_x = 0; tile_x < width; tile_x += kRemapTileSize) {
+                size_t tile_width = std::min(kRemapTileSize, width - tile_x);
+                for (size_t y = tile_y; y < std::min(tile_y + kRemapTileSize, height); ++y) {
+                    RemapSpan span{.sources = sources,
+                                   .levels = levels.data(),
+                                   .xs = map.RowXs(y) + tile_x,
+                                   .ys = map.RowYs(y) + tile_x,
+                                   .last_x = last_x,
+                                   .last_y = last_y};
+                    for (size_t x = RemapSpanVector(span, tile_width, values.data()); x < tile_width; ++x) {
+                        RemapPixelScalar(span, x, values.data());
+                    }
+                    for (size_t plane = 0; plane < sources.size(); ++plane) {
+                        kernels.narrow(values[plane], destinations[plane].Row(y) + tile_x, tile_width);
+                    }
+                }
+            }
+        }
+    });
+}
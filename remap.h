@@ -0,0 +1,90 @@
+#pragma once
+
+#include <array>
+#include <compare>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "bmp_processing.h"
+#include "convolution.h"
+#include "mapped_file.h"
+
+constexpr std::string_view kRemapLensName = "lens";
+constexpr std::string_view kRemapPerspectiveName = "perspective";
+
+// Cache files hold a header of this size, then the x plane and the y plane of the map.
+constexpr size_t kRemapFileHeaderBytesCount = 96;
+
+constexpr size_t kLensMinCoefficientsCount = 1;
+constexpr size_t kLensMaxCoefficientsCount = 2;
+constexpr size_t kHomographySize = 3;
+// The last entry of a homography is 1.
+constexpr size_t kPerspectiveCoefficientsCount = kHomographySize * kHomographySize - 1;
+
+// Destination pixels are sampled this many at a time in vectors.
+constexpr size_t kRemapLanes = 8;
+// Destination pixels are sampled in square tiles of this side, so the source pixels a tile
+// reads, which lie close together for lens and perspective maps, stay in cache.
+constexpr size_t kRemapTileSize = 64;
+
+// Maps (x, y, 1) to (X, Y, W), which stands for the point (X / W, Y / W).
+typedef std::array<std::array<double, kHomographySize>, kHomographySize> Homography;
+
+// coefficients are the first kPerspectiveCoefficientsCount entries, row by row.
+Homography MakeHomography(std::span<const double> coefficients);
+// No value for a homography that collapses the plane.
+std::optional<Homography> InvertHomography(const Homography& homography);
+
+enum class RemapKind : unsigned char {
+    kLens,
+    kPerspective,
+};
+
+// kLens: k1 [k2]. The corrected pixel p samples the photo at c + (p - c)(1 + k1 r^2 + k2 r^4),
+// where c is the centre and r the distance from it over half the diagonal (Brown's radial
+// model), so k1 > 0 removes pincushion and k1 < 0 barrel distortion.
+// kPerspective: the first eight entries of the homography taking the photo to the corrected
+// image, row by row; the map samples through its inverse.
+struct RemapModel {
+    RemapKind kind = RemapKind::kLens;
+    std::vector<double> coefficients;
+
+    auto operator<=>(const RemapModel&) const = default;
+};
+
+// Source coordinates of every pixel of a destination, x and y in separate planes of floats.
+// The coordinates live in memory or in a mapped cache file.
+class RemapMap {
+    size_t width_ = 0;
+    size_t height_ = 0;
+    std::vector<float> coordinates_;
+    std::unique_ptr<MappedFile> file_;
+    const float* xs_ = nullptr;
+    const float* ys_ = nullptr;
+
+public:
+    RemapMap(const RemapModel& model, size_t width, size_t height);
+    // bytes must hold 2 * width * height floats and outlive the map with file.
+    RemapMap(std::unique_ptr<MappedFile> file, std::span<const std::byte> bytes, size_t width, size_t height);
+
+    size_t Width() const;
+    size_t Height() const;
+    const float* RowXs(size_t y) const;
+    const float* RowYs(size_t y) const;
+};
+
+// Maps are computed once per model and size and kept for the whole run. With a non-empty
+// cache_directory they are also written there and later runs map the file instead of
+// computing it again; a directory that can not be written leaves the maps in memory only.
+std::shared_ptr<const RemapMap> GetRemapMap(const RemapModel& model, size_t width, size_t height,
+                                            const std::string& cache_directory = {});
+
+// Sets every destination pixel to its source plane sampled bilinearly at the coordinates of
+// map, or to 0 if they fall outside the source. Tile rows are split across threads; the vector
+// path gathers the taps of eight pixels at once with the same float arithmetic as the scalar one.
+void RemapPlanes(std::span<const Plane> sources, std::span<Plane> destinations, const RemapMap& map,
+                 LightMode light = LightMode::kEncoded);
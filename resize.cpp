@@ -0,0 +1,213 @@
+#include "resize.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numbers>
+
+#include "parallel.h"
+#include "simd.h"
+
+namespace {
+
+double GetSupport(ResizeFilter filter) {
+    switch (filter) {
+        case ResizeFilter::kBilinear:
+            return kBilinearSupport;
+        case ResizeFilter::kBicubic:
+            return kBicubicSupport;
+        default:
+            return kLanczos3Support;
+    }
+}
+
+double Sinc(double x) {
+    if (x == 0) {
+        return 1;
+    }
+    return std::sin(std::numbers::pi * x) / (std::numbers::pi * x);
+}
+
+double EvaluateFilter(ResizeFilter filter, double x) {
+    x = std::abs(x);
+    switch (filter) {
+        case ResizeFilter::kBilinear:
+            return x < kBilinearSupport ? 1 - x : 0;
+        case ResizeFilter::kBicubic: {
+            constexpr double a = kBicubicSharpness;
+            if (x < 1) {
+                return ((a + 2) * x - (a + 3)) * x * x + 1;
+            }
+            if (x < kBicubicSupport) {
+                return ((a * x - 5 * a) * x + 8 * a) * x - 4 * a;
+            }
+            return 0;
+        }
+        default:
+            return x < kLanczos3Support ? Sinc(x) * Sinc(x / kLanczos3Support) : 0;
+    }
+}
+
+size_t RoundUpToLanes(size_t count) {
+    return (count + kResampleLanes - 1) / kResampleLanes * kResampleLanes;
+}
+
+// Vector kernels keep kResampleLanes partial sums, the scalar one keeps the same sums lane by
+// lane and all of them reduce the lanes in this order.
+float ReduceLanes(const float* lanes) {
+    return ((lanes[0] + lanes[4]) + (lanes[2] + lanes[6])) + ((lanes[1] + lanes[5]) + (lanes[3] + lanes[7]));
+}
+
+void ResampleRowScalar(const float* source, const ResampleWeights& weights, float* destination, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        const float* taps = source + weights.starts[i];
+        const float* row_weights = weights.weights.data() + i * weights.stride;
+        float lanes[kResampleLanes] = {};
+        for (size_t tap = 0; tap < weights.stride; tap += kResampleLanes) {
+            for (size_t lane = 0; lane < kResampleLanes; ++lane) {
+                lanes[lane] += row_weights[tap + lane] * taps[tap + lane];
+            }
+        }
+        destination[i] = ReduceLanes(lanes);
+    }
+}
+
+#ifdef IMAGE_PROCESSOR_X86
+
+IMAGE_PROCESSOR_TARGET("sse4.1")
+float ReduceLanesSse41(__m128 low, __m128 high) {
+    __m128 pairs = _mm_add_ps(low, high);
+    __m128 quads = _mm_add_ps(pairs, _mm_movehl_ps(pairs, pairs));
+    return _mm_cvtss_f32(_mm_add_ss(quads, _mm_shuffle_ps(quads, quads, 1)));
+}
+
+IMAGE_PROCESSOR_TARGET("sse4.1")
+void ResampleRowSse41(const float* source, const ResampleWeights& weights, float* destination, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        const float* taps = source + weights.starts[i];
+        const float* row_weights = weights.weights.data() + i * weights.stride;
+        __m128 low = _mm_setzero_ps();
+        __m128 high = _mm_setzero_ps();
+        for (size_t tap = 0; tap < weights.stride; tap += kResampleLanes) {
+            low = _mm_add_ps(low, _mm_mul_ps(_mm_loadu_ps(row_weights + tap), _mm_loadu_ps(taps + tap)));
+            high = _mm_add_ps(high, _mm_mul_ps(_mm_loadu_ps(row_weights + tap + 4), _mm_loadu_ps(taps + tap + 4)));
+        }
+        destination[i] = ReduceLanesSse41(low, high);
+    }
+}
+
+IMAGE_PROCESSOR_TARGET("avx2")
+void ResampleRowAvx2(const float* source, const ResampleWeights& weights, float* destination, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        const float* taps = source + weights.starts[i];
+        const float* row_weights = weights.weights.data() + i * weights.stride;
+        __m256 sum = _mm256_setzero_ps();
+        for (size_t tap = 0; tap < weights.stride; tap += kResampleLanes) {
+            __m256 product = _mm256_mul_ps(_mm256_loadu_ps(row_weights + tap), _mm256_loadu_ps(taps + tap));
+            sum = _mm256_add_ps(sum, product);
+        }
+        destination[i] = ReduceLanesSse41(_mm256_castps256_ps128(sum), _mm256_extractf128_ps(sum, 1));
+    }
+}
+
+#endif
+
+void ResampleRow(const float* source, const ResampleWeights& weights, float* destination, size_t count) {
+#ifdef IMAGE_PROCESSOR_X86
+    if (GetSimdLevel() >= SimdLevel::kAvx2) {
+        ResampleRowAvx2(source, weights, destination, count);
+        return;
+    }
+    if (GetSimdLevel() >= SimdLevel::kSse41) {
+        ResampleRowSse41(source, weights, destination, count);
+        return;
+    }
+#endif
+    ResampleRowScalar(source, weights, destination, count);
+}
+
+}  // namespace
+
+ResampleWeights ComputeResampleWeights(size_t source_size, size_t destination_size, ResizeFilter filter) {
+    double scale = static_cast<double>(source_size) / static_cast<double>(destination_size);
+    ResampleWeights weights;
+    weights.starts.resize(destination_size);
+    weights.taps_counts.resize(destination_size);
+
+    if (filter == ResizeFilter::kNearest) {
+        weights.stride = kResampleLanes;
+        weights.weights.resize(destination_size * weights.stride);
+        for (size_t i = 0; i < destination_size; ++i) {
+            auto nearest = static_cast<size_t>((static_cast<double>(i) + 0.5) * scale);
+            weights.starts[i] = static_cast<uint32_t>(std::min(nearest, source_size - 1));
+            weights.taps_counts[i] = 1;
+            weights.weights[i * weights.stride] = 1;
+        }
+        return weights;
+    }
+
+    double filter_scale = std::max(scale, 1.0);
+    double support = GetSupport(filter) * filter_scale;
+    weights.stride = RoundUpToLanes(static_cast<size_t>(std::ceil(support)) * 2 + 1);
+    weights.weights.resize(destination_size * weights.stride);
+    std::vector<double> taps(weights.stride);
+    for (size_t i = 0; i < destination_size; ++i) {
+        double centre = (static_cast<double>(i) + 0.5) * scale;
+        auto begin = static_cast<size_t>(std::max(centre - support + 0.5, 0.0));
+        auto end = std::min(static_cast<size_t>(std::max(centre + support + 0.5, 0.0)), source_size);
+        end = std::max(end, std::min(begin + 1, source_size));
+        begin = std::min(begin, end - 1);
+
+        double sum = 0;
+        for (size_t position = begin; position < end; ++position) {
+            taps[position - begin] = EvaluateFilter(filter, (static_cast<double>(position) + 0.5 - centre) /
+                                                                    filter_scale);
+            sum += taps[position - begin];
+        }
+        weights.starts[i] = static_cast<uint32_t>(begin);
+        weights.taps_counts[i] = static_cast<uint32_t>(end - begin);
+        for (size_t tap = 0; tap < end - begin; ++tap) {
+            weights.weights[i * weights.stride + tap] = static_cast<float>(sum != 0 ? taps[tap] / sum : 0);
+        }
+    }
+    return weights;
+}
+
+void ResamplePlane(const Plane& source, Plane& destination, const ResampleWeights& horizontal,
+                   const ResampleWeights& vertical, LightMode light) {
+    const RowKernels<float> kernels = ActiveRowKernels<float>(light);
+    size_t width = horizontal.starts.size();
+    size_t height = vertical.starts.size();
+
+    // Only source rows some output row reads go through the horizontal pass.
+    std::vector<size_t> used_rows;
+    for (size_t y = 0; y < height; ++y) {
+        size_t first = used_rows.empty() ? 0 : used_rows.back() + 1;
+        for (size_t row = std::max<size_t>(vertical.starts[y], first);
+             row < vertical.starts[y] + vertical.taps_counts[y]; ++row) {
+            used_rows.push_back(row);
+        }
+    }
+    std::vector<float> filtered(source.height * width);
+    ParallelFor(used_rows.size(), [&](size_t, size_t begin, size_t end) {
+        // Taps may run up to a stride past the row, into zeros.
+        std::vector<float> widened(source.width + horizontal.stride);
+        for (size_t index = begin; index < end; ++index) {
+            kernels.widen(source.Row(used_rows[index]), widened.data(), source.width);
+            ResampleRow(widened.data(), horizontal, filtered.data() + used_rows[index] * width, width);
+        }
+    });
+
+    destination = Plane(width, height);
+    ParallelFor(height, [&](size_t, size_t begin, size_t end) {
+        std::vector<float> accumulator(width);
+        for (size_t y = begin; y < end; ++y) {
+            std::fill(accumulator.begin(), accumulator.end(), 0.0f);
+            const float* row_weights = vertical.weights.data() + y * vertical.stride;
+            for (size_t tap = 0; tap < vertical.taps_counts[y]; ++tap) {
+                kernels.accumulate(filtered.data() + (vertical.starts[y] + tap) * width, row_weights[tap],
+                                   accumulator.data(), width);
+            }
+            kernels.narrow(accumulator.data(), destination.Row(y), width);
+        }
+    });
+}
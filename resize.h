@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+#include "bmp_processing.h"
+#include "convolution.h"
+
+constexpr std::string_view kResizeNearestName = "nearest";
+constexpr std::string_view kResizeBilinearName = "bilinear";
+constexpr std::string_view kResizeBicubicName = "bicubic";
+constexpr std::string_view kResizeLanczos3Name = "lanczos3";
+
+constexpr double kBilinearSupport = 1.0;
+constexpr double kBicubicSupport = 2.0;
+// Keys' cubic with a = -0.5 (Catmull-Rom).
+constexpr double kBicubicSharpness = -0.5;
+constexpr double kLanczos3Support = 3.0;
+
+// Tap rows of ResampleWeights are padded to whole vectors of this many floats.
+constexpr size_t kResampleLanes = 8;
+
+enum class ResizeFilter : unsigned char {
+    kNearest,
+    kBilinear,
+    kBicubic,
+    kLanczos3,
+};
+
+// Weights of one pass, one entry per output position: it reads taps_counts[i] source
+// positions from starts[i] with weights[i * stride ...]. The rest of a weight row is zero.
+struct ResampleWeights {
+    size_t stride = 0;
+    std::vector<uint32_t> starts;
+    std::vector<uint32_t> taps_counts;
+    std::vector<float> weights;
+};
+
+// Sample centres are aligned, (i + 0.5) * source_size / destination_size. When shrinking,
+// the filter is stretched by the scale so every source pixel contributes; near the borders
+// the taps that would leave the image are dropped and the rest renormalised.
+ResampleWeights ComputeResampleWeights(size_t source_size, size_t destination_size, ResizeFilter filter);
+
+// A horizontal pass into float rows, then a vertical one, each split into row bands across
+// threads. Every SIMD level gives identical pixels.
+void ResamplePlane(const Plane& source, Plane& destination, const ResampleWeights& horizontal,
+                   const ResampleWeights& vertical, LightMode light = LightMode::kEncoded);
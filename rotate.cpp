@@ -0,0 +1,201 @@
+#include "rotate.h"
+
+#include <algorithm>
+
+#include "parallel.h"
+#include "simd.h"
+
+namespace {
+
+typedef void (*BlockTranspose)(const uint8_t* source, std::ptrdiff_t source_stride, uint8_t* destination,
+                               std::ptrdiff_t destination_stride);
+
+// Row x of the destination block gets column x of the source block.
+void TransposeBlockScalar(const uint8_t* source, std::ptrdiff_t source_stride, uint8_t* destination,
+                          std::ptrdiff_t destination_stride, size_t width, size_t height) {
+    for (size_t x = 0; x < width; ++x) {
+        uint8_t* row = destination + static_cast<std::ptrdiff_t>(x) * destination_stride;
+        for (size_t y = 0; y < height; ++y) {
+            row[y] = source[static_cast<std::ptrdiff_t>(y) * source_stride + static_cast<std::ptrdiff_t>(x)];
+        }
+    }
+}
+
+void TransposeFullBlockScalar(const uint8_t* source, std::ptrdiff_t source_stride, uint8_t* destination,
+                              std::ptrdiff_t destination_stride) {
+    TransposeBlockScalar(source, source_stride, destination, destination_stride, kTransposeBlockSize,
+                         kTransposeBlockSize);
+}
+
+#ifdef IMAGE_PROCESSOR_X86
+
+// Interleaving bytes, then words, then double words of row pairs leaves two columns in each register.
+IMAGE_PROCESSOR_TARGET("sse4.1")
+void TransposeFullBlockSse41(const uint8_t* source, std::ptrdiff_t source_stride, uint8_t* destination,
+                             std::ptrdiff_t destination_stride) {
+    __m128i rows[kTransposeBlockSize];
+    for (size_t y = 0; y < kTransposeBlockSize; ++y) {
+        rows[y] = _mm_loadl_epi64(
+                reinterpret_cast<const __m128i*>(source + static_cast<std::ptrdiff_t>(y) * source_stride));
+    }
+    __m128i bytes0 = _mm_unpacklo_epi8(rows[0], rows[1]);
+    __m128i bytes1 = _mm_unpacklo_epi8(rows[2], rows[3]);
+    __m128i bytes2 = _mm_unpacklo_epi8(rows[4], rows[5]);
+    __m128i bytes3 = _mm_unpacklo_epi8(rows[6], rows[7]);
+    __m128i words0 = _mm_unpacklo_epi16(bytes0, bytes1);
+    __m128i words1 = _mm_unpackhi_epi16(bytes0, bytes1);
+    __m128i words2 = _mm_unpacklo_epi16(bytes2, bytes3);
+    __m128i words3 = _mm_unpackhi_epi16(bytes2, bytes3);
+    const __m128i columns[] = {_mm_unpacklo_epi32(words0, words2), _mm_unpackhi_epi32(words0, words2),
+                               _mm_unpacklo_epi32(words1, words3), _mm_unpackhi_epi32(words1, words3)};
+    for (size_t pair = 0; pair < kTransposeBlockSize / 2; ++pair) {
+        auto* even = reinterpret_cast<__m128i*>(destination + static_cast<std::ptrdiff_t>(2 * pair) *
+                                                                      destination_stride);
+        auto* odd = reinterpret_cast<__m128i*>(destination + static_cast<std::ptrdiff_t>(2 * pair + 1) *
+                                                                     destination_stride);
+        _mm_storel_epi64(even, columns[pair]);
+        _mm_storel_epi64(odd, _mm_unpackhi_epi64(columns[pair], columns[pair]));
+    }
+}
+
+IMAGE_PROCESSOR_TARGET("sse4.1")
+size_t ReverseRowSse41(const uint8_t* source, uint8_t* destination, size_t count) {
+    const __m128i reverse = _mm_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+    size_t x = 0;
+    for (; x + 16 <= count; x += 16) {
+        __m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(source + x));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(destination + count - 16 - x), _mm_shuffle_epi8(pixels, reverse));
+    }
+    return x;
+}
+
+// Returns how many pixels were swapped at each end, the caller reverses the middle.
+IMAGE_PROCESSOR_TARGET("sse4.1")
+size_t ReverseRowInPlaceSse41(uint8_t* row, size_t count) {
+    const __m128i reverse = _mm_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+    size_t x = 0;
+    for (; x + 32 <= count - x; x += 16) {
+        auto* left = reinterpret_cast<__m128i*>(row + x);
+        auto* right = reinterpret_cast<__m128i*>(row + count - 16 - x);
+        __m128i left_pixels = _mm_loadu_si128(left);
+        _mm_storeu_si128(left, _mm_shuffle_epi8(_mm_loadu_si128(right), reverse));
+        _mm_storeu_si128(right, _mm_shuffle_epi8(left_pixels, reverse));
+    }
+    return x;
+}
+
+#endif
+
+BlockTranspose GetFullBlockTranspose() {
+#ifdef IMAGE_PROCESSOR_X86
+    if (GetSimdLevel() >= SimdLevel::kSse41) {
+        return TransposeFullBlockSse41;
+    }
+#endif
+    return TransposeFullBlockScalar;
+}
+
+// Returns how many leading pixels were moved, the caller finishes the row in scalar.
+size_t ReverseRowVector(const uint8_t* source, uint8_t* destination, size_t count) {
+#ifdef IMAGE_PROCESSOR_X86
+    if (GetSimdLevel() >= SimdLevel::kSse41) {
+        return ReverseRowSse41(source, destination, count);
+    }
+#endif
+    return 0;
+}
+
+size_t ReverseRowInPlaceVector(uint8_t* row, size_t count) {
+#ifdef IMAGE_PROCESSOR_X86
+    if (GetSimdLevel() >= SimdLevel::kSse41) {
+        return ReverseRowInPlaceSse41(row, count);
+    }
+#endif
+    return 0;
+}
+
+// The source is read with its rows reversed when reverse_source_rows is set, transposed, and
+// written with the rows reversed when reverse_destination_rows is set.
+void TransposePlane(const Plane& source, Plane& destination, bool reverse_source_rows,
+                    bool reverse_destination_rows) {
+    destination = Plane(source.height, source.width);
+    std::ptrdiff_t source_stride = source.stride;
+    std::ptrdiff_t destination_stride = destination.stride;
+    auto source_row = [&](size_t y) {
+        return source.Row(reverse_source_rows ? source.height - 1 - y : y);
+    };
+    auto destination_row = [&](size_t y) {
+        return destination.Row(reverse_destination_rows ? destination.height - 1 - y : y);
+    };
+    source_stride = reverse_source_rows ? -source_stride : source_stride;
+    destination_stride = reverse_destination_rows ? -destination_stride : destination_stride;
+    BlockTranspose transpose_full_block = GetFullBlockTranspose();
+
+    // A band of source column tiles is a band of destination rows.
+    size_t tiles_count = (source.width + kTransposeTileSize - 1) / kTransposeTileSize;
+    ParallelFor(tiles_count, [&](size_t, size_t begin, size_t end) {
+        size_t band_end = std::min(end * kTransposeTileSize, source.width);
+        for (size_t tile_y = 0; tile_y < source.height; tile_y += kTransposeTileSize) {
+            size_t tile_y_end = std::min(tile_y + kTransposeTileSize, source.height);
+            for (size_t tile_x = begin * kTransposeTileSize; tile_x < band_end; tile_x += kTransposeTileSize) {
+                size_t tile_x_end = std::min(tile_x + kTransposeTileSize, source.width);
+                for (size_t y = tile_y; y < tile_y_end; y += kTransposeBlockSize) {
+                    size_t block_height = std::min(kTransposeBlockSize, tile_y_end - y);
+                    for (size_t x = tile_x; x < tile_x_end; x += kTransposeBlockSize) {
+                        size_t block_width = std::min(kTransposeBlockSize, tile_x_end - x);
+                        const uint8_t* source_block = source_row(y) + x;
+                        uint8_t* destination_block = destination_row(x) + y;
+                        if (block_width == kTransposeBlockSize && block_height == kTransposeBlockSize) {
+                            transpose_full_block(source_block, source_stride, destination_block,
+                                                 destination_stride);
+                        } else {
+                            TransposeBlockScalar(source_block, source_stride, destination_block,
+                                                 destination_stride, block_width, block_height);
+                        }
+                    }
+                }
+            }
+        }
+    });
+}
+
+void RotatePlaneHalfTurn(const Plane& source, Plane& destination) {
+    destination = Plane(source.width, source.height);
+    ParallelFor(source.height, [&](size_t, size_t begin, size_t end) {
+        for (size_t y = begin; y < end; ++y) {
+            const uint8_t* row = source.Row(y);
+            uint8_t* reversed = destination.Row(source.height - 1 - y);
+            for (size_t x = ReverseRowVector(row, reversed, source.width); x < source.width; ++x) {
+                reversed[source.width - 1 - x] = row[x];
+            }
+        }
+    });
+}
+
+}  // namespace
+
+void FlipPlaneColumns(Plane& plane) {
+    ParallelFor(plane.height, [&plane](size_t, size_t begin, size_t end) {
+        for (size_t y = begin; y < end; ++y) {
+            uint8_t* row = plane.Row(y);
+            size_t swapped = ReverseRowInPlaceVector(row, plane.width);
+            std::reverse(row + swapped, row + plane.width - swapped);
+        }
+    });
+}
+
+void RotatePlane(const Plane& source, Plane& destination, Rotation rotation) {
+    switch (rotation) {
+        case Rotation::kRotate90:
+            TransposePlane(source, destination, true, false);
+            return;
+        case Rotation::kRotate180:
+            RotatePlaneHalfTurn(source, destination);
+            return;
+        case Rotation::kRotate270:
+            TransposePlane(source, destination, false, true);
+            return;
+        default:
+            TransposePlane(source, destination, false, false);
+    }
+}
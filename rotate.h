@@ -0,0 +1,25 @@
+#pragma once
+
+#include <cstdint>
+
+#include "bmp_processing.h"
+
+// Planes are transposed in square tiles of this many pixels that fit in L1 with their
+// destination, and each tile in blocks that are transposed in registers.
+constexpr size_t kTransposeTileSize = 64;
+constexpr size_t kTransposeBlockSize = 8;
+
+// Rotations are clockwise. kTranspose mirrors the image about its main diagonal.
+enum class Rotation : unsigned char {
+    kRotate90,
+    kRotate180,
+    kRotate270,
+    kTranspose,
+};
+
+// Every rotation but kRotate180 swaps width and height. Those go through a tiled transpose, split
+// into bands of destination rows across threads; kRotate180 reverses every row.
+void RotatePlane(const Plane& source, Plane& destination, Rotation rotation);
+// Mirrors every row in place, swapping vectors from both ends, split into bands of rows across
+// threads. A vertical flip needs no copy, see Plane::FlipRows.
+void FlipPlaneColumns(Plane& plane);
@@ -0,0 +1,63 @@
+#include "simd.h"
+
+#include <algorithm>
+
+namespace {
+
+SimdLevel DetectSupportedSimdLevel() {
+#if defined(IMAGE_PROCESSOR_X86) && (defined(__GNUC__) || defined(__clang__))
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) {
+        return SimdLevel::kAvx512;
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        return SimdLevel::kAvx2;
+    }
+    if (__builtin_cpu_supports("sse4.1")) {
+        return SimdLevel::kSse41;
+    }
+#elif defined(IMAGE_PROCESSOR_X86) && defined(_MSC_VER)
+    constexpr int kSse41Bit = 1 << 19;
+    constexpr int kOsxsaveBit = 1 << 27;
+    constexpr int kAvx2Bit = 1 << 5;
+    constexpr int kAvx512Bit = 1 << 16;
+    constexpr unsigned long long kAvxStateMask = 0x6;
+    constexpr unsigned long long kAvx512StateMask = 0xE6;
+
+    int registers[4];
+    __cpuid(registers, 1);
+    bool has_sse41 = registers[2] & kSse41Bit;
+    bool has_os_avx = (registers[2] & kOsxsaveBit) && (_xgetbv(0) & kAvxStateMask) == kAvxStateMask;
+    __cpuidex(registers, 7, 0);
+    if (has_os_avx && (registers[1] & kAvx512Bit) && (_xgetbv(0) & kAvx512StateMask) == kAvx512StateMask) {
+        return SimdLevel::kAvx512;
+    }
+    if (has_os_avx && (registers[1] & kAvx2Bit)) {
+        return SimdLevel::kAvx2;
+    }
+    if (has_sse41) {
+        return SimdLevel::kSse41;
+    }
+#endif
+    return SimdLevel::kScalar;
+}
+
+SimdLevel& ActiveSimdLevel() {
+    static SimdLevel level = DetectSimdLevel();
+    return level;
+}
+
+}  // namespace
+
+SimdLevel DetectSimdLevel() {
+    static const SimdLevel kSupportedLevel = DetectSupportedSimdLevel();
+    return kSupportedLevel;
+}
+
+SimdLevel GetSimdLevel() {
+    return ActiveSimdLevel();
+}
+
+void SetSimdLevel(SimdLevel level) {
+    ActiveSimdLevel() = std::min(level, DetectSimdLevel());
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define IMAGE_PROCESSOR_X86
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+#endif
+
+// Kernels for a level above the compile-time baseline are tagged with the instruction set
+// they use and only called after runtime dispatch picked that level.
+#if defined(__GNUC__) || defined(__clang__)
+#define IMAGE_PROCESSOR_TARGET(isa) __attribute__((target(isa)))
+#else
+#define IMAGE_PROCESSOR_TARGET(isa)
+#endif
+
+enum class SimdLevel : unsigned char {
+    kScalar,
+    kSse41,
+    kAvx2,
+    kAvx512,
+};
+
+SimdLevel DetectSimdLevel();
+SimdLevel GetSimdLevel();
+// Levels above the one supported by the CPU are lowered to DetectSimdLevel().
+void SetSimdLevel(SimdLevel level);
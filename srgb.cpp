@@ -0,0 +1,174 @@
+#include "srgb.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "simd.h"
+
+namespace {
+
+// Thresholds of neighbouring levels are at least 1 / (255 * 12.92) apart, more than a bucket,
+// so the level at the start of a bucket is either the answer or one below it.
+static_assert(kLinearToSrgbBucketsCount > kMaxRgb * kSrgbLinearSlope);
+
+template <typename Value>
+struct LinearToSrgbTables {
+    // thresholds[level] is the linear value from which level is the nearest one; the last
+    // entry is never reached.
+    std::array<Value, kSrgbLevelsCount + 1> thresholds{};
+    // 32-bit entries so the vector path can gather them.
+    std::array<int32_t, kLinearToSrgbBucketsCount + 1> bucket_levels{};
+
+    LinearToSrgbTables() {
+        for (size_t level = 1; level < kSrgbLevelsCount; ++level) {
+            thresholds[level] = static_cast<Value>(DecodeSrgb((static_cast<double>(level) - 0.5) / kMaxRgb));
+        }
+        thresholds[kSrgbLevelsCount] = std::numeric_limits<Value>::infinity();
+        size_t level = 0;
+        for (size_t bucket = 0; bucket <= kLinearToSrgbBucketsCount; ++bucket) {
+            auto linear = static_cast<Value>(bucket) / kLinearToSrgbBucketsCount;
+            while (linear >= thresholds[level + 1]) {
+                ++level;
+            }
+            bucket_levels[bucket] = static_cast<int32_t>(level);
+        }
+    }
+
+    // NaN is taken as 0: std::max returns its first argument when the comparison fails.
+    uint8_t Encode(Value linear) const {
+        linear = std::min(std::max(static_cast<Value>(0), linear), static_cast<Value>(1));
+        int32_t level = bucket_levels[static_cast<int32_t>(linear * kLinearToSrgbBucketsCount)];
+        return static_cast<uint8_t>(level + (linear >= thresholds[level + 1]));
+    }
+};
+
+template <typename Value>
+const LinearToSrgbTables<Value>& GetLinearToSrgbTables() {
+    static const LinearToSrgbTables<Value> tables;
+    return tables;
+}
+
+#ifdef IMAGE_PROCESSOR_X86
+
+IMAGE_PROCESSOR_TARGET("avx2")
+size_t DecodeSrgbRowAvx2(const std::array<float, kSrgbLevelsCount>& table, const uint8_t* source,
+                         float* destination, size_t count) {
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i levels = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(source + i)));
+        _mm256_storeu_ps(destination + i, _mm256_i32gather_ps(table.data(), levels, sizeof(float)));
+    }
+    return i;
+}
+
+// Same steps as LinearToSrgbTables::Encode, eight pixels at a time.
+IMAGE_PROCESSOR_TARGET("avx2")
+size_t EncodeSrgbRowAvx2(const LinearToSrgbTables<float>& tables, const float* source, uint8_t* destination,
+                         size_t count) {
+    const __m256 buckets_count = _mm256_set1_ps(kLinearToSrgbBucketsCount);
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 one = _mm256_set1_ps(1.0f);
+    const __m256i one_level = _mm256_set1_epi32(1);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        // maxps returns its second operand for NaN lanes.
+        __m256 linear = _mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(source + i), zero), one);
+        __m256i bucket = _mm256_cvttps_epi32(_mm256_mul_ps(linear, buckets_count));
+        __m256i level = _mm256_i32gather_epi32(tables.bucket_levels.data(), bucket, sizeof(int32_t));
+        __m256 next_threshold = _mm256_i32gather_ps(tables.thresholds.data(), _mm256_add_epi32(level, one_level),
+                                                    sizeof(float));
+        __m256i step = _mm256_castps_si256(_mm256_cmp_ps(linear, next_threshold, _CMP_GE_OQ));
+        level = _mm256_sub_epi32(level, step);
+        __m128i words = _mm_packs_epi32(_mm256_castsi256_si128(level), _mm256_extracti128_si256(level, 1));
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(destination + i), _mm_packus_epi16(words, words));
+    }
+    return i;
+}
+
+#endif
+
+template <typename Value>
+size_t DecodeSrgbRowVector(const std::array<Value, kSrgbLevelsCount>&, const uint8_t*, Value*, size_t) {
+    return 0;
+}
+
+template <typename Value>
+size_t EncodeSrgbRowVector(const LinearToSrgbTables<Value>&, const Value*, uint8_t*, size_t) {
+    return 0;
+}
+
+#ifdef IMAGE_PROCESSOR_X86
+template <>
+size_t DecodeSrgbRowVector<float>(const std::array<float, kSrgbLevelsCount>& table, const uint8_t* source,
+                                  float* destination, size_t count) {
+    if (GetSimdLevel() >= SimdLevel::kAvx2) {
+        return DecodeSrgbRowAvx2(table, source, destination, count);
+    }
+    return 0;
+}
+
+template <>
+size_t EncodeSrgbRowVector<float>(const LinearToSrgbTables<float>& tables, const float* source,
+                                  uint8_t* destination, size_t count) {
+    if (GetSimdLevel() >= SimdLevel::kAvx2) {
+        return EncodeSrgbRowAvx2(tables, source, destination, count);
+    }
+    return 0;
+}
+#endif
+
+}  // namespace
+
+double DecodeSrgb(double encoded) {
+    if (encoded <= kSrgbLinearThreshold) {
+        return encoded / kSrgbLinearSlope;
+    }
+    return std::pow((encoded + kSrgbOffset) / (1 + kSrgbOffset), kSrgbGamma);
+}
+
+double EncodeSrgb(double linear) {
+    if (linear <= kSrgbLinearThreshold / kSrgbLinearSlope) {
+        return linear * kSrgbLinearSlope;
+    }
+    return (1 + kSrgbOffset) * std::pow(linear, 1 / kSrgbGamma) - kSrgbOffset;
+}
+
+template <typename Value>
+const std::array<Value, kSrgbLevelsCount>& GetSrgbToLinearTable() {
+    static const std::array<Value, kSrgbLevelsCount> table = [] {
+        std::array<Value, kSrgbLevelsCount> levels;
+        for (size_t level = 0; level < kSrgbLevelsCount; ++level) {
+            levels[level] = static_cast<Value>(DecodeSrgb(static_cast<double>(level) / kMaxRgb));
+        }
+        return levels;
+    }();
+    return table;
+}
+
+uint8_t LinearToSrgb(double linear) {
+    return GetLinearToSrgbTables<double>().Encode(linear);
+}
+
+template <typename Value>
+void DecodeSrgbRow(const uint8_t* source, Value* destination, size_t count) {
+    const std::array<Value, kSrgbLevelsCount>& table = GetSrgbToLinearTable<Value>();
+    for (size_t i = DecodeSrgbRowVector(table, source, destination, count); i < count; ++i) {
+        destination[i] = table[source[i]];
+    }
+}
+
+template <typename Value>
+void EncodeSrgbRow(const Value* source, uint8_t* destination, size_t count) {
+    const LinearToSrgbTables<Value>& tables = GetLinearToSrgbTables<Value>();
+    for (size_t i = EncodeSrgbRowVector(tables, source, destination, count); i < count; ++i) {
+        destination[i] = tables.Encode(source[i]);
+    }
+}
+
+template const std::array<float, kSrgbLevelsCount>& GetSrgbToLinearTable<float>();
+template const std::array<double, kSrgbLevelsCount>& GetSrgbToLinearTable<double>();
+template void DecodeSrgbRow<float>(const uint8_t* source, float* destination, size_t count);
+template void DecodeSrgbRow<double>(const uint8_t* source, double* destination, size_t count);
+template void EncodeSrgbRow<float>(const float* source, uint8_t* destination, size_t count);
+template void EncodeSrgbRow<double>(const double* source, uint8_t* destination, size_t count);
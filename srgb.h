@@ -0,0 +1,32 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+#include "bmp_processing.h"
+
+constexpr size_t kSrgbLevelsCount = kMaxRgb + 1;
+// Linear values are bucketed by their top bits before the exact threshold check; the
+// steepest part of the curve spans less than one level per bucket.
+constexpr size_t kLinearToSrgbBucketsCount = 4096;
+
+constexpr double kSrgbLinearThreshold = 0.04045;
+constexpr double kSrgbLinearSlope = 12.92;
+constexpr double kSrgbOffset = 0.055;
+constexpr double kSrgbGamma = 2.4;
+
+// The sRGB transfer function and its inverse on [0, 1].
+double DecodeSrgb(double encoded);
+double EncodeSrgb(double linear);
+
+// Linear light of every encoded level.
+template <typename Value>
+const std::array<Value, kSrgbLevelsCount>& GetSrgbToLinearTable();
+
+// The level nearest to EncodeSrgb(linear) * 255; linear is clamped to [0, 1].
+uint8_t LinearToSrgb(double linear);
+
+template <typename Value>
+void DecodeSrgbRow(const uint8_t* source, Value* destination, size_t count);
+template <typename Value>
+void EncodeSrgbRow(const Value* source, uint8_t* destination, size_t count);
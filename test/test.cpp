@@ -1,11 +1,18 @@
 #define CATCH_CONFIG_MAIN
 #include "catch.hpp"
 
+#include <cstring>
+#include <filesystem>
+
 #include "..\bmp_processing.h"
 #include "..\console_read.h"
+#include "..\convolution.h"
 #include "..\exceptions.h"
 #include "..\filters.h"
 #include "..\filters_processing.h"
+#include "..\grayscale.h"
+#include "..\parallel.h"
+#include "..\srgb.h"
 
 void CheckMatricesEquality(const PixelMatrix& gotten, const PixelMatrix& expected) {
     REQUIRE(gotten.size() == expected.size());
@@ -19,6 +26,53 @@ void CheckMatricesEquality(const PixelMatrix& gotten, const PixelMatrix& expecte
     }
 }
 
+PixelMatrix MakeRandomPixels(size_t width, size_t height, unsigned seed) {
+    std::mt19937 generator(seed);
+    std::uniform_int_distribution<int> distribution(kMinRgb, kMaxRgb);
+    PixelMatrix pixels(height, std::vector<PixelColor>(width));
+    for (auto& row : pixels) {
+        for (auto& pixel : row) {
+            pixel = {static_cast<uint8_t>(distribution(generator)), static_cast<uint8_t>(distribution(generator)),
+                     static_cast<uint8_t>(distribution(generator))};
+        }
+    }
+    return pixels;
+}
+
+BMP MakeImage(const PixelMatrix& pixels) {
+    BMP image;
+    image.ResizeHeight(pixels.size());
+    image.ResizeWidth(pixels.empty() ? 0 : pixels[0].size());
+    image.PixelMatrix() = pixels;
+    return image;
+}
+
+PixelMatrix ApplyToPixels(const PixelMatrix& pixels, const std::vector<Filter>& filters,
+                          const ProcessingOptions& options = {}) {
+    BMP image = MakeImage(pixels);
+    ApplyFilters(filters, image, options);
+    return image.PixelMatrix();
+}
+
+// The scalar kernels are the reference: every vector level the CPU has and a run on three
+// threads must give the same pixels.
+void CheckSimdAndThreadsAgree(const PixelMatrix& pixels, const std::vector<Filter>& filters,
+                              const ProcessingOptions& options = {}) {
+    SetSimdLevel(SimdLevel::kScalar);
+    PixelMatrix expected = ApplyToPixels(pixels, filters, options);
+    for (auto level : {SimdLevel::kSse41, SimdLevel::kAvx2, SimdLevel::kAvx512}) {
+        if (level > DetectSimdLevel()) {
+            continue;
+        }
+        SetSimdLevel(level);
+        CheckMatricesEquality(ApplyToPixels(pixels, filters, options), expected);
+    }
+    SetSimdLevel(DetectSimdLevel());
+    ProcessingOptions threaded = options;
+    threaded.threads = 3;
+    CheckMatricesEquality(ApplyToPixels(pixels, filters, threaded), expected);
+}
+
 TEST_CASE("ConsoleRead") {
     {
         Parser parser;
@@ -76,6 +130,19 @@ TEST_CASE("ConsoleRead") {
         REQUIRE(args.filters[1].filter_name == "-gs");
         REQUIRE(args.filters.size() == 2);
     }
+    {
+        Parser parser;
+
+        constexpr size_t filters_count = 3;
+        const char* test_arguments[] = {".\\image_processor", ".\\examples\\example.bmp",
+                                        ".\\output\\program_test.bmp", "-brightness", "-20", "-neg"};
+
+        auto args = parser(kMinimalAmountOfArgs + filters_count, const_cast<char**>(test_arguments));
+        REQUIRE(args.filters[0].filter_name == "-brightness");
+        REQUIRE(args.filters[0].filter_params[0] == "-20");
+        REQUIRE(args.filters[1].filter_name == "-neg");
+        REQUIRE(args.filters.size() == 2);
+    }
 }
 
 TEST_CASE("FIleProcessing") {
@@ -211,6 +278,189 @@ TEST_CASE("FilterCrop") {
         REQUIRE(image.PixelMatrix()[0].size() == 3);
         REQUIRE(image.GetWidth() == 3);
     }
+    {
+        constexpr size_t height = 9;
+        constexpr size_t width = 13;
+        PixelMatrix pixels(height, std::vector<PixelColor>(width));
+        for (size_t y = 0; y < height; ++y) {
+            for (size_t x = 0; x < width; ++x) {
+                pixels[y][x] = {static_cast<uint8_t>(y), static_cast<uint8_t>(x), static_cast<uint8_t>(x * y)};
+            }
+        }
+        BMP interleaved = MakeImage(pixels);
+        BMP planar = interleaved;
+        planar.SetLayout(PixelLayout::kPlanar);
+        BMP flipped = planar;
+        flipped.FlipRows();
+
+        Crop({"5", "20", "6", "3"}).Apply(interleaved);
+        Crop({"5", "20", "6", "3"}).Apply(planar);
+        Crop({"5", "20", "6", "3"}).Apply(flipped);
+        REQUIRE(planar.GetLayout() == PixelLayout::kPlanar);
+        REQUIRE(planar.GetWidth() == 5);
+        REQUIRE(planar.GetHeight() == 6);
+        REQUIRE(planar.Planes()[0].data.size() == width * height);
+        REQUIRE(!planar.Planes()[0].IsCompact());
+        for (size_t y = 0; y < 6; ++y) {
+            for (size_t x = 0; x < 5; ++x) {
+                REQUIRE(interleaved.PixelMatrix()[y][x].r == pixels[y + 3][x + 6].r);
+                REQUIRE(interleaved.PixelMatrix()[y][x].b == pixels[y + 3][x + 6].b);
+                REQUIRE(planar.Planes()[1].Row(y)[x] == x + 6);
+                REQUIRE(flipped.Planes()[0].Row(y)[x] == height - 1 - (y + 3));
+            }
+        }
+
+        BMP compact = planar;
+        for (auto& plane : compact.Planes()) {
+            plane.Compact();
+            REQUIRE(plane.IsCompact());
+        }
+        std::vector<Filter> chain = {Filter{.filter_name = "-blur", .filter_params = {"1.5"}},
+                                     Filter{.filter_name = "-crop", .filter_params = {"3", "3", "1", "2"}},
+                                     Filter{.filter_name = "-rotate", .filter_params = {"90"}}};
+        ApplyFilters(chain, planar);
+        ApplyFilters(chain, compact);
+        for (size_t channel = 0; channel < kAmountOfPrimaryColors; ++channel) {
+            REQUIRE(planar.Planes()[channel] == compact.Planes()[channel]);
+        }
+
+        REQUIRE_THROWS_AS(Crop({"1", "1", "5", "0"}).Apply(planar), FiltersProcessingException);
+        REQUIRE_THROWS_AS(Crop({"1", "1", "0"}), FiltersProcessingException);
+        REQUIRE_THROWS_AS(Crop({"0", "1", "0", "0"}), FiltersProcessingException);
+
+        // A leading crop keeps only the region while decoding, for 24-bit and paletted files alike.
+        BMP source = MakeImage(pixels);
+        std::string path = "test_crop.bmp";
+        std::string gray_path = "test_crop_gray.bmp";
+        source.Save(path);
+        BMP gray = source;
+        gray.SetLayout(PixelLayout::kGray);
+        gray.Save(gray_path, kPalettedBitsPerPixel);
+        Filter crop{"-crop", {"5", "20", "6", "3"}};
+        for (const auto& chain : {std::vector<Filter>{crop}, std::vector<Filter>{crop, Filter{"-rotate", {"90"}}},
+                                  std::vector<Filter>{Filter{"-crop", {"4", "4"}}, Filter{"-sharp", {}}}}) {
+            for (const auto& file : {path, gray_path}) {
+                BMP streamed;
+                OpenAndApplyFilters(file, chain, streamed);
+                BMP opened;
+                opened.Open(file);
+                ApplyFilters(chain, opened);
+                CheckMatricesEquality(streamed.PixelMatrix(), opened.PixelMatrix());
+            }
+        }
+        BMP cropped;
+        OpenAndApplyFilters(path, {crop}, cropped);
+        REQUIRE(cropped.GetLayout() == PixelLayout::kPlanar);
+        REQUIRE(cropped.Planes()[0].data.size() == 5 * 6);
+        REQUIRE(cropped.Planes()[2].Row(5)[4] == pixels[8][10].b);
+        REQUIRE_THROWS_AS(OpenAndApplyFilters(path, {Filter{"-crop", {"1", "1", "13", "0"}}}, cropped),
+                          FiltersProcessingException);
+        std::filesystem::remove(path);
+        std::filesystem::remove(gray_path);
+    }
+}
+
+TEST_CASE("PixelLayout") {
+    {
+        constexpr size_t height = 5;
+        constexpr size_t width = 37;
+
+        PixelMatrix pixels = MakeRandomPixels(width, height, 11);
+
+        for (auto level : {SimdLevel::kScalar, SimdLevel::kSse41}) {
+            if (level > DetectSimdLevel()) {
+                continue;
+            }
+            SetSimdLevel(level);
+            ColorPlanes planes = SplitToPlanes(pixels);
+            REQUIRE(planes[1].Row(3)[30] == pixels[3][30].g);
+            REQUIRE(planes[2].Row(4)[36] == pixels[4][36].b);
+            PixelMatrix merged;
+            MergePlanes(planes, merged);
+            for (size_t y = 0; y < height; ++y) {
+                for (size_t x = 0; x < width; ++x) {
+                    REQUIRE(std::tie(merged[y][x].r, merged[y][x].g, merged[y][x].b) ==
+                            std::tie(pixels[y][x].r, pixels[y][x].g, pixels[y][x].b));
+                }
+            }
+        }
+        SetSimdLevel(DetectSimdLevel());
+
+        BMP image = MakeImage(pixels);
+        Crop({"20", "3"}).Apply(image);
+        image.SetLayout(PixelLayout::kPlanar);
+        Crop({"10", "2"}).Apply(image);
+        REQUIRE(image.GetLayout() == PixelLayout::kPlanar);
+        REQUIRE(image.Planes()[0].width == 10);
+        REQUIRE(image.Planes()[0].height == 2);
+        REQUIRE(image.PixelMatrix().size() == 2);
+        REQUIRE(image.PixelMatrix()[1].size() == 10);
+        REQUIRE(image.PixelMatrix()[1][9].r == pixels[1][9].r);
+
+        image.PixelMatrix() = pixels;
+        image.ResizeHeight(height);
+        image.ResizeWidth(width);
+        ApplyFilters({Filter{.filter_name = "-blur", .filter_params = {"1"}}, Filter{.filter_name = "-neg"},
+                      Filter{.filter_name = "-crop", .filter_params = {"30", "4"}}}, image);
+        REQUIRE(image.GetLayout() == PixelLayout::kPlanar);
+        ApplyFilters({Filter{.filter_name = "-colormatrix", .filter_params = {"sepia"}}}, image);
+        REQUIRE(image.GetLayout() == PixelLayout::kInterleaved);
+    }
+}
+
+TEST_CASE("GrayLayout") {
+    {
+        constexpr size_t height = 7;
+        constexpr size_t width = 21;
+
+        PixelMatrix pixels = MakeRandomPixels(width, height, 13);
+
+        BMP image = MakeImage(pixels);
+        ApplyFilters({Filter{.filter_name = "-gs"}}, image);
+        REQUIRE(image.GetLayout() == PixelLayout::kGray);
+        REQUIRE(image.Planes().size() == 1);
+        REQUIRE(image.Planes()[0].Row(2)[5] == CalculateGray(pixels[2][5]));
+
+        std::vector<Filter> chain = {Filter{.filter_name = "-blur", .filter_params = {"1"}},
+                                     Filter{.filter_name = "-sharp"},
+                                     Filter{.filter_name = "-gamma", .filter_params = {"2"}},
+                                     Filter{.filter_name = "-crop", .filter_params = {"20", "6"}}};
+        BMP expanded = image;
+        expanded.SetLayout(PixelLayout::kPlanar);
+        ApplyFilters(chain, image);
+        ApplyFilters(chain, expanded);
+        REQUIRE(image.GetLayout() == PixelLayout::kGray);
+        REQUIRE(expanded.GetLayout() == PixelLayout::kPlanar);
+        for (size_t channel = 0; channel < kAmountOfPrimaryColors; ++channel) {
+            REQUIRE(expanded.Planes()[channel] == image.Planes()[0]);
+        }
+
+        Plane gray = image.Planes()[0];
+        std::string path = "test_gray.bmp";
+        image.Save(path, kPalettedBitsPerPixel);
+        REQUIRE(std::filesystem::file_size(path) ==
+                kBmpMagicBytesCount + kBmpFileHeaderBytesCount + kBmpInfoHeaderBytesCount +
+                kPaletteSize * kPaletteEntryBytesCount + 20 * 6);
+        BMP reopened;
+        reopened.Open(path);
+        REQUIRE(reopened.GetLayout() == PixelLayout::kGray);
+        REQUIRE(reopened.Planes()[0] == gray);
+
+        reopened.Save(path);
+        reopened.Open(path);
+        REQUIRE(reopened.GetLayout() == PixelLayout::kInterleaved);
+        REQUIRE(reopened.PixelMatrix()[5][19].g == gray.Row(5)[19]);
+        std::filesystem::remove(path);
+
+        image.SetLayout(PixelLayout::kInterleaved);
+        image.SetLayout(PixelLayout::kGray);
+        REQUIRE(image.Planes()[0] == gray);
+
+        ApplyFilters({Filter{.filter_name = "-edge", .filter_params = {"20"}}}, image);
+        REQUIRE(image.GetLayout() == PixelLayout::kGray);
+        ApplyFilters({Filter{.filter_name = "-colormatrix", .filter_params = {"sepia"}}}, image);
+        REQUIRE(image.GetLayout() == PixelLayout::kInterleaved);
+    }
 }
 
 TEST_CASE("FilterGrayscale") {
@@ -229,6 +479,38 @@ TEST_CASE("FilterGrayscale") {
     }
 }
 
+TEST_CASE("GrayscaleExact") {
+    {
+        std::vector<PixelColor> row(kMaxRgb + 1);
+        std::vector<uint8_t> gray(row.size());
+        for (auto level : {SimdLevel::kScalar, SimdLevel::kSse41, SimdLevel::kAvx2, SimdLevel::kAvx512}) {
+            if (level > DetectSimdLevel()) {
+                continue;
+            }
+            SetSimdLevel(level);
+            size_t mismatches = 0;
+            for (int red = kMinRgb; red <= kMaxRgb; ++red) {
+                for (int green = kMinRgb; green <= kMaxRgb; ++green) {
+                    for (int blue = kMinRgb; blue <= kMaxRgb; ++blue) {
+                        row[blue] = {static_cast<uint8_t>(red), static_cast<uint8_t>(green),
+                                     static_cast<uint8_t>(blue)};
+                    }
+                    ConvertRowToGray(row.data(), gray.data(), row.size());
+                    for (const auto& pixel : row) {
+                        double expected = (static_cast<double>(pixel.r) / kMaxRgb * kRedToGray +
+                                           static_cast<double>(pixel.g) / kMaxRgb * kGreenToGray +
+                                           static_cast<double>(pixel.b) / kMaxRgb * kBlueToGray) * kMaxRgb;
+                        mismatches += gray[pixel.b] != std::lround(expected);
+                        mismatches += CalculateGray(pixel) != std::lround(expected);
+                    }
+                }
+            }
+            REQUIRE(mismatches == 0);
+        }
+        SetSimdLevel(DetectSimdLevel());
+    }
+}
+
 TEST_CASE("FilterNegative") {
     {
         BMP image;
@@ -245,6 +527,975 @@ TEST_CASE("FilterNegative") {
     }
 }
 
+TEST_CASE("FilterLut") {
+    {
+        PixelMatrix pixels(2, std::vector<PixelColor>(2, {0, 64, 255}));
+
+        BMP image = MakeImage(pixels);
+        Levels({"64", "192", "0", "255"}).Apply(image);
+        REQUIRE(image.PixelMatrix()[1][1].r == 0);
+        REQUIRE(image.PixelMatrix()[1][1].g == 0);
+        REQUIRE(image.PixelMatrix()[1][1].b == 255);
+
+        image.PixelMatrix() = pixels;
+        Gamma({"0.5"}).Apply(image);
+        REQUIRE(image.PixelMatrix()[1][1].g == 16);
+
+        image.PixelMatrix() = pixels;
+        Brightness({"-20"}).Apply(image);
+        REQUIRE(image.PixelMatrix()[1][1].r == 0);
+        REQUIRE(image.PixelMatrix()[1][1].g == 44);
+        REQUIRE(image.PixelMatrix()[1][1].b == 235);
+
+        image.PixelMatrix() = pixels;
+        Contrast({"2"}).Apply(image);
+        REQUIRE(image.PixelMatrix()[1][1].g == 1);
+        REQUIRE(image.PixelMatrix()[1][1].b == 255);
+
+        REQUIRE_THROWS_AS(Levels({"10", "10", "0", "255"}), FiltersProcessingException);
+        REQUIRE_THROWS_AS(Gamma({"0"}), FiltersProcessingException);
+        REQUIRE_THROWS_AS(Curve({"missing_curve.txt"}), FileProcessingException);
+    }
+    {
+        std::string curve_path = "test_curve.txt";
+        std::ofstream(curve_path) << "0 255\n128 0\n255 255\n";
+
+        BMP image;
+        image.ResizeHeight(2);
+        image.ResizeWidth(2);
+        image.PixelMatrix() = PixelMatrix(2, std::vector<PixelColor>(2, {64, 128, 192}));
+        Curve({curve_path}).Apply(image);
+        std::remove(curve_path.c_str());
+
+        REQUIRE(image.PixelMatrix()[1][1].r == 128);
+        REQUIRE(image.PixelMatrix()[1][1].g == 0);
+        REQUIRE(image.PixelMatrix()[1][1].b == 129);
+    }
+    {
+        std::vector<Filter> chain = {{"-gamma", {"1.8"}}, {"-levels", {"10", "240", "5", "250"}},
+                                     {"-neg", {}}, {"-contrast", {"1.3"}}, {"-brightness", {"12"}}};
+        auto planned = PlanFilters(CreateFilters(chain));
+        REQUIRE(planned.size() == 1);
+
+        PixelMatrix pixels(3, std::vector<PixelColor>(kLutSize));
+        for (size_t level = 0; level < kLutSize; ++level) {
+            auto value = static_cast<uint8_t>(level);
+            pixels[0][level] = pixels[1][level] = pixels[2][level] = {value, static_cast<uint8_t>(kMaxRgb - level),
+                                                                      value};
+        }
+
+        BMP sequential = MakeImage(pixels);
+        for (const auto& filter : CreateFilters(chain)) {
+            filter->Apply(sequential);
+        }
+
+        BMP composed = MakeImage(pixels);
+        ApplyFilters(chain, composed);
+
+        CheckMatricesEquality(composed.PixelMatrix(), sequential.PixelMatrix());
+
+        std::vector<Filter> split_chain = {{"-neg", {}}, {"-gs", {}}, {"-neg", {}}};
+        REQUIRE(PlanFilters(CreateFilters(split_chain)).size() == 3);
+    }
+}
+
+TEST_CASE("FilterLut3d") {
+    {
+        // A linear mapping, (r, g, b) -> (1 - g, b, r), is reproduced exactly by any lattice.
+        constexpr size_t cube_size = 5;
+        std::string cube_path = "test_lut3d.cube";
+        {
+            std::ofstream cube(cube_path);
+            cube << "# test cube\nTITLE \"swap\"\nLUT_3D_SIZE " << cube_size << "\n";
+            for (size_t blue = 0; blue < cube_size; ++blue) {
+                for (size_t green = 0; green < cube_size; ++green) {
+                    for (size_t red = 0; red < cube_size; ++red) {
+                        cube << 1 - static_cast<double>(green) / (cube_size - 1) << " "
+                             << static_cast<double>(blue) / (cube_size - 1) << " "
+                             << static_cast<double>(red) / (cube_size - 1) << "\n";
+                    }
+                }
+            }
+        }
+
+        constexpr size_t height = 37;
+        constexpr size_t width = 53;
+        PixelMatrix pixels = MakeRandomPixels(width, height, 3);
+
+        Lut3d lut3d({cube_path});
+        REQUIRE(GetCubeLut(cube_path) == GetCubeLut(cube_path));
+        std::remove(cube_path.c_str());
+
+        auto apply = [&pixels, &lut3d](SimdLevel level, size_t threads) {
+            SetSimdLevel(level);
+            SetThreadCount(threads);
+            BMP image = MakeImage(pixels);
+            lut3d.Apply(image);
+            return image.PixelMatrix();
+        };
+
+        PixelMatrix graded = apply(SimdLevel::kScalar, 1);
+        for (size_t y = 0; y < height; ++y) {
+            for (size_t x = 0; x < width; ++x) {
+                REQUIRE(graded[y][x].r == kMaxRgb - pixels[y][x].g);
+                REQUIRE(graded[y][x].g == pixels[y][x].b);
+                REQUIRE(graded[y][x].b == pixels[y][x].r);
+            }
+        }
+        CheckMatricesEquality(apply(DetectSimdLevel(), 4), graded);
+        SetSimdLevel(DetectSimdLevel());
+        SetThreadCount(0);
+
+        REQUIRE_THROWS_AS(Lut3d({cube_path}), FileProcessingException);
+    }
+}
+
+TEST_CASE("FilterColorMatrix") {
+    {
+        constexpr size_t height = 29;
+        constexpr size_t width = 77;
+
+        PixelMatrix pixels = MakeRandomPixels(width, height, 11);
+
+        PixelMatrix swapped = ApplyToPixels(pixels, {{"-colormatrix", {"swap"}}});
+        for (size_t y = 0; y < height; ++y) {
+            for (size_t x = 0; x < width; ++x) {
+                REQUIRE(swapped[y][x].r == pixels[y][x].b);
+                REQUIRE(swapped[y][x].g == pixels[y][x].g);
+                REQUIRE(swapped[y][x].b == pixels[y][x].r);
+            }
+        }
+
+        std::vector<std::vector<Filter>> chains = {
+                {{"-colormatrix", {"sepia"}}},
+                {{"-colormatrix", {"saturation", "1.7"}}},
+                {{"-colormatrix",
+                  {"0.5", "-0.2", "0.1", "0.05", "0.3", "0.9", "-0.4", "-0.1", "1.2", "0", "0.3", "0"}}}};
+        for (const auto& chain : chains) {
+            CheckSimdAndThreadsAgree(pixels, chain);
+        }
+
+        // Without clamping in between, the fused matrix differs from step by step rounding by at most one.
+        std::vector<Filter> chain = {{"-colormatrix", {"saturation", "0.8"}}, {"-gs", {}}, {"-colormatrix", {"swap"}}};
+        REQUIRE(PlanFilters(CreateFilters(chain)).size() == 1);
+        PixelMatrix fused = ApplyToPixels(pixels, chain);
+        BMP sequential = MakeImage(pixels);
+        for (const auto& filter : CreateFilters(chain)) {
+            filter->Apply(sequential);
+        }
+        for (size_t y = 0; y < height; ++y) {
+            for (size_t x = 0; x < width; ++x) {
+                REQUIRE(std::abs(fused[y][x].r - sequential.PixelMatrix()[y][x].r) <= 1);
+                REQUIRE(std::abs(fused[y][x].g - sequential.PixelMatrix()[y][x].g) <= 1);
+                REQUIRE(std::abs(fused[y][x].b - sequential.PixelMatrix()[y][x].b) <= 1);
+            }
+        }
+
+        std::vector<Filter> grayscale_chain = {{"-gs", {}}, {"-gs", {}}};
+        REQUIRE(PlanFilters(CreateFilters(grayscale_chain)).size() == 2);
+        REQUIRE_THROWS_AS(ColorMatrixFilter({"saturation"}), FiltersProcessingException);
+        REQUIRE_THROWS_AS(ColorMatrixFilter({"1", "2", "3"}), FiltersProcessingException);
+    }
+}
+
+TEST_CASE("FilterEqualize") {
+    {
+        constexpr size_t height = 41;
+        constexpr size_t width = 23;
+
+        std::mt19937 generator(5);
+        std::uniform_int_distribution<int> distribution(40, 120);
+        PixelMatrix pixels(height, std::vector<PixelColor>(width));
+        ColorHistogram expected;
+        for (auto& row : pixels) {
+            for (auto& pixel : row) {
+                pixel = {static_cast<uint8_t>(distribution(generator)), static_cast<uint8_t>(distribution(generator)),
+                         static_cast<uint8_t>(distribution(generator) / 2)};
+                ++expected.channels[0][pixel.r];
+                ++expected.channels[1][pixel.g];
+                ++expected.channels[2][pixel.b];
+            }
+        }
+
+        for (size_t threads : {1, 3, 7, 64}) {
+            SetThreadCount(threads);
+            REQUIRE(ComputeHistogram(pixels).channels == expected.channels);
+        }
+        SetThreadCount(0);
+
+        BMP image = MakeImage(pixels);
+        Equalize({"channels"}).Apply(image);
+        for (size_t channel = 0; channel < kAmountOfPrimaryColors; ++channel) {
+            ChannelHistogram equalized = ComputeHistogram(image.PixelMatrix()).channels[channel];
+            auto first = std::find_if(equalized.begin(), equalized.end(), [](uint64_t count) { return count != 0; });
+            REQUIRE(first - equalized.begin() == kMinRgb);
+            REQUIRE(equalized[kMaxRgb] != 0);
+        }
+
+        image.PixelMatrix() = PixelMatrix(height, std::vector<PixelColor>(width, {100, 100, 100}));
+        image.PixelMatrix()[0][0] = {50, 50, 50};
+        Equalize({}).Apply(image);
+        REQUIRE(image.PixelMatrix()[0][0].r == kMinRgb);
+        REQUIRE(image.PixelMatrix()[1][1].r == kMaxRgb);
+
+        REQUIRE_THROWS_AS(Equalize({"luma"}), FiltersProcessingException);
+    }
+}
+
+TEST_CASE("FilterAutoLevels") {
+    {
+        REQUIRE(GetStatisticsStep(1000, 1000) == 1);
+        REQUIRE(GetStatisticsStep(4096, 1024) == 2);
+        REQUIRE(GetStatisticsStep(10000, 10000) == 9);
+
+        ChannelHistogram histogram{};
+        histogram[10] = 1;
+        histogram[20] = 98;
+        histogram[30] = 1;
+        REQUIRE(FindPercentile(histogram, 0) == 10);
+        REQUIRE(FindPercentile(histogram, 0.005) == 10);
+        REQUIRE(FindPercentile(histogram, 0.5) == 20);
+        REQUIRE(FindPercentile(histogram, 0.995) == 30);
+        REQUIRE(FindMean(histogram) == 20);
+
+        BMP image;
+        image.ResizeHeight(2);
+        image.ResizeWidth(50);
+        PixelMatrix pixels(2, std::vector<PixelColor>(50));
+        for (size_t x = 0; x < 50; ++x) {
+            auto level = static_cast<uint8_t>(60 + x);
+            pixels[0][x] = {level, static_cast<uint8_t>(level / 2), 7};
+            pixels[1][x] = {static_cast<uint8_t>(level + 50), level, 7};
+        }
+        image.PixelMatrix() = pixels;
+        AutoLevels({"0"}).Apply(image);
+        REQUIRE(image.PixelMatrix()[0][0].r == kMinRgb);
+        REQUIRE(image.PixelMatrix()[1][49].r == kMaxRgb);
+        REQUIRE(image.PixelMatrix()[0][0].g == kMinRgb);
+        REQUIRE(image.PixelMatrix()[1][49].g == kMaxRgb);
+        REQUIRE(image.PixelMatrix()[0][0].b == 7);
+
+        image.PixelMatrix() = PixelMatrix(2, std::vector<PixelColor>(50, {200, 100, 50}));
+        image.PixelMatrix()[0][0] = {100, 50, 25};
+        AutoWhiteBalance({}).Apply(image);
+        ColorHistogram balanced = ComputeHistogram(image.PixelMatrix());
+        REQUIRE(std::abs(FindMean(balanced.channels[0]) - FindMean(balanced.channels[1])) < 1);
+        REQUIRE(std::abs(FindMean(balanced.channels[1]) - FindMean(balanced.channels[2])) < 1);
+
+        REQUIRE_THROWS_AS(AutoLevels({"50"}), FiltersProcessingException);
+        REQUIRE_THROWS_AS(AutoLevels({"-1"}), FiltersProcessingException);
+        REQUIRE_THROWS_AS(AutoLevels({"1", "2"}), FiltersProcessingException);
+        REQUIRE_THROWS_AS(AutoWhiteBalance({"1"}), FiltersProcessingException);
+    }
+    {
+        // Gray and indexed images keep their layout and end up as the expanded image would.
+        constexpr size_t height = 19;
+        constexpr size_t width = 37;
+
+        std::mt19937 generator(13);
+        std::uniform_int_distribution<int> distribution(30, 200);
+        PixelMatrix pixels(height, std::vector<PixelColor>(width));
+        for (auto& row : pixels) {
+            for (auto& pixel : row) {
+                pixel = {static_cast<uint8_t>(distribution(generator)), static_cast<uint8_t>(distribution(generator)),
+                         static_cast<uint8_t>(distribution(generator) / 2)};
+            }
+        }
+
+        for (const auto& filter : std::vector<Filter>{{"-equalize", {}}, {"-equalize", {"channels"}},
+                                                      {"-autolevels", {"1"}}, {"-autowb", {}}}) {
+            for (auto [reduce, layout] : {std::pair{Filter{"-gs", {}}, PixelLayout::kGray},
+                                          std::pair{Filter{"-quantize", {"16"}}, PixelLayout::kIndexed}}) {
+                BMP image = MakeImage(pixels);
+                ApplyFilters({reduce}, image);
+                REQUIRE(image.GetLayout() == layout);
+                BMP expanded = image;
+                expanded.SetLayout(PixelLayout::kInterleaved);
+                BMP planar = image;
+                planar.SetLayout(PixelLayout::kPlanar);
+
+                ApplyFilters({filter}, image);
+                ApplyFilters({filter}, expanded);
+                ApplyFilters({filter}, planar);
+                REQUIRE(image.GetLayout() == layout);
+                CheckMatricesEquality(image.PixelMatrix(), expanded.PixelMatrix());
+                CheckMatricesEquality(planar.PixelMatrix(), expanded.PixelMatrix());
+            }
+        }
+    }
+}
+
+TEST_CASE("FilterQuantize") {
+    {
+        const std::vector<PixelColor> colors = {{0, 0, 0}, {255, 255, 255}, {255, 0, 0}, {0, 0, 255}};
+        BMP image;
+        image.ResizeHeight(6);
+        image.ResizeWidth(10);
+        PixelMatrix pixels(6, std::vector<PixelColor>(10));
+        for (size_t y = 0; y < 6; ++y) {
+            for (size_t x = 0; x < 10; ++x) {
+                pixels[y][x] = colors[(x / 3 + y) % colors.size()];
+            }
+        }
+        image.PixelMatrix() = pixels;
+        ApplyFilters({Filter{.filter_name = "-quantize", .filter_params = {"4"}}}, image);
+        REQUIRE(image.GetLayout() == PixelLayout::kIndexed);
+        REQUIRE(image.GetPalette().size() == 4);
+        CheckMatricesEquality(image.PixelMatrix(), pixels);
+
+        ApplyFilters({Filter{.filter_name = "-quantize", .filter_params = {"4"}},
+                      Filter{.filter_name = "-neg"},
+                      Filter{.filter_name = "-crop", .filter_params = {"7", "5"}}}, image);
+        REQUIRE(image.GetLayout() == PixelLayout::kIndexed);
+        REQUIRE(image.Planes().size() == 3);
+        REQUIRE(image.GetHeight() == 5);
+        REQUIRE(image.PixelMatrix()[4][6].r == kMaxRgb - pixels[4][6].r);
+
+        REQUIRE_THROWS_AS(Quantize({"1"}), FiltersProcessingException);
+        REQUIRE_THROWS_AS(Quantize({"257"}), FiltersProcessingException);
+        REQUIRE_THROWS_AS(Quantize({"many"}), FiltersProcessingException);
+        REQUIRE_THROWS_AS(Quantize({}), FiltersProcessingException);
+    }
+    {
+        constexpr size_t height = 67;
+        constexpr size_t width = 301;
+
+        PixelMatrix pixels(height, std::vector<PixelColor>(width));
+        std::mt19937 generator(3);
+        std::uniform_int_distribution<int> noise(-20, 20);
+        for (size_t y = 0; y < height; ++y) {
+            for (size_t x = 0; x < width; ++x) {
+                auto level = [&](size_t value) {
+                    return static_cast<uint8_t>(std::clamp(static_cast<int>(value) + noise(generator), kMinRgb,
+                                                           kMaxRgb));
+                };
+                pixels[y][x] = {level(x * kMaxRgb / width), level(y * kMaxRgb / height), level(128)};
+            }
+        }
+
+        std::vector<BMP> images;
+        for (size_t threads : {1, 3, 8}) {
+            BMP image = MakeImage(pixels);
+            ApplyFilters({Filter{.filter_name = "-quantize", .filter_params = {"16"}}}, image,
+                         ProcessingOptions{.threads = threads});
+            images.push_back(image);
+        }
+        for (auto& other : images) {
+            REQUIRE(other.GetPalette().size() == 16);
+        }
+        BMP image = images[1];
+        PixelMatrix& dithered = images[0].PixelMatrix();
+        for (auto& other : images) {
+            CheckMatricesEquality(other.PixelMatrix(), dithered);
+        }
+
+        // Error diffusion keeps the mean colour of the image.
+        ColorHistogram original_histogram = ComputeHistogram(pixels);
+        ColorHistogram dithered_histogram = ComputeHistogram(dithered);
+        for (size_t channel = 0; channel < kAmountOfPrimaryColors; ++channel) {
+            REQUIRE(std::abs(FindMean(original_histogram.channels[channel]) -
+                             FindMean(dithered_histogram.channels[channel])) < 1);
+        }
+
+        std::string path = "test_quantize.bmp";
+        image.Save(path);
+        REQUIRE(std::filesystem::file_size(path) ==
+                kBmpMagicBytesCount + kBmpFileHeaderBytesCount + kBmpInfoHeaderBytesCount +
+                16 * kPaletteEntryBytesCount + (width + 3) * height);
+        BMP reopened;
+        reopened.Open(path);
+        CheckMatricesEquality(reopened.PixelMatrix(), dithered);
+        std::filesystem::remove(path);
+    }
+}
+
+TEST_CASE("FilterResize") {
+    {
+        ResampleWeights identity = ComputeResampleWeights(10, 10, ResizeFilter::kBilinear);
+        for (size_t i = 0; i < 10; ++i) {
+            REQUIRE(identity.starts[i] == i);
+            REQUIRE(identity.weights[i * identity.stride] == 1);
+        }
+
+        for (auto filter : {ResizeFilter::kNearest, ResizeFilter::kBilinear, ResizeFilter::kBicubic,
+                            ResizeFilter::kLanczos3}) {
+            ResampleWeights shrinking = ComputeResampleWeights(24, 5, filter);
+            REQUIRE(shrinking.stride % kResampleLanes == 0);
+            for (size_t i = 0; i < 5; ++i) {
+                REQUIRE(shrinking.starts[i] + shrinking.taps_counts[i] <= 24);
+                double sum = 0;
+                for (size_t tap = 0; tap < shrinking.stride; ++tap) {
+                    sum += shrinking.weights[i * shrinking.stride + tap];
+                }
+                REQUIRE(std::abs(sum - 1) < 1e-6);
+            }
+
+            Plane flat(37, 23);
+            std::fill(flat.data.begin(), flat.data.end(), 77);
+            Plane resized;
+            ResamplePlane(flat, resized, ComputeResampleWeights(37, 11, filter),
+                          ComputeResampleWeights(23, 50, filter));
+            REQUIRE(resized.width == 11);
+            REQUIRE(resized.height == 50);
+            REQUIRE(std::all_of(resized.data.begin(), resized.data.end(), [](uint8_t level) { return level == 77; }));
+        }
+
+        Plane source(3, 2);
+        source.data = {1, 2, 3, 4, 5, 6};
+        Plane doubled;
+        ResamplePlane(source, doubled, ComputeResampleWeights(3, 6, ResizeFilter::kNearest),
+                      ComputeResampleWeights(2, 4, ResizeFilter::kNearest));
+        REQUIRE(doubled.data == std::vector<uint8_t>{1, 1, 2, 2, 3, 3, 1, 1, 2, 2, 3, 3,
+                                                     4, 4, 5, 5, 6, 6, 4, 4, 5, 5, 6, 6});
+    }
+    {
+        constexpr size_t height = 41;
+        constexpr size_t width = 67;
+
+        PixelMatrix pixels = MakeRandomPixels(width, height, 5);
+
+        for (const auto& params : std::vector<std::vector<std::string>>{
+                     {"13", "9", "lanczos3"}, {"150", "70", "bicubic"}, {"20", "100", "bilinear"}}) {
+            Filter resize{.filter_name = "-resize", .filter_params = params};
+            PixelMatrix resized = ApplyToPixels(pixels, {resize});
+            REQUIRE(resized.size() == std::stoul(params[1]));
+            REQUIRE(resized[0].size() == std::stoul(params[0]));
+            CheckSimdAndThreadsAgree(pixels, {resize});
+        }
+
+        BMP image = MakeImage(pixels);
+        ApplyFilters({Filter{.filter_name = "-gs"}, Filter{.filter_name = "-resize", .filter_params = {"30", "20"}}},
+                     image);
+        REQUIRE(image.GetLayout() == PixelLayout::kGray);
+        REQUIRE(image.GetWidth() == 30);
+        REQUIRE(image.GetHeight() == 20);
+        REQUIRE(image.Planes()[0].width == 30);
+        REQUIRE(image.PixelMatrix().size() == 20);
+
+        REQUIRE_THROWS_AS(Resize({"10"}), FiltersProcessingException);
+        REQUIRE_THROWS_AS(Resize({"0", "10"}), FiltersProcessingException);
+        REQUIRE_THROWS_AS(Resize({"10", "10", "sharpest"}), FiltersProcessingException);
+    }
+}
+
+TEST_CASE("FilterDownscale") {
+    constexpr size_t height = 41;
+    constexpr size_t width = 67;
+
+    PixelMatrix pixels = MakeRandomPixels(width, height, 6);
+
+    for (size_t factor : {1, 2, 3, 4, 5, 8, 70}) {
+        size_t downscaled_width = GetDownscaledSize(width, factor);
+        size_t downscaled_height = GetDownscaledSize(height, factor);
+        PixelMatrix expected(downscaled_height, std::vector<PixelColor>(downscaled_width));
+        for (size_t y = 0; y < downscaled_height; ++y) {
+            for (size_t x = 0; x < downscaled_width; ++x) {
+                size_t red = 0;
+                size_t green = 0;
+                size_t blue = 0;
+                size_t count = 0;
+                for (size_t row = y * factor; row < std::min((y + 1) * factor, height); ++row) {
+                    for (size_t col = x * factor; col < std::min((x + 1) * factor, width); ++col) {
+                        red += pixels[row][col].r;
+                        green += pixels[row][col].g;
+                        blue += pixels[row][col].b;
+                        ++count;
+                    }
+                }
+                expected[y][x] = {static_cast<uint8_t>((red + count / 2) / count),
+                                  static_cast<uint8_t>((green + count / 2) / count),
+                                  static_cast<uint8_t>((blue + count / 2) / count)};
+            }
+        }
+
+        for (auto level : {SimdLevel::kScalar, SimdLevel::kSse41, SimdLevel::kAvx2}) {
+            if (level > DetectSimdLevel()) {
+                continue;
+            }
+            SetSimdLevel(level);
+            BMP image = MakeImage(pixels);
+            ApplyFilters({Filter{.filter_name = "-downscale", .filter_params = {std::to_string(factor)}}}, image);
+            REQUIRE(image.GetWidth() == downscaled_width);
+            REQUIRE(image.GetHeight() == downscaled_height);
+            CheckMatricesEquality(image.PixelMatrix(), expected);
+        }
+        SetSimdLevel(DetectSimdLevel());
+    }
+
+    {
+        BMP image = MakeImage(pixels);
+        std::string path = "test_downscale.bmp";
+        image.Save(path);
+        std::vector<Filter> chain = {Filter{.filter_name = "-downscale", .filter_params = {"3"}},
+                                     Filter{.filter_name = "-neg"}};
+        BMP decoded;
+        OpenAndApplyFilters(path, chain, decoded);
+        BMP opened;
+        opened.Open(path);
+        ApplyFilters(chain, opened);
+        std::filesystem::remove(path);
+        REQUIRE(decoded.GetWidth() == 23);
+        REQUIRE(decoded.GetHeight() == 14);
+        CheckMatricesEquality(decoded.PixelMatrix(), opened.PixelMatrix());
+    }
+    {
+        BMP image = MakeImage(pixels);
+        for (auto& row : image.PixelMatrix()) {
+            std::fill(row.begin(), row.end(), PixelColor{10, 128, 250});
+        }
+        ApplyFilters({Filter{.filter_name = "-downscale", .filter_params = {"4"}}}, image,
+                     ProcessingOptions{.light = LightMode::kLinear});
+        REQUIRE(image.PixelMatrix()[10][16].r == 10);
+        REQUIRE(image.PixelMatrix()[10][16].g == 128);
+        REQUIRE(image.PixelMatrix()[10][16].b == 250);
+    }
+
+    REQUIRE_THROWS_AS(Downscale({"0"}), FiltersProcessingException);
+    REQUIRE_THROWS_AS(Downscale({"257"}), FiltersProcessingException);
+    REQUIRE_THROWS_AS(Downscale({"2", "2"}), FiltersProcessingException);
+}
+
+TEST_CASE("Pyramid") {
+    constexpr size_t height = 45;
+    constexpr size_t width = 71;
+    constexpr size_t levels_count = 4;
+
+    std::mt19937 generator(8);
+    std::uniform_int_distribution<int> distribution(kMinRgb, kMaxRgb);
+    Plane source(width, height);
+    for (size_t y = 0; y < height; ++y) {
+        for (size_t x = 0; x < width; ++x) {
+            source.Row(y)[x] = static_cast<uint8_t>(distribution(generator));
+        }
+    }
+
+    PyramidBuilder top_down(width, height, levels_count);
+    PyramidBuilder bottom_up(width, height, levels_count);
+    for (size_t y = 0; y < height; ++y) {
+        top_down.AddRow(y, source.Row(y));
+        bottom_up.AddRow(height - 1 - y, source.Row(height - 1 - y));
+    }
+    Plane expected = source;
+    for (size_t level = 0; level < levels_count; ++level) {
+        expected = DownscalePlane(expected, kPyramidFactor);
+        REQUIRE(top_down.Levels()[level] == expected);
+        REQUIRE(bottom_up.Levels()[level] == expected);
+    }
+    REQUIRE(top_down.Levels()[3].width == 5);
+    REQUIRE(top_down.Levels()[3].height == 3);
+
+    BMP image;
+    image.SetPlanes({source, source, source});
+    std::string path = "test_pyramid.bmp";
+    std::string output_path = "test_pyramid_output.bmp";
+    image.Save(path);
+    REQUIRE(GetPyramidLevelPath(output_path, 2) == "test_pyramid_output_2.bmp");
+    for (const auto& filters : {std::vector<Filter>{}, std::vector<Filter>{Filter{.filter_name = "-gs"}}}) {
+        ProcessImage(path, output_path, filters, ProcessingOptions{.pyramid_levels = levels_count});
+        BMP output;
+        output.Open(output_path);
+        REQUIRE(output.Planes()[0] == source);
+        expected = source;
+        for (size_t level = 1; level <= levels_count; ++level) {
+            expected = DownscalePlane(expected, kPyramidFactor);
+            BMP level_image;
+            level_image.Open(GetPyramidLevelPath(output_path, level));
+            REQUIRE(level_image.Planes()[1] == expected);
+            std::filesystem::remove(GetPyramidLevelPath(output_path, level));
+        }
+    }
+
+    // The pyramid must not change how the main output is written. The colours keep the paletted
+    // output from being read back as gray.
+    Plane inverted = source;
+    for (size_t y = 0; y < height; ++y) {
+        for (size_t x = 0; x < width; ++x) {
+            inverted.Row(y)[x] = static_cast<uint8_t>(kMaxRgb - source.Row(y)[x]);
+        }
+    }
+    image.SetPlanes({source, inverted, source});
+    image.Save(path);
+    auto read_bits_per_pixel = [](const std::string& file) {
+        std::ifstream in(file, std::ios::binary);
+        in.seekg(static_cast<std::streamoff>(kBmpMagicBytesCount + kBmpFileHeaderBytesCount +
+                                             offsetof(BitmapInfo, bits_per_pixel)));
+        Word bits_per_pixel = 0;
+        in.read(reinterpret_cast<char*>(&bits_per_pixel), sizeof(bits_per_pixel));
+        return bits_per_pixel;
+    };
+    std::vector<Filter> quantize = {Filter{.filter_name = "-quantize", .filter_params = {"8"}}};
+    std::string paletted_path = "test_pyramid_paletted.bmp";
+    ProcessImage(path, paletted_path, quantize, ProcessingOptions{});
+    REQUIRE(read_bits_per_pixel(paletted_path) == kPalettedBitsPerPixel);
+    for (const auto& [input, filters] : {std::pair{path, quantize}, std::pair{paletted_path, std::vector<Filter>{}}}) {
+        ProcessImage(input, output_path, filters, ProcessingOptions{});
+        auto bits_per_pixel = read_bits_per_pixel(output_path);
+        auto size = std::filesystem::file_size(output_path);
+        ProcessImage(input, output_path, filters, ProcessingOptions{.pyramid_levels = 2});
+        REQUIRE(read_bits_per_pixel(output_path) == bits_per_pixel);
+        REQUIRE(std::filesystem::file_size(output_path) == size);
+        for (size_t level = 1; level <= 2; ++level) {
+            REQUIRE(read_bits_per_pixel(GetPyramidLevelPath(output_path, level)) == kRequiredBitsPerPixel);
+            std::filesystem::remove(GetPyramidLevelPath(output_path, level));
+        }
+    }
+    std::filesystem::remove(paletted_path);
+    std::filesystem::remove(path);
+    std::filesystem::remove(output_path);
+
+    REQUIRE_THROWS_AS(GetProcessingOptions({Option{.option_name = "--pyramid", .option_params = {"0"}}}),
+                      ParserException);
+    REQUIRE_THROWS_AS(GetProcessingOptions({Option{.option_name = "--pyramid", .option_params = {"32"}}}),
+                      ParserException);
+}
+
+TEST_CASE("FilterRotate") {
+    for (auto [width, height] : {std::pair<size_t, size_t>{37, 21}, {130, 70}, {8, 8}}) {
+        PixelMatrix pixels = MakeRandomPixels(width, height, 7);
+
+        for (const auto& filter : std::vector<Filter>{{"-rotate", {"90"}}, {"-rotate", {"180"}},
+                                                      {"-rotate", {"270"}}, {"-transpose", {}}}) {
+            bool swaps_axes = filter.filter_params != std::vector<std::string>{"180"};
+            PixelMatrix expected(swaps_axes ? width : height,
+                                 std::vector<PixelColor>(swaps_axes ? height : width));
+            for (size_t y = 0; y < height; ++y) {
+                for (size_t x = 0; x < width; ++x) {
+                    if (filter.filter_name == "-transpose") {
+                        expected[x][y] = pixels[y][x];
+                    } else if (filter.filter_params[0] == "90") {
+                        expected[x][height - 1 - y] = pixels[y][x];
+                    } else if (filter.filter_params[0] == "180") {
+                        expected[height - 1 - y][width - 1 - x] = pixels[y][x];
+                    } else {
+                        expected[width - 1 - x][y] = pixels[y][x];
+                    }
+                }
+            }
+
+            PixelMatrix rotated = ApplyToPixels(pixels, {filter});
+            REQUIRE(rotated.size() == expected.size());
+            REQUIRE(rotated[0].size() == expected[0].size());
+            REQUIRE(rotated[0][0].r == expected[0][0].r);
+            CheckMatricesEquality(rotated, expected);
+            CheckSimdAndThreadsAgree(pixels, {filter});
+        }
+
+        BMP image = MakeImage(pixels);
+        ApplyFilters({Filter{.filter_name = "-gs"}, Filter{.filter_name = "-rotate", .filter_params = {"90"}},
+                      Filter{.filter_name = "-transpose"}}, image);
+        REQUIRE(image.GetLayout() == PixelLayout::kGray);
+        REQUIRE(image.GetWidth() == width);
+        REQUIRE(image.GetHeight() == height);
+        // A quarter turn and then a transpose flip the image upside down.
+        REQUIRE(image.PixelMatrix()[0][3].g == CalculateGray(pixels[height - 1][3]));
+    }
+
+    {
+        // Filters that only move pixels move the indices of an indexed image and keep its palette.
+        constexpr size_t height = 21;
+        constexpr size_t width = 37;
+
+        PixelMatrix pixels = MakeRandomPixels(width, height, 14);
+
+        for (const auto& filter : std::vector<Filter>{{"-rotate", {"90"}}, {"-rotate", {"180"}},
+                                                      {"-transpose", {}}, {"-fliph", {}}, {"-flipv", {}},
+                                                      {"-shuffle", {"4", "3"}}}) {
+            BMP image = MakeImage(pixels);
+            ApplyFilters({Filter{.filter_name = "-quantize", .filter_params = {"16"}}}, image);
+            BMP expanded = image;
+            expanded.SetLayout(PixelLayout::kInterleaved);
+
+            ApplyFilters({filter}, image);
+            ApplyFilters({filter}, expanded);
+            REQUIRE(image.GetLayout() == PixelLayout::kIndexed);
+            REQUIRE(image.GetPalette().size() <= 16);
+            CheckMatricesEquality(image.PixelMatrix(), expanded.PixelMatrix());
+        }
+    }
+
+    REQUIRE_THROWS_AS(Rotate({"45"}), FiltersProcessingException);
+    REQUIRE_THROWS_AS(Rotate({}), FiltersProcessingException);
+    REQUIRE_THROWS_AS(Transpose({"90"}), FiltersProcessingException);
+}
+
+TEST_CASE("FilterFlip") {
+    for (auto [width, height] : {std::pair<size_t, size_t>{37, 21}, {130, 5}}) {
+        PixelMatrix pixels = MakeRandomPixels(width, height, 8);
+
+        PixelMatrix mirrored = pixels;
+        for (auto& row : mirrored) {
+            std::reverse(row.begin(), row.end());
+        }
+        PixelMatrix flipped_horizontally = ApplyToPixels(pixels, {Filter{.filter_name = "-fliph"}});
+        REQUIRE(flipped_horizontally[0][0].b == mirrored[0][0].b);
+        CheckMatricesEquality(flipped_horizontally, mirrored);
+        CheckSimdAndThreadsAgree(pixels, {Filter{.filter_name = "-fliph"}});
+
+        PixelMatrix upside_down(pixels.rbegin(), pixels.rend());
+        BMP interleaved = MakeImage(pixels);
+        ApplyFilters({Filter{.filter_name = "-flipv"}}, interleaved);
+        CheckMatricesEquality(interleaved.PixelMatrix(), upside_down);
+
+        // Filters after a vertical flip read the planes through their negated strides.
+        BMP flipped = MakeImage(pixels);
+        ApplyFilters({Filter{.filter_name = "-sharp"}, Filter{.filter_name = "-flipv"},
+                      Filter{.filter_name = "-neg"}, Filter{.filter_name = "-rotate", .filter_params = {"90"}}},
+                     flipped);
+        REQUIRE(flipped.GetLayout() == PixelLayout::kPlanar);
+        BMP expected = MakeImage(upside_down);
+        ApplyFilters({Filter{.filter_name = "-sharp"}, Filter{.filter_name = "-neg"},
+                      Filter{.filter_name = "-rotate", .filter_params = {"90"}}},
+                     expected);
+        CheckMatricesEquality(flipped.PixelMatrix(), expected.PixelMatrix());
+
+        BMP gray = MakeImage(pixels);
+        gray.SetLayout(PixelLayout::kGray);
+        ApplyFilters({Filter{.filter_name = "-flipv"}}, gray);
+        REQUIRE(gray.GetLayout() == PixelLayout::kGray);
+        std::string path = "test_flip.bmp";
+        gray.Save(path, kPalettedBitsPerPixel);
+        BMP reopened;
+        reopened.Open(path);
+        std::filesystem::remove(path);
+        REQUIRE(reopened.Planes()[0].Row(0)[2] == CalculateGray(pixels[height - 1][2]));
+        REQUIRE(reopened.Planes()[0].Row(height - 1)[2] == CalculateGray(pixels[0][2]));
+    }
+
+    REQUIRE_THROWS_AS(FlipVertical({"1"}), FiltersProcessingException);
+    REQUIRE_THROWS_AS(FlipHorizontal({"1"}), FiltersProcessingException);
+}
+
+TEST_CASE("FilterAffine") {
+    constexpr size_t height = 41;
+    constexpr size_t width = 67;
+
+    PixelMatrix pixels = MakeRandomPixels(width, height, 9);
+
+    Filter identity{.filter_name = "-affine", .filter_params = {"1", "0", "0", "0", "1", "0"}};
+    CheckMatricesEquality(ApplyToPixels(pixels, {identity}), pixels);
+    CheckMatricesEquality(ApplyToPixels(pixels, {identity}, ProcessingOptions{.light = LightMode::kLinear}), pixels);
+
+    Filter shift{.filter_name = "-affine", .filter_params = {"1", "0", "3", "0", "1", "-2"}};
+    PixelMatrix shifted = ApplyToPixels(pixels, {shift});
+    for (size_t y = 0; y < height; ++y) {
+        for (size_t x = 0; x < width; ++x) {
+            bool inside = x >= 3 && y + 2 < height;
+            REQUIRE(shifted[y][x].g == (inside ? pixels[y + 2][x - 3].g : 0));
+        }
+    }
+
+    // Rows of the half turn read the source backwards, so vectors cross the right edge too.
+    PixelMatrix half_turn = ApplyToPixels(pixels, {Filter{.filter_name = "-rotate-deg", .filter_params = {"180"}}});
+    for (size_t y = 1; y + 1 < height; ++y) {
+        for (size_t x = 1; x + 1 < width; ++x) {
+            REQUIRE(half_turn[y][x].r == pixels[height - 1 - y][width - 1 - x].r);
+        }
+    }
+
+    for (const auto& filter : std::vector<Filter>{{"-rotate-deg", {"30"}}, {"-rotate-deg", {"-100.5"}},
+                                                  {"-affine", {"0.7", "0.2", "-5", "-0.1", "1.3", "4"}}}) {
+        CheckSimdAndThreadsAgree(pixels, {filter});
+    }
+
+    REQUIRE_THROWS_AS(Affine({"1", "2", "0", "2", "4", "0"}), FiltersProcessingException);
+    REQUIRE_THROWS_AS(Affine({"1", "0", "0", "0", "1"}), FiltersProcessingException);
+    REQUIRE_THROWS_AS(RotateDegrees({"nan"}), FiltersProcessingException);
+}
+
+TEST_CASE("FilterRemap") {
+    constexpr size_t height = 70;
+    constexpr size_t width = 83;
+
+    PixelMatrix pixels = MakeRandomPixels(width, height, 10);
+
+    CheckMatricesEquality(ApplyToPixels(pixels, {Filter{.filter_name = "-remap", .filter_params = {"lens", "0"}}}),
+                          pixels);
+    Filter identity{.filter_name = "-remap", .filter_params = {"perspective", "1", "0", "0", "0", "1", "0", "0", "0"}};
+    CheckMatricesEquality(ApplyToPixels(pixels, {identity}), pixels);
+    Filter shift{.filter_name = "-remap", .filter_params = {"perspective", "1", "0", "3", "0", "1", "-2", "0", "0"}};
+    Filter affine_shift{.filter_name = "-affine", .filter_params = {"1", "0", "3", "0", "1", "-2"}};
+    CheckMatricesEquality(ApplyToPixels(pixels, {shift}), ApplyToPixels(pixels, {affine_shift}));
+
+    // Pincushion correction samples the corners outside the photo, the centre stays.
+    PixelMatrix pincushion =
+            ApplyToPixels(pixels, {Filter{.filter_name = "-remap", .filter_params = {"lens", "0.3"}}});
+    REQUIRE(pincushion[0][0].r == 0);
+    REQUIRE(pincushion[height - 1][width - 1].b == 0);
+    REQUIRE(pincushion[height / 2][width / 2].g == pixels[height / 2][width / 2].g);
+
+    for (const auto& filter : std::vector<Filter>{{"-remap", {"lens", "-0.2", "0.05"}},
+                                                  {"-remap", {"perspective", "0.9", "0.1", "2", "-0.05", "1.1",
+                                                              "-3", "0.001", "0.002"}}}) {
+        CheckSimdAndThreadsAgree(pixels, {filter});
+    }
+
+    {
+        std::string directory = "test_remap_cache";
+        std::filesystem::remove_all(directory);
+        RemapModel model{.kind = RemapKind::kLens, .coefficients = {0.125}};
+        auto map = GetRemapMap(model, width, height, directory);
+        REQUIRE(GetRemapMap(model, width, height, directory) == map);
+        std::filesystem::directory_iterator files(directory);
+        REQUIRE(files->file_size() == kRemapFileHeaderBytesCount + 2 * width * height * sizeof(float));
+        MappedFile file(files->path().string());
+        size_t plane_bytes_count = width * height * sizeof(float);
+        const std::byte* xs = file.Bytes().data() + kRemapFileHeaderBytesCount;
+        REQUIRE(std::memcmp(xs, map->RowXs(0), plane_bytes_count) == 0);
+        REQUIRE(std::memcmp(xs + plane_bytes_count, map->RowYs(0), plane_bytes_count) == 0);
+        std::filesystem::remove_all(directory);
+    }
+    {
+        // A cache that can not be written falls back to the maps in memory and leaves no file.
+        std::string blocker = "test_remap_cache_blocker";
+        std::ofstream(blocker) << "not a directory";
+        for (const auto& directory : {blocker, blocker + "/maps"}) {
+            RemapModel model{.kind = RemapKind::kLens, .coefficients = {directory == blocker ? 0.0625 : 0.25}};
+            auto map = GetRemapMap(model, width, height, directory);
+            RemapMap expected(model, width, height);
+            REQUIRE(std::memcmp(map->RowXs(0), expected.RowXs(0), width * height * sizeof(float)) == 0);
+        }
+        Filter remap{.filter_name = "-remap", .filter_params = {"lens", "0.375"}};
+        PixelMatrix cached = ApplyToPixels(pixels, {remap}, ProcessingOptions{.remap_cache_directory = blocker});
+        CheckMatricesEquality(cached, ApplyToPixels(pixels, {remap}));
+        REQUIRE(std::filesystem::is_regular_file(blocker));
+        std::filesystem::remove(blocker);
+    }
+
+    REQUIRE_THROWS_AS(Remap({"lens"}), FiltersProcessingException);
+    REQUIRE_THROWS_AS(Remap({"lens", "0.1", "0.2", "0.3"}), FiltersProcessingException);
+    REQUIRE_THROWS_AS(Remap({"fisheye", "0.1"}), FiltersProcessingException);
+    REQUIRE_THROWS_AS(Remap({"perspective", "1", "2", "0", "2", "4", "0", "0", "0"}), FiltersProcessingException);
+}
+
+TEST_CASE("FilterPixelate") {
+    constexpr size_t height = 29;
+    constexpr size_t width = 37;
+
+    std::mt19937 generator(12);
+    std::uniform_int_distribution<int> distribution(kMinRgb, kMaxRgb);
+    ColorPlanes planes = {Plane(width, height), Plane(width, height), Plane(width, height)};
+    for (auto& plane : planes) {
+        for (size_t y = 0; y < height; ++y) {
+            for (size_t x = 0; x < width; ++x) {
+                plane.Row(y)[x] = static_cast<uint8_t>(distribution(generator));
+            }
+        }
+    }
+
+    for (size_t threads : {1, 3}) {
+        SetThreadCount(threads);
+        IntegralImage<uint32_t> narrow(planes[0]);
+        IntegralImage<uint64_t> wide(planes[0], 3, 2, 30, 25);
+        for (size_t box = 0; box < 200; ++box) {
+            size_t x = generator() % 30;
+            size_t y = generator() % 25;
+            size_t box_width = generator() % (30 - x) + 1;
+            size_t box_height = generator() % (25 - y) + 1;
+            uint64_t sum = 0;
+            for (size_t row = y; row < y + box_height; ++row) {
+                for (size_t column = x; column < x + box_width; ++column) {
+                    sum += planes[0].Row(row + 2)[column + 3];
+                }
+            }
+            REQUIRE(wide.BoxSum(x, y, box_width, box_height) == sum);
+            REQUIRE(narrow.BoxSum(x + 3, y + 2, box_width, box_height) == sum);
+        }
+    }
+    SetThreadCount(0);
+
+    BMP image;
+    image.SetPlanes(planes);
+    ApplyFilters({Filter{.filter_name = "-pixelate", .filter_params = {"4"}}}, image);
+    for (size_t channel = 0; channel < kAmountOfPrimaryColors; ++channel) {
+        Plane downscaled = DownscalePlane(planes[channel], 4);
+        for (size_t y = 0; y < height; ++y) {
+            for (size_t x = 0; x < width; ++x) {
+                REQUIRE(image.Planes()[channel].Row(y)[x] == downscaled.Row(y / 4)[x / 4]);
+            }
+        }
+    }
+
+    image.SetPlanes(planes);
+    ApplyFilters({Filter{.filter_name = "-pixelate", .filter_params = {"5", "10", "6", "12", "100"}}}, image);
+    IntegralImage<uint32_t> integral(planes[1]);
+    for (size_t y = 0; y < height; ++y) {
+        for (size_t x = 0; x < width; ++x) {
+            bool inside = x >= 10 && x < 22 && y >= 6;
+            uint8_t expected = planes[1].Row(y)[x];
+            if (inside) {
+                size_t block_x = 10 + (x - 10) / 5 * 5;
+                size_t block_y = 6 + (y - 6) / 5 * 5;
+                expected = integral.BoxMean(block_x, block_y, std::min<size_t>(5, 22 - block_x),
+                                            std::min<size_t>(5, height - block_y));
+            }
+            REQUIRE(image.Planes()[1].Row(y)[x] == expected);
+        }
+    }
+
+    REQUIRE_THROWS_AS(Pixelate({"0"}), FiltersProcessingException);
+    REQUIRE_THROWS_AS(Pixelate({"4", "1", "1"}), FiltersProcessingException);
+    REQUIRE_THROWS_AS(Pixelate({"4", "0", "0", "0", "5"}), FiltersProcessingException);
+    REQUIRE_THROWS_AS(Pixelate({"4", "40", "0", "5", "5"}).Apply(image), FiltersProcessingException);
+}
+
+TEST_CASE("FilterShuffle") {
+    constexpr size_t height = 17;
+    constexpr size_t width = 23;
+    constexpr size_t pieces_on_one_side = 3;
+    constexpr size_t piece_height = height / pieces_on_one_side;
+    constexpr size_t piece_width = width / pieces_on_one_side;
+
+    PixelMatrix pixels(height, std::vector<PixelColor>(width));
+    for (size_t y = 0; y < height; ++y) {
+        for (size_t x = 0; x < width; ++x) {
+            pixels[y][x] = {static_cast<uint8_t>(x), static_cast<uint8_t>(y), static_cast<uint8_t>(x * y)};
+        }
+    }
+    auto shuffle = [&pixels](const std::vector<std::string>& params, PixelLayout layout,
+                             const ProcessingOptions& options = {}) {
+        BMP image = MakeImage(pixels);
+        image.SetLayout(layout);
+        ApplyFilters({Filter{.filter_name = "-shuffle", .filter_params = params}}, image, options);
+        REQUIRE(image.GetLayout() == layout);
+        return image.PixelMatrix();
+    };
+
+    PixelMatrix shuffled = shuffle({"9", "5"}, PixelLayout::kInterleaved);
+    REQUIRE(shuffled.size() == piece_height * pieces_on_one_side);
+    REQUIRE(shuffled[0].size() == piece_width * pieces_on_one_side);
+    std::vector<bool> used(pieces_on_one_side * pieces_on_one_side);
+    for (size_t piece_y = 0; piece_y < pieces_on_one_side; ++piece_y) {
+        for (size_t piece_x = 0; piece_x < pieces_on_one_side; ++piece_x) {
+            const PixelColor& corner = shuffled[piece_y * piece_height][piece_x * piece_width];
+            size_t source_x = corner.r;
+            size_t source_y = corner.g;
+            REQUIRE(source_x % piece_width == 0);
+            REQUIRE(source_y % piece_height == 0);
+            size_t source_piece = source_y / piece_height * pieces_on_one_side + source_x / piece_width;
+            REQUIRE(!used[source_piece]);
+            used[source_piece] = true;
+            for (size_t y = 0; y < piece_height; ++y) {
+                for (size_t x = 0; x < piece_width; ++x) {
+                    REQUIRE(shuffled[piece_y * piece_height + y][piece_x * piece_width + x].b ==
+                            pixels[source_y + y][source_x + x].b);
+                }
+            }
+        }
+    }
+
+    CheckMatricesEquality(shuffle({"9", "5"}, PixelLayout::kPlanar), shuffled);
+    CheckMatricesEquality(shuffle({"9", "5"}, PixelLayout::kInterleaved, ProcessingOptions{.threads = 3}),
+                          shuffled);
+    CheckMatricesEquality(shuffle({"9"}, PixelLayout::kInterleaved),
+                          shuffle({"9", "0"}, PixelLayout::kInterleaved));
+    PixelMatrix gray = shuffle({"9", "5"}, PixelLayout::kGray);
+    REQUIRE(gray[0][0].g == CalculateGray(shuffled[0][0]));
+
+    REQUIRE_THROWS_AS(Shuffle({"8"}), FiltersProcessingException);
+    REQUIRE_THROWS_AS(Shuffle({"4", "-1"}), FiltersProcessingException);
+    REQUIRE_THROWS_AS(Shuffle({"4", "seed"}), FiltersProcessingException);
+}
+
 TEST_CASE("FilterSharpening") {
     {
         BMP image;
@@ -293,4 +1544,289 @@ TEST_CASE("FilterGaussianBlur") {
 
         CheckMatricesEquality(image.PixelMatrix(), expected);
     }
+    {
+        for (const char* sigma : {"0", "-1", "0.0001", "0.00001", "1e-6", "1e-300", "nan"}) {
+            REQUIRE_THROWS_AS(GaussianBlur({sigma}), FiltersProcessingException);
+        }
+
+        GaussianKernel<double> kernel = CalculateGaussianKernel(kMinGaussianSigma);
+        double kernel_sum = 0;
+        for (double coefficient : kernel.kernel) {
+            REQUIRE(std::isfinite(coefficient));
+            kernel_sum += coefficient;
+        }
+        REQUIRE(kernel_sum == Approx(1));
+        double matrix_sum = 0;
+        for (const auto& row : kernel.matrix) {
+            for (double coefficient : row) {
+                REQUIRE(std::isfinite(coefficient));
+                matrix_sum += coefficient;
+            }
+        }
+        REQUIRE(matrix_sum == Approx(1));
+    }
+}
+
+TEST_CASE("FilterEdgeDetection") {
+    {
+        constexpr size_t height = 23;
+        constexpr size_t width = 41;
+        constexpr int threshold = 12;
+
+        BMP image = MakeImage(MakeRandomPixels(width, height, 7));
+
+        BMP gray = image;
+        Grayscale grayscale({});
+        grayscale.Configure({.precision = Precision::kDouble});
+        grayscale.Apply(gray);
+        Plane convolved;
+        ConvolveDirect<double>(SplitToPlanes(gray.PixelMatrix())[0], convolved, kFilterEdgeDetectionMatrix);
+
+        EdgeDetection edge_detection({std::to_string(threshold)});
+        edge_detection.Configure({.precision = Precision::kDouble});
+        edge_detection.Apply(image);
+
+        for (size_t y = 0; y < height; ++y) {
+            for (size_t x = 0; x < width; ++x) {
+                uint8_t expected = convolved.Row(y)[x] > threshold ? kMaxRgb : kMinRgb;
+                REQUIRE(image.PixelMatrix()[y][x].r == expected);
+                REQUIRE(image.PixelMatrix()[y][x].g == expected);
+                REQUIRE(image.PixelMatrix()[y][x].b == expected);
+            }
+        }
+    }
+    {
+        // Every layout thresholds the same luma, and the result is a gray image.
+        PixelMatrix pixels = MakeRandomPixels(29, 17, 15);
+        BMP interleaved = MakeImage(pixels);
+        BMP planar = interleaved;
+        planar.SetLayout(PixelLayout::kPlanar);
+        BMP gray = interleaved;
+        gray.SetLayout(PixelLayout::kGray);
+        BMP indexed = interleaved;
+        ApplyFilters({Filter{.filter_name = "-quantize", .filter_params = {"16"}}}, indexed);
+        BMP expanded = indexed;
+        expanded.SetLayout(PixelLayout::kInterleaved);
+
+        for (auto* image : {&interleaved, &planar, &gray, &indexed, &expanded}) {
+            ApplyFilters({Filter{.filter_name = "-edge", .filter_params = {"20"}}}, *image);
+            REQUIRE(image->GetLayout() == PixelLayout::kGray);
+        }
+        REQUIRE(planar.Planes()[0] == interleaved.Planes()[0]);
+        REQUIRE(gray.Planes()[0] == interleaved.Planes()[0]);
+        REQUIRE(indexed.Planes()[0] == expanded.Planes()[0]);
+    }
+}
+
+TEST_CASE("ConvolutionSimd") {
+    {
+        constexpr size_t height = 29;
+        constexpr size_t width = 77;
+
+        PixelMatrix pixels = MakeRandomPixels(width, height, 42);
+
+        for (auto precision : {Precision::kFloat, Precision::kDouble}) {
+            CheckSimdAndThreadsAgree(pixels, {Filter{.filter_name = "-sharp"}}, {.precision = precision});
+            CheckSimdAndThreadsAgree(pixels, {Filter{.filter_name = "-blur", .filter_params = {"2.5"}}},
+                                     {.precision = precision});
+        }
+    }
+}
+
+TEST_CASE("ConvolutionPrecision") {
+    {
+        BMP image;
+        image.ResizeHeight(3);
+        image.ResizeWidth(3);
+        PixelMatrix pixels(3, std::vector<PixelColor>(3, {100, 100, 100}));
+        pixels[0][0].r = 200;
+        pixels[0][1].r = 150;
+        image.PixelMatrix() = pixels;
+
+        ApplyFilters({Filter{.filter_name = "-blur", .filter_params = {"1"}}}, image,
+                     {.precision = Precision::kDouble});
+
+        PixelMatrix expected(3, std::vector<PixelColor>(3, {100, 100, 100}));
+        expected[0][0].r = 135;
+        expected[1][0].r = 109;
+        expected[2][0].r = 101;
+        expected[0][1].r = 120;
+        expected[1][1].r = 105;
+        expected[2][1].r = 101;
+        expected[0][2].r = 104;
+        expected[1][2].r = 101;
+        expected[2][2].r = 100;
+
+        CheckMatricesEquality(image.PixelMatrix(), expected);
+    }
+    {
+        Parser parser;
+
+        constexpr size_t filters_count = 3;
+        const char* test_arguments[] = {".\\image_processor", ".\\examples\\example.bmp",
+                                        ".\\output\\program_test.bmp", "--precision", "double", "-gs"};
+
+        auto args = parser(kMinimalAmountOfArgs + filters_count, const_cast<char**>(test_arguments));
+        REQUIRE(args.filters.size() == 1);
+        REQUIRE(GetProcessingOptions(args.options).precision == Precision::kDouble);
+    }
+}
+
+TEST_CASE("LinearLight") {
+    {
+        for (int level = kMinRgb; level <= kMaxRgb; ++level) {
+            REQUIRE(LinearToSrgb(GetSrgbToLinearTable<float>()[level]) == level);
+            REQUIRE(LinearToSrgb(GetSrgbToLinearTable<double>()[level]) == level);
+        }
+        size_t mismatches = 0;
+        for (size_t step = 0; step <= 1000000; ++step) {
+            double linear = static_cast<double>(step) / 1000000;
+            mismatches += LinearToSrgb(linear) != std::lround(EncodeSrgb(linear) * kMaxRgb);
+        }
+        REQUIRE(mismatches == 0);
+        REQUIRE(LinearToSrgb(-1) == kMinRgb);
+        REQUIRE(LinearToSrgb(2) == kMaxRgb);
+
+        std::vector<float> linear_row(100003);
+        for (size_t i = 0; i < linear_row.size(); ++i) {
+            linear_row[i] = static_cast<float>(i) / 100000 * 1.2f - 0.1f;
+        }
+        linear_row[7] = std::numeric_limits<float>::quiet_NaN();
+        std::vector<uint8_t> levels_row(kSrgbLevelsCount);
+        std::iota(levels_row.begin(), levels_row.end(), 0);
+        std::vector<uint8_t> expected_encoded(linear_row.size());
+        std::vector<float> expected_decoded(levels_row.size());
+        SetSimdLevel(SimdLevel::kScalar);
+        EncodeSrgbRow(linear_row.data(), expected_encoded.data(), linear_row.size());
+        DecodeSrgbRow(levels_row.data(), expected_decoded.data(), levels_row.size());
+        REQUIRE(expected_encoded[7] == kMinRgb);
+        for (auto level : {SimdLevel::kSse41, SimdLevel::kAvx2, SimdLevel::kAvx512}) {
+            if (level > DetectSimdLevel()) {
+                continue;
+            }
+            SetSimdLevel(level);
+            std::vector<uint8_t> encoded(linear_row.size());
+            std::vector<float> decoded(levels_row.size());
+            EncodeSrgbRow(linear_row.data(), encoded.data(), linear_row.size());
+            DecodeSrgbRow(levels_row.data(), decoded.data(), levels_row.size());
+            REQUIRE(encoded == expected_encoded);
+            REQUIRE(decoded == expected_decoded);
+        }
+        SetSimdLevel(DetectSimdLevel());
+
+        Plane source(2, 1);
+        source.data = {0, 255};
+        const CoefficientsMatrix half = {{0, 0, 0}, {0, 0.5, 0.5}, {0, 0, 0}};
+        Plane encoded;
+        Plane linear;
+        ConvolveDirect<float>(source, encoded, half);
+        ConvolveDirect<float>(source, linear, half, LightMode::kLinear);
+        REQUIRE(encoded.data[0] == 128);
+        REQUIRE(linear.data[0] == LinearToSrgb(0.5));
+        REQUIRE(linear.data[1] == kMaxRgb);
+
+        Plane flat(40, 30);
+        std::fill(flat.data.begin(), flat.data.end(), 77);
+        CoefficientsMatrix box(kFftConvolutionMinMatrixSize,
+                               CoefficientsVector(kFftConvolutionMinMatrixSize,
+                                                  1.0 / (kFftConvolutionMinMatrixSize * kFftConvolutionMinMatrixSize)));
+        Plane blurred;
+        ConvolveFft(flat, blurred, box, LightMode::kLinear);
+        REQUIRE(blurred.data == flat.data);
+        auto gaussian = GetGaussianKernel<float>(2);
+        ConvolveSeparable(flat, blurred, gaussian->kernel, gaussian->kernel, LightMode::kLinear);
+        REQUIRE(blurred.data == flat.data);
+
+        REQUIRE(GetProcessingOptions({Option{.option_name = "--linear"}}).light == LightMode::kLinear);
+        REQUIRE_THROWS_AS(GetProcessingOptions({Option{.option_name = "--linear", .option_params = {"1"}}}),
+                          ParserException);
+    }
+}
+
+TEST_CASE("ConvolutionFft") {
+    std::mt19937 generator(7);
+    std::uniform_int_distribution<int> pixel_distribution(kMinRgb, kMaxRgb);
+    std::uniform_real_distribution<double> coefficient_distribution(-0.5, 1.0);
+
+    CoefficientsMatrix matrix(kFftConvolutionMinMatrixSize, CoefficientsVector(kFftConvolutionMinMatrixSize));
+    double sum = 0;
+    for (auto& row : matrix) {
+        for (auto& coefficient : row) {
+            coefficient = coefficient_distribution(generator);
+            sum += coefficient;
+        }
+    }
+    for (auto& row : matrix) {
+        for (auto& coefficient : row) {
+            coefficient /= sum;
+        }
+    }
+
+    for (auto [width, height] : {std::pair<size_t, size_t>{301, 157}, std::pair<size_t, size_t>{10, 7},
+                                 std::pair<size_t, size_t>{90, 530}}) {
+        Plane source(width, height);
+        for (auto& value : source.data) {
+            value = static_cast<uint8_t>(pixel_distribution(generator));
+        }
+
+        Plane direct;
+        Plane fft;
+        ConvolveDirect<double>(source, direct, matrix);
+        ConvolveFft(source, fft, matrix);
+
+        REQUIRE(fft.width == direct.width);
+        REQUIRE(fft.height == direct.height);
+        for (size_t i = 0; i < direct.data.size(); ++i) {
+            REQUIRE(std::abs(static_cast<int>(fft.data[i]) - static_cast<int>(direct.data[i])) <= 1);
+        }
+
+        // Bands of tile rows recompute their overlap, so the thread count doesn't change a pixel.
+        for (size_t threads : {1, 2, 3}) {
+            SetThreadCount(threads);
+            Plane banded;
+            ConvolveFft(source, banded, matrix);
+            REQUIRE(banded == fft);
+        }
+        SetThreadCount(0);
+    }
+
+    {
+        // Wide kernels of the double-precision blur reach the FFT path from the filter.
+        auto kernel = GetGaussianKernel<double>(9);
+        REQUIRE(kernel->matrix.size() >= kFftConvolutionMinMatrixSize);
+
+        PixelMatrix pixels = MakeRandomPixels(110, 140, 7);
+        Filter blur{.filter_name = "-blur", .filter_params = {"9"}};
+        PixelMatrix blurred = ApplyToPixels(pixels, {blur}, {.precision = Precision::kDouble});
+
+        BMP reference = MakeImage(pixels);
+        for (auto& plane : reference.Planes()) {
+            Plane convolved;
+            ConvolveFft(plane, convolved, kernel->matrix);
+            plane = std::move(convolved);
+        }
+        CheckMatricesEquality(blurred, reference.PixelMatrix());
+        CheckSimdAndThreadsAgree(pixels, {blur}, {.precision = Precision::kDouble});
+    }
+}
+
+TEST_CASE("GaussianKernelCache") {
+    for (auto sigma : kStandardGaussianSigmas) {
+        auto cached = GetGaussianKernel<double>(sigma);
+        auto calculated = CalculateGaussianKernel(sigma);
+
+        REQUIRE(cached == GetGaussianKernel<double>(sigma));
+        REQUIRE(cached->matrix == calculated.matrix);
+        REQUIRE(cached->kernel == calculated.kernel);
+        for (size_t y = 0; y < cached->kernel.size(); ++y) {
+            for (size_t x = 0; x < cached->kernel.size(); ++x) {
+                REQUIRE(cached->matrix[y][x] == Approx(cached->kernel[y] * cached->kernel[x]));
+            }
+        }
+    }
+    {
+        auto kernel = GetGaussianKernel<double>(1.7);
+        REQUIRE(kernel == GetGaussianKernel<double>(1.7));
+        REQUIRE(kernel->kernel.size() == 5);
+    }
 }
@@ -0,0 +1,216 @@
+#include "warp.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numbers>
+
+#include "parallel.h"
+#include "simd.h"
+
+namespace {
+
+// Sampling parameters of one destination row; coordinates are clamped to the last pixel
+// centres, which only matters for rounding at the bounds.
+struct WarpRow {
+    std::span<const Plane> sources;
+    const float* levels;
+    float start_x;
+    float start_y;
+    float step_x;
+    float step_y;
+    float last_x;
+    float last_y;
+};
+
+void WarpPixelScalar(const WarpRow& row, size_t x, float* const* values) {
+    auto position = static_cast<float>(x);
+    float source_x = std::min(std::max(row.start_x + position * row.step_x, 0.0f), row.last_x);
+    float source_y = std::min(std::max(row.start_y + position * row.step_y, 0.0f), row.last_y);
+    float floor_x = std::floor(source_x);
+    float floor_y = std::floor(source_y);
+    float fraction_x = source_x - floor_x;
+    float fraction_y = source_y - floor_y;
+    auto left = static_cast<size_t>(floor_x);
+    auto top = static_cast<size_t>(floor_y);
+    size_t right = BorderCoordinate(left, 1, row.sources[0].width);
+    size_t bottom = BorderCoordinate(top, 1, row.sources[0].height);
+
+    for (size_t plane = 0; plane < row.sources.size(); ++plane) {
+        const uint8_t* top_row = row.sources[plane].Row(top);
+        const uint8_t* bottom_row = row.sources[plane].Row(bottom);
+        float top_value = row.levels[top_row[left]] * (1 - fraction_x) + row.levels[top_row[right]] * fraction_x;
+        float bottom_value = row.levels[bottom_row[left]] * (1 - fraction_x) +
+                             row.levels[bottom_row[right]] * fraction_x;
+        values[plane][x] = top_value * (1 - fraction_y) + bottom_value * fraction_y;
+    }
+}
+
+#ifdef IMAGE_PROCESSOR_X86
+
+// Each gather reads four bytes from the left tap on, so a vector only runs when all its
+// taps are at least four pixels from the right edge and above the last row; other vectors
+// go through WarpPixelScalar. The taps of all planes share offsets, so their strides must match.
+IMAGE_PROCESSOR_TARGET("avx2")
+size_t WarpRowAvx2(const WarpRow& row, size_t begin, size_t end, float* const* values) {
+    const __m256 lanes = _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7);
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 one = _mm256_set1_ps(1.0f);
+    const __m256i byte_mask = _mm256_set1_epi32(0xFF);
+    const __m256i last_left = _mm256_set1_epi32(static_cast<int>(row.sources[0].width) - 4);
+    const __m256i last_top = _mm256_set1_epi32(static_cast<int>(row.sources[0].height) - 2);
+    const __m256i stride = _mm256_set1_epi32(static_cast<int>(row.sources[0].stride));
+    for (const auto& source : row.sources) {
+        if (source.stride != row.sources[0].stride) {
+            return begin;
+        }
+    }
+    size_t x = begin;
+    for (; x + kWarpLanes <= end; x += kWarpLanes) {
+        __m256 positions = _mm256_add_ps(_mm256_set1_ps(static_cast<float>(x)), lanes);
+        __m256 source_x = _mm256_add_ps(_mm256_set1_ps(row.start_x),
+                                        _mm256_mul_ps(positions, _mm256_set1_ps(row.step_x)));
+        __m256 source_y = _mm256_add_ps(_mm256_set1_ps(row.start_y),
+                                        _mm256_mul_ps(positions, _mm256_set1_ps(row.step_y)));
+        source_x = _mm256_min_ps(_mm256_max_ps(source_x, zero), _mm256_set1_ps(row.last_x));
+        source_y = _mm256_min_ps(_mm256_max_ps(source_y, zero), _mm256_set1_ps(row.last_y));
+        __m256 floor_x = _mm256_floor_ps(source_x);
+        __m256 floor_y = _mm256_floor_ps(source_y);
+        __m256i left = _mm256_cvttps_epi32(floor_x);
+        __m256i top = _mm256_cvttps_epi32(floor_y);
+        __m256i outside = _mm256_or_si256(_mm256_cmpgt_epi32(left, last_left), _mm256_cmpgt_epi32(top, last_top));
+        if (!_mm256_testz_si256(outside, outside)) {
+            for (size_t lane = 0; lane < kWarpLanes; ++lane) {
+                WarpPixelScalar(row, x + lane, values);
+            }
+            continue;
+        }
+
+        __m256 fraction_x = _mm256_sub_ps(source_x, floor_x);
+        __m256 fraction_y = _mm256_sub_ps(source_y, floor_y);
+        __m256 rest_x = _mm256_sub_ps(one, fraction_x);
+        __m256 rest_y = _mm256_sub_ps(one, fraction_y);
+        __m256i offsets = _mm256_add_epi32(_mm256_mullo_epi32(top, stride), left);
+        for (size_t plane = 0; plane < row.sources.size(); ++plane) {
+            const uint8_t* top_row = row.sources[plane].Row(0);
+            const uint8_t* bottom_row = row.sources[plane].Row(1);
+            __m256i top_taps = _mm256_i32gather_epi32(reinterpret_cast<const int*>(top_row), offsets, 1);
+            __m256i bottom_taps = _mm256_i32gather_epi32(reinterpret_cast<const int*>(bottom_row), offsets, 1);
+            __m256 top_left = _mm256_i32gather_ps(row.levels, _mm256_and_si256(top_taps, byte_mask), 4);
+            __m256 top_right = _mm256_i32gather_ps(
+                    row.levels, _mm256_and_si256(_mm256_srli_epi32(top_taps, 8), byte_mask), 4);
+            __m256 bottom_left = _mm256_i32gather_ps(row.levels, _mm256_and_si256(bottom_taps, byte_mask), 4);
+            __m256 bottom_right = _mm256_i32gather_ps(
+                    row.levels, _mm256_and_si256(_mm256_srli_epi32(bottom_taps, 8), byte_mask), 4);
+            __m256 top_value = _mm256_add_ps(_mm256_mul_ps(top_left, rest_x), _mm256_mul_ps(top_right, fraction_x));
+            __m256 bottom_value = _mm256_add_ps(_mm256_mul_ps(bottom_left, rest_x),
+                                                _mm256_mul_ps(bottom_right, fraction_x));
+            _mm256_storeu_ps(values[plane] + x, _mm256_add_ps(_mm256_mul_ps(top_value, rest_y),
+                                                              _mm256_mul_ps(bottom_value, fraction_y)));
+        }
+    }
+    return x;
+}
+
+#endif
+
+// Returns the first pixel left for WarpPixelScalar.
+size_t WarpRowVector(const WarpRow& row, size_t begin, size_t end, float* const* values) {
+#ifdef IMAGE_PROCESSOR_X86
+    if (GetSimdLevel() >= SimdLevel::kAvx2) {
+        return WarpRowAvx2(row, begin, end, values);
+    }
+#endif
+    return begin;
+}
+
+// Narrows [begin, end) of x, given as doubles, to where start + x * step lies in [0, last].
+void ClipToSource(double start, double step, double last, double& begin, double& end) {
+    if (step == 0) {
+        if (start < 0 || start > last) {
+            end = begin;
+        }
+        return;
+    }
+    double first = -start / step;
+    double second = (last - start) / step;
+    begin = std::max(begin, std::ceil(std::min(first, second)));
+    end = std::min(end, std::floor(std::max(first, second)) + 1);
+}
+
+}  // namespace
+
+AffineMatrix MakeRotationAffineMatrix(double degrees, size_t width, size_t height) {
+    double angle = degrees * std::numbers::pi / 180;
+    double cosine = std::cos(angle);
+    double sine = std::sin(angle);
+    double centre_x = (static_cast<double>(width) - 1) / 2;
+    double centre_y = (static_cast<double>(height) - 1) / 2;
+    return {{{cosine, -sine, centre_x - cosine * centre_x + sine * centre_y},
+             {sine, cosine, centre_y - sine * centre_x - cosine * centre_y}}};
+}
+
+std::optional<AffineMatrix> InvertAffineMatrix(const AffineMatrix& matrix) {
+    double determinant = matrix[0][0] * matrix[1][1] - matrix[0][1] * matrix[1][0];
+    if (determinant == 0 || !std::isfinite(determinant)) {
+        return std::nullopt;
+    }
+    AffineMatrix inverse;
+    inverse[0][0] = matrix[1][1] / determinant;
+    inverse[0][1] = -matrix[0][1] / determinant;
+    inverse[1][0] = -matrix[1][0] / determinant;
+    inverse[1][1] = matrix[0][0] / determinant;
+    inverse[0][2] = -(inverse[0][0] * matrix[0][2] + inverse[0][1] * matrix[1][2]);
+    inverse[1][2] = -(inverse[1][0] * matrix[0][2] + inverse[1][1] * matrix[1][2]);
+    return inverse;
+}
+
+void WarpPlanes(std::span<const Plane> sources, std::span<Plane> destinations, const AffineMatrix& to_source,
+                LightMode light) {
+    const RowKernels<float> kernels = ActiveRowKernels<float>(light);
+    std::array<uint8_t, kMaxRgb + 1> all_levels;
+    for (size_t level = 0; level <= kMaxRgb; ++level) {
+        all_levels[level] = static_cast<uint8_t>(level);
+    }
+    std::array<float, kMaxRgb + 1> levels;
+    kernels.widen(all_levels.data(), levels.data(), levels.size());
+
+    size_t width = destinations[0].width;
+    double last_x = static_cast<double>(sources[0].width) - 1;
+    double last_y = static_cast<double>(sources[0].height) - 1;
+    ParallelFor(destinations[0].height, [&](size_t, size_t begin, size_t end) {
+        std::vector<float> buffer(sources.size() * width);
+        std::vector<float*> values(sources.size());
+        for (size_t plane = 0; plane < sources.size(); ++plane) {
+            values[plane] = buffer.data() + plane * width;
+        }
+
+        for (size_t y = begin; y < end; ++y) {
+            double start_x = to_source[0][1] * static_cast<double>(y) + to_source[0][2];
+            double start_y = to_source[1][1] * static_cast<double>(y) + to_source[1][2];
+            double row_begin = 0;
+            double row_end = static_cast<double>(width);
+            ClipToSource(start_x, to_source[0][0], last_x, row_begin, row_end);
+            ClipToSource(start_y, to_source[1][0], last_y, row_begin, row_end);
+            if (row_begin >= row_end) {
+                continue;
+            }
+
+            WarpRow row{.sources = sources,
+                        .levels = levels.data(),
+                        .start_x = static_cast<float>(start_x),
+                        .start_y = static_cast<float>(start_y),
+                        .step_x = static_cast<float>(to_source[0][0]),
+                        .step_y = static_cast<float>(to_source[1][0]),
+                        .last_x = static_cast<float>(last_x),
+                        .last_y = static_cast<float>(last_y)};
+            auto first = static_cast<size_t>(row_begin);
+            auto last = static_cast<size_t>(row_end);
+            for (size_t x = WarpRowVector(row, first, last, values.data()); x < last; ++x) {
+                WarpPixelScalar(row, x, values.data());
+            }
+            for (size_t plane = 0; plane < sources.size(); ++plane) {
+                kernels.narrow(values[plane] + first, destinations[plane].Row(y) + first, last - first);
+            }
+        }
+    });
+}
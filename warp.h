@@ -0,0 +1,32 @@
+#pragma once
+
+#include <array>
+#include <optional>
+#include <span>
+
+#include "bmp_processing.h"
+#include "convolution.h"
+
+constexpr size_t kAffineMatrixColumns = 3;
+// Destination pixels are sampled this many at a time, in vectors or in scalar chunks.
+constexpr size_t kWarpLanes = 8;
+
+// Maps (x, y) to (m[0][0] x + m[0][1] y + m[0][2], m[1][0] x + m[1][1] y + m[1][2]). Pixel centres
+// are at integer coordinates.
+typedef std::array<std::array<double, kAffineMatrixColumns>, 2> AffineMatrix;
+
+constexpr AffineMatrix kIdentityAffineMatrix = {{{1, 0, 0}, {0, 1, 0}}};
+
+// Clockwise, as seen with rows going down, about the centre of a width x height image.
+AffineMatrix MakeRotationAffineMatrix(double degrees, size_t width, size_t height);
+// No value for a matrix that collapses the plane.
+std::optional<AffineMatrix> InvertAffineMatrix(const AffineMatrix& matrix);
+
+// Sets every destination pixel (x, y) of every plane to its source plane sampled bilinearly at
+// to_source(x, y); destinations keep their size and their pixels whose sample falls outside
+// the source. Per row the samples lie between two x bounds, so only those are computed, as
+// row start + x * step: no per-pixel matrix product and no drift along the row. The right and
+// bottom taps follow BorderCoordinate. Rows are split into bands across threads, and the vector
+// path gathers the taps of eight pixels at once with the same float steps as the scalar one.
+void WarpPlanes(std::span<const Plane> sources, std::span<Plane> destinations, const AffineMatrix& to_source,
+                LightMode light = LightMode::kEncoded);